@@ -0,0 +1,309 @@
+#include "batchrunner.h"
+#include "exparser.h"
+#include "fileloader.h"
+#include "filesaver.h"
+#include <QCoreApplication>
+#include <QFile>
+#include <QKeyEvent>
+
+BatchRunner::BatchRunner(const QStringList& script, const QStringList& files, int jobs, QObject* parent)
+    : QObject(parent)
+    , m_script(script)
+    , m_jobs(qMax(1, jobs))
+    , m_log(stderr)
+{
+    for (const QString& name : files)
+    {
+        auto file = std::make_shared<File>();
+        file->name = name;
+        m_files.append(file);
+    }
+
+    // the last message of a command tells whether it failed
+    connect(&m_editor, &VimTextEdit::commandChanged, this,
+            [this](const QString& message) { m_lastMessage = message; });
+}
+
+BatchRunner::~BatchRunner()
+{
+    for (const std::shared_ptr<File>& file : m_files)
+        delete file->loader;
+    // savers finish their file before they go
+    qDeleteAll(m_savers);
+}
+
+/**
+ * @brief reads the lines of a script, leaving out blank lines and comments
+ */
+bool BatchRunner::readScript(const QString& filename, QStringList& script, QString& error)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        error = filename + ": " + file.errorString();
+        return false;
+    }
+    const QString text = QString::fromUtf8(file.readAll());
+    for (const QString& line : text.split('\n'))
+    {
+        const QString command = line.trimmed();
+        if (!command.isEmpty() && !command.startsWith('"'))
+            script.append(command);
+    }
+    return true;
+}
+
+void BatchRunner::start()
+{
+    loadNext();
+    finishIfDone();
+}
+
+// Pipeline
+// --------------
+/**
+ * @brief starts loading files until `jobs` of them are loading or waiting for the script
+ */
+void BatchRunner::loadNext()
+{
+    while (m_nextLoad < m_files.size() && m_nextLoad - m_nextEdit < m_jobs)
+    {
+        std::shared_ptr<File> file = m_files[m_nextLoad++];
+        file->loader = new FileLoader(file->name, this);
+        FileLoader* loader = file->loader;
+
+        connect(loader, &FileLoader::formatDetected, loader,
+                [file](const TextCodec::Format& format) { file->format = format; });
+
+        // the chunks are kept until the script gets to the file
+        connect(loader, &FileLoader::chunkLoaded, loader,
+                [file](const QString& text) {
+                    file->chunks.append(text);
+                    file->loader->chunkConsumed();
+        });
+
+        auto done = [this, file] {
+            file->loaded = true;
+            file->loader->deleteLater();
+            file->loader = nullptr;
+            editNext();
+        };
+        connect(loader, &FileLoader::finished, loader, done);
+        connect(loader, &FileLoader::failed, loader,
+                [this, file, done](const QString& error) {
+                    report(*file, "can't open: " + error);
+                    file->failed = true;
+                    done();
+        });
+
+        loader->start();
+    }
+}
+
+/**
+ * @brief runs the script on the loaded files in order, while fewer than `jobs` of them are being saved
+ */
+void BatchRunner::editNext()
+{
+    // a command waiting for a substitution gets here through the event loop
+    if (m_editing)
+        return;
+    m_editing = true;
+
+    while (m_nextEdit < m_files.size() && m_files[m_nextEdit]->loaded && m_savers.size() < m_jobs)
+    {
+        const std::shared_ptr<File> file = m_files[m_nextEdit++];
+        // the next file loads while this one is edited
+        loadNext();
+        if (file->failed)
+        {
+            ++m_failures;
+            continue;
+        }
+
+        m_editor.beginLoad();
+        for (const QString& chunk : std::as_const(file->chunks))
+            m_editor.appendLoaded(chunk);
+        file->chunks.clear();
+        m_editor.endLoad();
+        const quint64 loaded = m_editor.revision();
+
+        bool discard = false;
+        if (!runScript(*file, discard))
+            ++m_failures;
+        if (!discard && m_editor.revision() != loaded)
+            save(*file);
+    }
+
+    m_editing = false;
+    finishIfDone();
+}
+
+void BatchRunner::save(const File& file)
+{
+    FileSaver* saver = new FileSaver(file.name, m_editor.buffer(), file.format, this);
+    m_savers.append(saver);
+
+    auto done = [this, saver] {
+        m_savers.removeOne(saver);
+        saver->deleteLater();
+        editNext();
+    };
+    connect(saver, &FileSaver::finished, this,
+            [this, done] {
+                ++m_written;
+                done();
+    });
+    connect(saver, &FileSaver::failed, this,
+            [this, saver, done](const QString& error) {
+                m_log << saver->filename() << ": can't save: " << error << Qt::endl;
+                ++m_failures;
+                done();
+    });
+
+    saver->start();
+}
+
+void BatchRunner::finishIfDone()
+{
+    if (m_editing || m_nextEdit < m_files.size() || !m_savers.isEmpty())
+        return;
+    m_log << m_files.size() << " files, " << m_written << " written, " << m_failures << " failed" << Qt::endl;
+    emit finished();
+}
+
+void BatchRunner::report(const File& file, const QString& message)
+{
+    m_log << file.name << ": " << message << Qt::endl;
+}
+
+// Script
+// --------------
+static bool isError(const QString& message)
+{
+    // E486: Pattern not found, E492: Not an editor command, ...
+    qsizetype digits = 1;
+    while (digits < message.size() && message[digits].isDigit())
+        ++digits;
+    return message.startsWith('E') && digits > 1 && digits < message.size() && message[digits] == ':';
+}
+
+/**
+ * @brief runs the script on the text in the editor, false if a command failed
+ *
+ * A failed command is reported and the script goes on, like Vim's ex mode.
+ * discard is set by :q!, the changes are not to be written then.
+ */
+bool BatchRunner::runScript(const File& file, bool& discard)
+{
+    bool ok = true;
+    for (qsizetype i = 0; i < m_script.size(); ++i)
+    {
+        QStringView command = m_script[i];
+        while (command.startsWith(':'))
+            command = command.sliced(1).trimmed();
+
+        ExParser::Context context;
+        context.lineCount = m_editor.buffer().lineCount();
+        const ExCommand ex = ExParser::parse(command, context);
+        const QString& name = ex.name;
+
+        // writing and quitting are up to the runner, the file is written once at the end
+        if (name == "w" || name == "write")
+            continue;
+        if (name == "wq" || name == "x" || name == "xit" || name == "exit")
+            break;
+        if (name == "q" || name == "quit" || name == "qa" || name == "qall")
+        {
+            discard = ex.bang;
+            break;
+        }
+
+        m_lastMessage.clear();
+        if (name == "norm" || name == "normal")
+        {
+            sendKeys(QStringView(ex.argument).trimmed());
+            // an unfinished command is dropped, like :normal does
+            sendKey(Qt::Key_Escape, Qt::NoModifier, QString());
+        }
+        else
+        {
+            runCommand(command.toString());
+        }
+
+        if (isError(m_lastMessage))
+        {
+            report(file, QString("line %1: %2").arg(i + 1).arg(m_lastMessage));
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/**
+ * @brief types an Ex command on the : command line and waits until it's done
+ */
+void BatchRunner::runCommand(const QString& command)
+{
+    sendKey(Qt::Key_Colon, Qt::NoModifier, ":");
+    // the command line takes the text of a key at once
+    sendKey(Qt::Key_unknown, Qt::NoModifier, command);
+    sendKey(Qt::Key_Return, Qt::NoModifier, "\r");
+
+    // a substitution is applied once all of its matches are known
+    while (m_editor.isBusy())
+        QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+}
+
+/**
+ * @brief types keys in Vim's key notation: <Esc>, <CR>, <BS>, <Tab>, <Space>, <lt>, <C-x>
+ */
+void BatchRunner::sendKeys(QStringView keys)
+{
+    for (qsizetype i = 0; i < keys.size(); ++i)
+    {
+        const QChar ch = keys[i];
+        const qsizetype close = ch == '<' ? keys.indexOf('>', i) : -1;
+        if (close > i)
+        {
+            const QString name = keys.mid(i + 1, close - i - 1).toString().toLower();
+            bool known = true;
+            if (name == "esc")
+                sendKey(Qt::Key_Escape, Qt::NoModifier, QString());
+            else if (name == "cr" || name == "enter" || name == "return")
+                sendKey(Qt::Key_Return, Qt::NoModifier, "\r");
+            else if (name == "bs")
+                sendKey(Qt::Key_Backspace, Qt::NoModifier, QString(QChar(0x08)));
+            else if (name == "tab")
+                sendKey(Qt::Key_Tab, Qt::NoModifier, "\t");
+            else if (name == "space")
+                sendKey(Qt::Key_Space, Qt::NoModifier, " ");
+            else if (name == "lt")
+                sendKey(Qt::Key_Less, Qt::NoModifier, "<");
+            else if (name.size() == 3 && name.startsWith("c-") && name[2] >= 'a' && name[2] <= 'z')
+                sendKey(Qt::Key(Qt::Key_A + (name[2].unicode() - 'a')), Qt::ControlModifier,
+                        QString(QChar(name[2].unicode() - 'a' + 1)));
+            else
+                known = false;
+
+            if (known)
+            {
+                i = close;
+                continue;
+            }
+        }
+
+        // Qt's key codes of ASCII chars are the chars themselves, upper case for letters
+        const char16_t unicode = ch.toUpper().unicode();
+        const Qt::Key key = unicode >= 0x20 && unicode < 0x7f ? Qt::Key(unicode) : Qt::Key_unknown;
+        sendKey(key, ch.isUpper() ? Qt::ShiftModifier : Qt::NoModifier, QString(ch));
+    }
+}
+
+void BatchRunner::sendKey(Qt::Key key, Qt::KeyboardModifiers modifiers, const QString& text)
+{
+    QKeyEvent press(QEvent::KeyPress, key, modifiers, text);
+    QCoreApplication::sendEvent(&m_editor, &press);
+    QKeyEvent release(QEvent::KeyRelease, key, modifiers, text);
+    QCoreApplication::sendEvent(&m_editor, &release);
+}
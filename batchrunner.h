@@ -0,0 +1,85 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include "vimtextedit.h"
+#include "textcodec.h"
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QTextStream>
+#include <memory>
+
+class FileLoader;
+class FileSaver;
+
+/**
+ * @brief runs a Vim script over files without a window: vimmy --batch -c script.vim file...
+ *
+ * Every line of the script is an Ex command run through the : command line
+ * of a VimTextEdit (a leading : is optional), or normal-mode keys with
+ * :normal {keys} (<Esc>, <CR>, <BS>, <Tab>, <Space>, <lt> and <C-x> name the
+ * special ones). Lines starting with " are comments.
+ * A file changed by the script is written back in its own format once the
+ * script ends, or stops at :wq, :x or :q; :q! leaves the file untouched.
+ *
+ * The editor is a widget, so the scripts run on the GUI thread one file
+ * at a time (a :s itself runs on all cores); meanwhile up to `jobs` files
+ * are read and decoded ahead of it and written behind it, each streamed
+ * in chunks by a FileLoader / FileSaver worker.
+ */
+class BatchRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    BatchRunner(const QStringList& script, const QStringList& files, int jobs, QObject* parent = nullptr);
+    ~BatchRunner();
+
+    void start();
+    // files that failed to load or save, or whose script had errors
+    inline int failures() const { return m_failures; }
+
+    static bool readScript(const QString& filename, QStringList& script, QString& error);
+
+signals:
+    void finished();
+
+private:
+    struct File
+    {
+        QString name;
+        FileLoader* loader = nullptr;
+        QStringList chunks;
+        TextCodec::Format format;
+        bool loaded = false;
+        bool failed = false;
+    };
+
+    void loadNext();
+    void editNext();
+    bool runScript(const File& file, bool& discard);
+    void runCommand(const QString& command);
+    void sendKey(Qt::Key key, Qt::KeyboardModifiers modifiers, const QString& text);
+    void sendKeys(QStringView keys);
+    void save(const File& file);
+    void finishIfDone();
+    void report(const File& file, const QString& message);
+
+    QStringList m_script;
+    int m_jobs = 1;
+
+    QList<std::shared_ptr<File>> m_files;
+    qsizetype m_nextLoad = 0;   // next file to start loading
+    qsizetype m_nextEdit = 0;   // next file to run the script on
+    QList<FileSaver*> m_savers;
+
+    VimTextEdit m_editor;
+    QString m_lastMessage;
+    bool m_editing = false;
+    int m_failures = 0;
+    int m_written = 0;
+    QTextStream m_log;
+};
+
+#endif // BATCHRUNNER_H
@@ -0,0 +1,507 @@
+#include "vimtextedit.h"
+#include "textbuffer.h"
+#include "searchengine.h"
+#include "wordmotion.h"
+#include "textcodec.h"
+#include "substitution.h"
+#include "parallelsubstitute.h"
+#include "parallelsearch.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QKeyEvent>
+#include <QProcess>
+#include <QRandomGenerator>
+#include <QTemporaryFile>
+#include <QTextDocument>
+#include <QThread>
+#include <QTextStream>
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <vector>
+
+/**
+ * vimmy_bench: per-keystroke latency of VimTextEdit, driven headlessly
+ *
+ * Every scenario puts the cursor at a random spot, sends its setup keys,
+ * then times its keys (sent as synthesized QKeyEvents, up to the point the
+ * editor is idle again) and sends its teardown keys.
+ * Results are written as JSON with p50/p99 latencies in microseconds.
+ *
+ *     vimmy_bench --sizes 1K,1M,64M --iterations 500 --output results.json
+ *
+ * The sweep scenarios time TextBuffer inserts and deletes without the
+ * widget, from 1K to 1G chars (--buffer-sizes).
+ */
+
+// Keys
+// --------------
+struct KeyStroke
+{
+    Qt::Key key;
+    Qt::KeyboardModifiers modifiers;
+    QString text;
+};
+
+static KeyStroke key(char ch)
+{
+    const bool upper = ch >= 'A' && ch <= 'Z';
+    const Qt::Key code = upper ? Qt::Key(Qt::Key_A + (ch - 'A'))
+                               : Qt::Key(Qt::Key_A + (ch - 'a'));
+    return KeyStroke{code, upper ? Qt::ShiftModifier : Qt::NoModifier, QString(QChar(ch))};
+}
+
+static const KeyStroke Escape{Qt::Key_CapsLock, Qt::NoModifier, QString()};
+static const KeyStroke CtrlV{Qt::Key_V, Qt::ControlModifier, QString(QChar(0x16))};
+
+static QList<KeyStroke> keys(const char* text)
+{
+    QList<KeyStroke> strokes;
+    for (const char* ch = text; *ch; ++ch)
+        strokes.append(key(*ch));
+    return strokes;
+}
+
+static void send(VimTextEdit& editor, const KeyStroke& stroke)
+{
+    QKeyEvent press(QEvent::KeyPress, stroke.key, stroke.modifiers, stroke.text);
+    QApplication::sendEvent(&editor, &press);
+    QKeyEvent release(QEvent::KeyRelease, stroke.key, stroke.modifiers, stroke.text);
+    QApplication::sendEvent(&editor, &release);
+}
+// --------------
+
+// Scenarios
+// --------------
+struct Scenario
+{
+    QString name;
+    QList<KeyStroke> setup;
+    QList<KeyStroke> timed;
+    QList<KeyStroke> teardown;
+};
+
+static QList<Scenario> editorScenarios()
+{
+    return {
+        {"h", {}, keys("h"), {}},
+        {"j", {}, keys("j"), {}},
+        {"k", {}, keys("k"), {}},
+        {"l", {}, keys("l"), {}},
+        {"w", {}, keys("w"), {}},
+        {"b", {}, keys("b"), {}},
+        {"e", {}, keys("e"), {}},
+        {"x", {}, keys("x"), {}},
+        {"dw", {}, keys("dw"), {}},
+        {"cw", {}, keys("cw"), {Escape}},
+        {"o", {}, keys("o"), {Escape}},
+        {"O", {}, keys("O"), {Escape}},
+        // counted changes, timed from the key that runs them
+        {"500x", keys("500"), keys("x"), {}},
+        {"200dd", keys("200d"), keys("d"), {}},
+        {"100o", keys("100oab"), {Escape}, {}},
+        {"dot-dw", keys("dw"), keys("."), {}},
+        {"50-dot-x", keys("x50"), keys("."), {}},
+        {"u", keys("dw"), keys("u"), {}},
+        {"yG", {}, keys("yG"), {}},
+        {"p", keys("yy"), keys("p"), {}},
+        // a 3 column block over 1000 lines
+        {"block-d", QList<KeyStroke>{CtrlV} + keys("999j2l"), keys("d"), {}},
+        {"block-I", QList<KeyStroke>{CtrlV} + keys("999jIab"), {Escape}, {}},
+        {"normal->insert", {}, keys("i"), {Escape}},
+        {"insert->normal", keys("i"), {Escape}, {}},
+        {"normal->visual", {}, keys("v"), {Escape}},
+    };
+}
+// --------------
+
+struct Stats
+{
+    qsizetype samples = 0;
+    double p50 = 0;
+    double p99 = 0;
+    double mean = 0;
+    double max = 0;
+};
+
+static Stats statsOf(std::vector<qint64>& nanoseconds)
+{
+    Stats stats;
+    if (nanoseconds.empty())
+        return stats;
+
+    std::sort(nanoseconds.begin(), nanoseconds.end());
+    auto percentile = [&](double p) {
+        size_t index = size_t(p * double(nanoseconds.size() - 1) + 0.5);
+        return double(nanoseconds[index]) / 1000.0;
+    };
+    double sum = 0;
+    for (qint64 ns : nanoseconds)
+        sum += double(ns);
+
+    stats.samples = qsizetype(nanoseconds.size());
+    stats.p50 = percentile(0.50);
+    stats.p99 = percentile(0.99);
+    stats.mean = sum / double(nanoseconds.size()) / 1000.0;
+    stats.max = double(nanoseconds.back()) / 1000.0;
+    return stats;
+}
+
+static QJsonObject toJson(const QString& group, const QString& name, qint64 size, const Stats& stats)
+{
+    return QJsonObject{
+        {"group", group},
+        {"scenario", name},
+        {"size", size},
+        {"samples", stats.samples},
+        {"p50_us", stats.p50},
+        {"p99_us", stats.p99},
+        {"mean_us", stats.mean},
+        {"max_us", stats.max},
+    };
+}
+
+/**
+ * @brief deterministic text of lines of words, about size chars, handed out in chunks
+ */
+static void generateText(qint64 size, const std::function<void(const QString&)>& consume)
+{
+    static const char* words[] = {
+        "int", "return", "vimmy", "buffer", "the", "cursor", "QString", "motion",
+        "piece", "table", "x", "search", "(void)", "{", "}", "i++;", "const", "line",
+    };
+    constexpr qint64 CHUNK_SIZE = 4 * 1024 * 1024;
+
+    QRandomGenerator rng(1);
+    QString chunk;
+    chunk.reserve(CHUNK_SIZE + 128);
+    qint64 generated = 0;
+    int column = 0;
+    while (generated < size)
+    {
+        const QLatin1String word(words[rng.bounded(int(std::size(words)))]);
+        chunk += word;
+        column += int(word.size());
+        // lines of 0 to 100 chars, some of them empty
+        if (column > int(rng.bounded(100)))
+        {
+            chunk += '\n';
+            if (rng.bounded(10) == 0)
+                chunk += '\n';
+            column = 0;
+        }
+        else
+            chunk += ' ';
+
+        if (chunk.size() >= CHUNK_SIZE || generated + chunk.size() >= size)
+        {
+            generated += chunk.size();
+            consume(chunk);
+            chunk.clear();
+        }
+    }
+}
+
+static qint64 parseSize(QString text)
+{
+    text = text.trimmed().toUpper();
+    qint64 unit = 1;
+    if (text.endsWith('K'))
+        unit = 1024;
+    else if (text.endsWith('M'))
+        unit = 1024 * 1024;
+    else if (text.endsWith('G'))
+        unit = 1024 * 1024 * 1024;
+    if (unit > 1)
+        text.chop(1);
+    return text.toLongLong() * unit;
+}
+
+int main(int argc, char* argv[])
+{
+    // no window system needed
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+    QApplication::setApplicationName("vimmy_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Keystroke latency benchmarks for Vimmy");
+    parser.addHelpOption();
+    parser.addOption({"sizes", "Comma separated document sizes (K, M, G suffixes), 1K to 1G.", "sizes", "1K,64K,1M,16M"});
+    parser.addOption({"buffer-sizes", "Comma separated sizes of the TextBuffer insert/delete sweep.", "sizes", "1K,1M,32M,1G"});
+    parser.addOption({"iterations", "Samples per scenario and size.", "count", "200"});
+    parser.addOption({"filter", "Only run scenarios whose name contains this text.", "text"});
+    parser.addOption({"output", "Write the JSON results to this file instead of stdout.", "file"});
+    parser.addOption({"editor", "Vimmy executable the startup scenarios launch.", "path",
+                      QDir(QCoreApplication::applicationDirPath()).filePath("Editor")});
+    parser.process(app);
+
+    const int iterations = qMax(1, parser.value("iterations").toInt());
+    const QString filter = parser.value("filter");
+    auto selected = [&](const QString& name) { return filter.isEmpty() || name.contains(filter); };
+    QString editorPath = parser.value("editor");
+#ifdef Q_OS_WIN
+    if (!editorPath.endsWith(".exe"))
+        editorPath += ".exe";
+#endif
+
+    QJsonArray results;
+    QJsonArray loads;
+    QTextStream log(stderr);
+
+    for (const QString& sizeText : parser.value("sizes").split(',', Qt::SkipEmptyParts))
+    {
+        const qint64 size = parseSize(sizeText);
+        if (size <= 0)
+        {
+            log << "invalid size: " << sizeText << Qt::endl;
+            return 1;
+        }
+        log << "document of " << size << " chars" << Qt::endl;
+
+        VimTextEdit editor;
+        editor.resize(1000, 800);
+        editor.show();
+
+        // loaded the way MainWindow loads a file
+        QElapsedTimer loadTimer;
+        loadTimer.start();
+        editor.beginLoad();
+        generateText(size, [&](const QString& chunk) { editor.appendLoaded(chunk); });
+        editor.endLoad();
+        QApplication::processEvents();
+        loads.append(QJsonObject{{"size", size}, {"load_ms", double(loadTimer.nsecsElapsed()) / 1e6}});
+
+        QRandomGenerator rng(2);
+        auto randomPosition = [&]() {
+            const qsizetype length = editor.buffer().length();
+            return int(length / 10 + rng.bounded(qint64(qMax(qsizetype(1), length * 8 / 10))));
+        };
+
+        // Keystrokes
+        for (const Scenario& scenario : editorScenarios())
+        {
+            if (!selected(scenario.name))
+                continue;
+
+            std::vector<qint64> samples;
+            samples.reserve(size_t(iterations));
+            QElapsedTimer timer;
+            for (int i = 0; i < iterations; ++i)
+            {
+                QTextCursor cursor = editor.textCursor();
+                cursor.setPosition(randomPosition());
+                editor.setTextCursor(cursor);
+                for (const KeyStroke& stroke : scenario.setup)
+                    send(editor, stroke);
+                QApplication::processEvents();
+
+                timer.start();
+                for (const KeyStroke& stroke : scenario.timed)
+                    send(editor, stroke);
+                QApplication::processEvents();
+                samples.push_back(timer.nsecsElapsed());
+
+                for (const KeyStroke& stroke : scenario.teardown)
+                    send(editor, stroke);
+            }
+            results.append(toJson("keys", scenario.name, size, statsOf(samples)));
+        }
+
+        // Engine: the building blocks, without the widget
+        const TextBuffer snapshot = editor.buffer();
+        auto runEngine = [&](const QString& name, int count, const std::function<void()>& operation) {
+            if (!selected(name))
+                return;
+            std::vector<qint64> samples;
+            samples.reserve(size_t(count));
+            QElapsedTimer timer;
+            for (int i = 0; i < count; ++i)
+            {
+                timer.start();
+                operation();
+                samples.push_back(timer.nsecsElapsed());
+            }
+            results.append(toJson("engine", name, size, statsOf(samples)));
+        };
+
+        TextBuffer buffer = snapshot;
+        runEngine("buffer-insert", iterations, [&]() { buffer.insert(randomPosition(), QStringView(u"vimmy")); });
+        runEngine("buffer-lineAt", iterations, [&]() { buffer.lineAt(randomPosition()); });
+        runEngine("word-motion-9w", iterations, [&]() {
+            WordMotion::move(snapshot, randomPosition(), WordMotion::NextWordStart, false, 9);
+        });
+        SearchEngine literal("cursor", SearchOptions());
+        runEngine("search-next", iterations, [&]() { literal.findNext(snapshot, randomPosition()); });
+        SearchOptions regexOptions;
+        regexOptions.regex = true;
+        SearchEngine regex("piece\\s+\\w+", regexOptions);
+        runEngine("regex-next", iterations, [&]() { regex.findNext(snapshot, randomPosition()); });
+        // whole document scans are slow on big documents, a few samples do
+        runEngine("search-all", qMin(iterations, 10), [&]() { literal.findAll(snapshot); });
+
+        // the same searches (case insensitive) with QTextDocument::find, on the document the editor shows
+        QTextDocument* document = editor.document();
+        runEngine("qtextdocument-find-next", iterations, [&]() { document->find("cursor", randomPosition()); });
+        runEngine("qtextdocument-find-all", qMin(iterations, 10), [&]() {
+            QTextCursor found(document);
+            while (!(found = document->find("cursor", found)).isNull())
+                ;
+        });
+
+        // search-all on 1, 2, 4, ... threads up to all cores, to see how the scan scales with them
+        ParallelSearch parallel;
+        std::vector<int> threadCounts;
+        for (int threads = 1; threads < QThread::idealThreadCount(); threads *= 2)
+            threadCounts.push_back(threads);
+        threadCounts.push_back(QThread::idealThreadCount());
+        for (int threads : threadCounts)
+        {
+            parallel.setThreadCount(threads);
+            runEngine(QString("parallel-search-%1t").arg(threads), qMin(iterations, 10), [&]() {
+                QEventLoop loop;
+                QObject::connect(&parallel, &ParallelSearch::finished, &loop, &QEventLoop::quit);
+                parallel.start(snapshot, literal);
+                loop.exec();
+            });
+        }
+
+        // :%s/piece/PIECE/g, matched and rebuilt on all cores (applying it is one edit on top)
+        const Substitution substitution = Substitution::substitute(u"/piece/PIECE/g", Substitution());
+        ParallelSubstitute substitute;
+        runEngine("substitute-all", qMin(iterations, 10), [&]() {
+            QEventLoop loop;
+            QObject::connect(&substitute, &ParallelSubstitute::finished, &loop, &QEventLoop::quit);
+            substitute.start(snapshot, substitution, 0, snapshot.lineCount() - 1);
+            loop.exec();
+        });
+
+        // what opening and saving the document costs, on top of the disk
+        if (selected("codec-encode") || selected("codec-decode"))
+        {
+            const QString text = snapshot.toString();
+            TextCodec::Format format;
+            format.lineEnding = TextCodec::CRLF;
+            QByteArray encoded;
+            TextCodec::encode(text, format, encoded);
+            runEngine("codec-encode", qMin(iterations, 10), [&]() {
+                QByteArray bytes;
+                TextCodec::encode(text, format, bytes);
+            });
+            runEngine("codec-decode", qMin(iterations, 10), [&]() {
+                const TextCodec::Format detected = TextCodec::detect(encoded.constData(), encoded.size());
+                TextCodec::decode(encoded.constData(), encoded.size(), detected);
+            });
+        }
+
+        // Startup: launching the editor on a file of this size until its first text is painted
+        if ((selected("startup-first-paint") || selected("startup-process")) && QFileInfo::exists(editorPath))
+        {
+            QTemporaryFile file(QDir::temp().filePath("vimmy_bench_XXXXXX.txt"));
+            if (!file.open())
+            {
+                log << "can't write " << file.fileName() << Qt::endl;
+                return 1;
+            }
+            generateText(size, [&](const QString& chunk) { file.write(chunk.toUtf8()); });
+            file.close();
+
+            std::vector<qint64> firstPaint;
+            std::vector<qint64> process;
+            QElapsedTimer timer;
+            for (int i = 0; i < qMin(iterations, 10); ++i)
+            {
+                QProcess editorProcess;
+                timer.start();
+                editorProcess.start(editorPath, {"--startup-time", file.fileName()});
+                if (!editorProcess.waitForFinished(60 * 1000))
+                {
+                    log << "the editor didn't paint " << file.fileName() << " within a minute" << Qt::endl;
+                    editorProcess.kill();
+                    editorProcess.waitForFinished();
+                    break;
+                }
+                process.push_back(timer.nsecsElapsed());
+                // first_paint_ms is counted from the editor's main()
+                const QJsonObject reported = QJsonDocument::fromJson(editorProcess.readAllStandardOutput()).object();
+                firstPaint.push_back(qint64(reported.value("first_paint_ms").toDouble() * 1e6));
+            }
+            if (selected("startup-first-paint"))
+                results.append(toJson("startup", "startup-first-paint", size, statsOf(firstPaint)));
+            if (selected("startup-process"))
+                results.append(toJson("startup", "startup-process", size, statsOf(process)));
+        }
+    }
+
+    // Sweep: TextBuffer inserts and deletes alone, up to sizes the widget can't hold
+    for (const QString& sizeText : parser.value("buffer-sizes").split(',', Qt::SkipEmptyParts))
+    {
+        if (!selected("sweep-insert") && !selected("sweep-delete"))
+            break;
+        const qint64 size = parseSize(sizeText);
+        if (size <= 0)
+        {
+            log << "invalid size: " << sizeText << Qt::endl;
+            return 1;
+        }
+        log << "buffer of " << size << " chars" << Qt::endl;
+
+        TextBuffer buffer;
+        generateText(size, [&](const QString& chunk) { buffer.append(chunk); });
+
+        QRandomGenerator rng(3);
+        auto randomPosition = [&]() { return qsizetype(rng.bounded(qint64(qMax(qsizetype(1), buffer.length() - 5)))); };
+        auto sweep = [&](const QString& name, const std::function<void(qsizetype)>& operation) {
+            if (!selected(name))
+                return;
+            std::vector<qint64> samples;
+            samples.reserve(size_t(iterations));
+            QElapsedTimer timer;
+            for (int i = 0; i < iterations; ++i)
+            {
+                const qsizetype position = randomPosition();
+                timer.start();
+                operation(position);
+                samples.push_back(timer.nsecsElapsed());
+            }
+            results.append(toJson("sweep", name, size, statsOf(samples)));
+        };
+        sweep("sweep-insert", [&](qsizetype position) { buffer.insert(position, QStringView(u"vimmy")); });
+        sweep("sweep-delete", [&](qsizetype position) { buffer.remove(position, 5); });
+    }
+
+    QJsonObject report{
+        {"benchmark", "vimmy_bench"},
+        {"qt", qVersion()},
+        {"platform", QApplication::platformName()},
+        {"iterations", iterations},
+        {"loads", loads},
+        {"results", results},
+    };
+    const QByteArray json = QJsonDocument(report).toJson();
+
+    if (parser.isSet("output"))
+    {
+        QFile file(parser.value("output"));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            log << "can't write " << file.fileName() << Qt::endl;
+            return 1;
+        }
+        file.write(json);
+    }
+    else
+        QTextStream(stdout) << json;
+    return 0;
+}
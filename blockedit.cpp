@@ -0,0 +1,105 @@
+#include "blockedit.h"
+#include <algorithm>
+
+BlockEdit::Block BlockEdit::blockOf(const TextBuffer& buffer, qsizetype anchor, qsizetype cursor, bool toLineEnd)
+{
+    const qsizetype anchorLine = buffer.lineAt(anchor);
+    const qsizetype cursorLine = buffer.lineAt(cursor);
+    const qsizetype anchorColumn = anchor - buffer.lineStart(anchorLine);
+    const qsizetype cursorColumn = cursor - buffer.lineStart(cursorLine);
+
+    Block block;
+    block.firstLine = qMin(anchorLine, cursorLine);
+    block.lastLine = qMax(anchorLine, cursorLine);
+    block.firstColumn = qMin(anchorColumn, cursorColumn);
+    block.lastColumn = qMax(anchorColumn, cursorColumn);
+    block.toLineEnd = toLineEnd;
+    return block;
+}
+
+QString BlockEdit::apply(const TextBuffer& buffer, const Block& block, Operation operation, QStringView text)
+{
+    // one copy of the lines, each line is then cut out of it by its offset
+    const qsizetype regionStart = buffer.lineStart(block.firstLine);
+    const QString region = buffer.text(regionStart, buffer.lineEnd(block.lastLine) - regionStart);
+
+    QString result;
+    const qsizetype lines = block.lastLine - block.firstLine + 1;
+    result.reserve(region.size() + (operation == Insert || operation == Append ? lines * text.size() : 0));
+
+    qsizetype start = 0;
+    for (qsizetype line = block.firstLine; line <= block.lastLine; ++line)
+    {
+        const qsizetype end = line == block.lastLine ? region.size() : buffer.lineStart(line + 1) - regionStart - 1;
+        if (line > block.firstLine)
+            result.append('\n');
+        editLine(result, QStringView(region).mid(start, end - start), block, operation, text);
+        start = end + 1;
+    }
+    return result;
+}
+
+QString BlockEdit::text(const TextBuffer& buffer, const Block& block)
+{
+    QString result;
+    for (qsizetype line = block.firstLine; line <= block.lastLine; ++line)
+    {
+        const qsizetype start = buffer.lineStart(line);
+        const qsizetype length = buffer.lineEnd(line) - start;
+        const qsizetype first = qMin(block.firstColumn, length);
+        const qsizetype last = block.toLineEnd ? length : qMin(block.lastColumn + 1, length);
+        if (line > block.firstLine)
+            result.append('\n');
+        result.append(buffer.text(start + first, last - first));
+    }
+    return result;
+}
+
+void BlockEdit::editLine(QString& result, QStringView line, const Block& block, Operation operation, QStringView text)
+{
+    const qsizetype length = line.size();
+    // [first, last) of the block on this line
+    const qsizetype first = qMin(block.firstColumn, length);
+    const qsizetype last = block.toLineEnd ? length : qMin(block.lastColumn + 1, length);
+
+    switch (operation)
+    {
+        case Delete:
+            result.append(line.first(first));
+            result.append(line.mid(last));
+            break;
+
+        case Insert:
+            // lines that don't reach into the block are left alone
+            if (length <= block.firstColumn && block.firstColumn > 0)
+            {
+                result.append(line);
+                break;
+            }
+            result.append(line.first(first));
+            result.append(text);
+            result.append(line.mid(first));
+            break;
+
+        case Append:
+        {
+            // short lines are padded up to the end of the block
+            const qsizetype column = block.toLineEnd ? length : block.lastColumn + 1;
+            result.append(line.first(qMin(column, length)));
+            if (length < column)
+                result.resize(result.size() + column - length, QChar(' '));
+            result.append(text);
+            result.append(line.mid(qMin(column, length)));
+            break;
+        }
+
+        case Replace:
+        {
+            const qsizetype offset = result.size();
+            result.append(line);
+            if (!text.isEmpty())
+                std::fill(result.data() + offset + first, result.data() + offset + last, text.front());
+            break;
+        }
+    }
+}
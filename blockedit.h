@@ -0,0 +1,44 @@
+#ifndef BLOCKEDIT_H
+#define BLOCKEDIT_H
+
+#include "textbuffer.h"
+#include <QString>
+#include <QStringView>
+
+/**
+ * @brief visual block (Ctrl+V) edits: the same column range changed on every line
+ *
+ * An edit rebuilds the text of all the lines of the block into one string
+ * that replaces them with a single buffer/document edit, instead of editing
+ * line by line. Line offsets come from the buffer's line index and each
+ * line is copied in at most three bulk appends, so nothing is scanned char
+ * by char and a block over 100k lines is one pass over their text.
+ */
+class BlockEdit
+{
+public:
+    enum Operation {Delete = 0, Insert, Append, Replace};
+
+    // lines and columns are 0 based and inclusive
+    struct Block
+    {
+        qsizetype firstLine = 0;
+        qsizetype lastLine = 0;
+        qsizetype firstColumn = 0;
+        qsizetype lastColumn = 0;
+        bool toLineEnd = false; // extended with $, the block ends where each line does
+    };
+
+    static Block blockOf(const TextBuffer& buffer, qsizetype anchor, qsizetype cursor, bool toLineEnd = false);
+
+    // the new text of the block's lines (lineStart(firstLine) to lineEnd(lastLine)):
+    // Insert puts text before the block, Append after it, Replace fills it with text[0]
+    static QString apply(const TextBuffer& buffer, const Block& block, Operation operation, QStringView text = {});
+    // the block's part of each line, one line each
+    static QString text(const TextBuffer& buffer, const Block& block);
+
+private:
+    static void editLine(QString& result, QStringView line, const Block& block, Operation operation, QStringView text);
+};
+
+#endif // BLOCKEDIT_H
@@ -0,0 +1,127 @@
+#include "bufferlist.h"
+#include <QFileInfo>
+#include <QTextDocument>
+
+// rough bytes a QTextDocument spends per line besides the text
+static constexpr qsizetype BLOCK_COST = 128;
+
+/**
+ * @brief starts with one untitled buffer, the one shown
+ */
+BufferList::BufferList()
+{
+    add(QString());
+    setCurrent(0);
+}
+
+int BufferList::indexOf(const QString& filename) const
+{
+    for (int i = 0; i < count(); ++i)
+        if (!filename.isEmpty() && at(i).filename == filename)
+            return i;
+    return -1;
+}
+
+/**
+ * @brief adds a buffer at the end, loaded (empty) unless told otherwise
+ */
+int BufferList::add(const QString& filename)
+{
+    auto buffer = std::make_unique<Buffer>();
+    buffer->filename = filename;
+    m_buffers.push_back(std::move(buffer));
+    return count() - 1;
+}
+
+void BufferList::setCurrent(int index)
+{
+    m_current = qBound(0, index, count() - 1);
+    at(m_current).lastShown = ++m_clock;
+}
+
+void BufferList::setMemoryBudget(qsizetype bytes)
+{
+    m_budget = qMax(qsizetype(0), bytes);
+    evict();
+}
+
+/**
+ * @brief bytes held by the parked buffers (the shown one is the editor's)
+ */
+qsizetype BufferList::memoryUsage() const
+{
+    qsizetype usage = 0;
+    for (int i = 0; i < count(); ++i)
+        if (i != m_current)
+            usage += costOf(at(i));
+    return usage;
+}
+
+/**
+ * @brief releases memory of the buffers shown least recently until the parked ones fit the budget
+ */
+void BufferList::evict()
+{
+    qsizetype usage = memoryUsage();
+    while (usage > m_budget)
+    {
+        // the oldest buffer that still has something to give back
+        Buffer* oldest = nullptr;
+        for (int i = 0; i < count(); ++i)
+        {
+            Buffer& buffer = at(i);
+            if (i != m_current && (!oldest || buffer.lastShown < oldest->lastShown) && isReleasable(buffer))
+                oldest = &buffer;
+        }
+        if (!oldest)
+            return;
+
+        const qsizetype cost = costOf(*oldest);
+        release(*oldest);
+        usage += costOf(*oldest) - cost;
+    }
+}
+
+bool BufferList::isReleasable(const Buffer& buffer)
+{
+    return buffer.state.document || buffer.state.undo.memoryBudget() > 0 || isFileBacked(buffer);
+}
+
+// the text can be loaded from the file again
+bool BufferList::isFileBacked(const Buffer& buffer)
+{
+    return buffer.loaded && buffer.saved && !buffer.filename.isEmpty() && QFileInfo::exists(buffer.filename);
+}
+
+/**
+ * @brief drops the thing a parked buffer holds that is cheapest to rebuild
+ */
+void BufferList::release(Buffer& buffer)
+{
+    BufferState& state = buffer.state;
+    if (state.document)
+    {
+        delete state.document;
+        state.document = nullptr;
+    }
+    else if (state.undo.memoryBudget() > 0)
+    {
+        // every step of a parked buffer is closed, all of it can go
+        state.undo.setMemoryBudget(0, state.text);
+    }
+    else if (isFileBacked(buffer))
+    {
+        buffer.fileModified = QFileInfo(buffer.filename).lastModified();
+        buffer.loaded = false;
+        state.text = TextBuffer();
+    }
+}
+
+qsizetype BufferList::costOf(const Buffer& buffer)
+{
+    const BufferState& state = buffer.state;
+    qsizetype cost = state.text.length() * qsizetype(sizeof(QChar)) + state.undo.memoryUsage(state.text);
+    if (state.document)
+        cost += state.text.length() * qsizetype(sizeof(QChar)) + state.text.lineCount() * BLOCK_COST;
+    return cost;
+}
@@ -0,0 +1,91 @@
+#ifndef BUFFERLIST_H
+#define BUFFERLIST_H
+
+#include "textbuffer.h"
+#include "undohistory.h"
+#include "syntaxtokenizer.h"
+#include "editjournal.h"
+#include "textcodec.h"
+#include <QString>
+#include <QDateTime>
+#include <memory>
+#include <vector>
+
+class QTextDocument;
+
+/**
+ * @brief everything the editor keeps of a buffer that isn't shown
+ */
+struct BufferState
+{
+    TextBuffer text;
+    quint64 revision = 0;
+    UndoHistory undo;
+    // laid out text, owned by the editor; null once evicted, rebuilt from text when shown
+    QTextDocument* document = nullptr;
+    int cursor = 0;
+    int scroll = 0;
+    SyntaxTokenizer::Language language = SyntaxTokenizer::PlainText;
+};
+
+/**
+ * @brief the buffers open in a window, all but the shown one parked here
+ *
+ * Parked buffers keep their document, so showing one again only swaps
+ * pointers. They share one memory budget though: when it's exceeded, the
+ * buffers shown least recently give memory back, cheapest to rebuild
+ * first: their document (rebuilt from the text), then their undo history
+ * (moved to its spill file), and last the text of unmodified files, which
+ * are loaded again when shown.
+ */
+class BufferList
+{
+public:
+    struct Buffer
+    {
+        QString filename;   // empty if untitled
+        // encoding and line ending the file is saved in, detected when loaded
+        TextCodec::Format format = TextCodec::defaultFormat();
+        bool saved = true;
+        // false: only the file is left, it's loaded when the buffer is shown
+        bool loaded = true;
+        // of the file when the text was dropped, the history only applies to that version
+        QDateTime fileModified;
+        quint64 lastShown = 0;
+        BufferState state;  // while parked
+        // crash recovery: the edits since the file was last saved
+        std::unique_ptr<EditJournal> journal = std::make_unique<EditJournal>();
+    };
+
+    BufferList();
+
+    inline int count() const { return int(m_buffers.size()); }
+    inline int current() const { return m_current; }
+    inline Buffer& at(int index) { return *m_buffers[size_t(index)]; }
+    inline const Buffer& at(int index) const { return *m_buffers[size_t(index)]; }
+    int indexOf(const QString& filename) const;
+
+    int add(const QString& filename);
+    void setCurrent(int index);
+
+    void setMemoryBudget(qsizetype bytes);
+    inline qsizetype memoryBudget() const { return m_budget; }
+    qsizetype memoryUsage() const;
+    void evict();
+
+    static constexpr qsizetype DEFAULT_BUDGET = 256 * 1024 * 1024;
+
+private:
+    static void release(Buffer& buffer);
+    static bool isReleasable(const Buffer& buffer);
+    static bool isFileBacked(const Buffer& buffer);
+    static qsizetype costOf(const Buffer& buffer);
+
+    // pointers, so a Buffer& stays valid while buffers are added
+    std::vector<std::unique_ptr<Buffer>> m_buffers;
+    int m_current = 0;
+    quint64 m_clock = 0;
+    qsizetype m_budget = DEFAULT_BUDGET;
+};
+
+#endif // BUFFERLIST_H
@@ -0,0 +1,295 @@
+#include "commandparser.h"
+
+// Key Tables
+// --------------
+namespace {
+
+enum class Kind : quint8 {Invalid = 0, Digit, Register, Operator, Motion, Action, GPrefix, TextObject, CharArgument};
+
+struct Binding
+{
+    Kind kind = Kind::Invalid;
+    quint8 value = 0;
+};
+
+using Table = std::array<Binding, 128>;
+
+constexpr Binding motion(Motion m) { return Binding{Kind::Motion, quint8(m)}; }
+constexpr Binding action(Action a) { return Binding{Kind::Action, quint8(a)}; }
+constexpr Binding op(Operator o) { return Binding{Kind::Operator, quint8(o)}; }
+
+constexpr void addDigits(Table& table)
+{
+    for (char16_t digit = '0'; digit <= '9'; ++digit)
+        table[digit] = Binding{Kind::Digit, quint8(digit - '0')};
+}
+
+constexpr void addMotions(Table& table)
+{
+    table['h'] = motion(Motion::Left);
+    table['l'] = motion(Motion::Right);
+    table['j'] = motion(Motion::Down);
+    table['k'] = motion(Motion::Up);
+    table['w'] = motion(Motion::WordStart);
+    table['e'] = motion(Motion::WordEnd);
+    table['b'] = motion(Motion::WordBack);
+    table['W'] = motion(Motion::BigWordStart);
+    table['E'] = motion(Motion::BigWordEnd);
+    table['B'] = motion(Motion::BigWordBack);
+    table['^'] = motion(Motion::FirstNonBlank);
+    table['$'] = motion(Motion::LineEnd);
+    table['G'] = motion(Motion::LastLine);
+    table['g'] = Binding{Kind::GPrefix, 0};
+}
+
+// '0' is a count digit once a count was started and the line start otherwise
+constexpr Table makeNormalTable()
+{
+    Table table = {};
+    addDigits(table);
+    addMotions(table);
+
+    table['"'] = Binding{Kind::Register, 0};
+    table['d'] = op(Operator::Delete);
+    table['c'] = op(Operator::Change);
+    table['y'] = op(Operator::Yank);
+
+    table['x'] = action(Action::CharDelete);
+    table['r'] = Binding{Kind::CharArgument, quint8(Action::ReplaceChar)};
+    table['n'] = action(Action::SearchNext);
+    table['N'] = action(Action::SearchPrevious);
+    table[':'] = action(Action::CommandLine);
+    table['.'] = action(Action::Repeat);
+    table['u'] = action(Action::Undo);
+    table[0x12] = action(Action::Redo); // Ctrl+R
+    table['p'] = action(Action::Put);
+    table['P'] = action(Action::PutBefore);
+
+    table[CommandParser::Escape] = action(Action::Navigate);
+    table['v'] = action(Action::Visual);
+    table['V'] = action(Action::VisualLine);
+    table[0x16] = action(Action::VisualBlock); // Ctrl+V
+
+    table['i'] = action(Action::insert);
+    table['I'] = action(Action::Insert);
+    table['o'] = action(Action::insertLine);
+    table['O'] = action(Action::InsertLine);
+    table['a'] = action(Action::append);
+    table['A'] = action(Action::Append);
+    return table;
+}
+
+// after an operator
+constexpr Table makeOperatorTable()
+{
+    Table table = {};
+    addDigits(table);
+    addMotions(table);
+    table['i'] = Binding{Kind::TextObject, 0};
+    table['a'] = Binding{Kind::TextObject, 1};
+    return table;
+}
+
+// after g
+constexpr Table makeGTable()
+{
+    Table table = {};
+    table['g'] = motion(Motion::FirstLine);
+    table['e'] = motion(Motion::WordEndBack);
+    table['E'] = motion(Motion::BigWordEndBack);
+    return table;
+}
+
+// after the i/a of a text object
+constexpr Table makeTextObjectTable()
+{
+    Table table = {};
+    table['w'] = motion(Motion::InnerWord);
+    table['W'] = motion(Motion::InnerBigWord);
+    return table;
+}
+
+constexpr Table normalTable = makeNormalTable();
+constexpr Table operatorTable = makeOperatorTable();
+constexpr Table gTable = makeGTable();
+constexpr Table textObjectTable = makeTextObjectTable();
+
+constexpr bool isRegisterName(char16_t key)
+{
+    return (key >= 'a' && key <= 'z') || (key >= 'A' && key <= 'Z') || (key >= '0' && key <= '9') ||
+           key == '"' || key == '-' || key == '_' || key == '+' || key == '*' || key == '/' || key == '.' || key == ':';
+}
+
+constexpr quint32 appendDigit(quint32 count, char16_t digit)
+{
+    const quint32 value = count * 10 + quint32(digit - '0');
+    return value > CommandParser::MAX_COUNT ? CommandParser::MAX_COUNT : value;
+}
+
+} // namespace
+// --------------
+
+CommandParser::Result CommandParser::feed(char16_t key, bool visual)
+{
+    // a new command starts
+    if (m_keyCount == 0)
+        m_command = Command();
+    if (m_keyCount == MAX_KEYS)
+    {
+        reset();
+        return Invalid;
+    }
+    m_keys[m_keyCount++] = key;
+
+    // Escape cancels whatever was typed
+    if (key == Escape)
+        return complete(Action::Navigate);
+
+    const Table* table = nullptr;
+    switch (m_state)
+    {
+        case State::Start:           table = &normalTable;     break;
+        case State::OperatorPending: table = &operatorTable;   break;
+        case State::GPrefix:         table = &gTable;          break;
+        case State::TextObject:      table = &textObjectTable; break;
+        case State::Register:        break;
+        case State::CharArgument:    break;
+    }
+    const Binding binding = (table && key < table->size()) ? (*table)[key] : Binding();
+
+    switch (m_state)
+    {
+        case State::Start:
+            if (binding.kind == Kind::Digit && (key != '0' || m_count > 0))
+            {
+                m_count = appendDigit(m_count, key);
+                return Pending;
+            }
+            switch (binding.kind)
+            {
+                case Kind::Digit:
+                    return complete(Action::Move, Motion::LineStart);
+                case Kind::Register:
+                    m_state = State::Register;
+                    return Pending;
+                case Kind::Operator:
+                    m_command.op = Operator(binding.value);
+                    // visual mode operators work on the selection
+                    if (visual)
+                        return complete(Action::Operate);
+                    m_operatorKey = key;
+                    m_state = State::OperatorPending;
+                    return Pending;
+                case Kind::Motion:
+                    return complete(Action::Move, Motion(binding.value));
+                case Kind::GPrefix:
+                    m_state = State::GPrefix;
+                    return Pending;
+                case Kind::Action:
+                    return complete(Action(binding.value));
+                case Kind::CharArgument:
+                    m_command.action = Action(binding.value);
+                    m_state = State::CharArgument;
+                    return Pending;
+                default:
+                    break;
+            }
+            break;
+
+        case State::CharArgument:
+            m_command.ch = key;
+            return complete(m_command.action);
+
+        case State::Register:
+            if (isRegisterName(key))
+            {
+                m_command.reg = key;
+                m_state = State::Start;
+                return Pending;
+            }
+            break;
+
+        case State::OperatorPending:
+            if (binding.kind == Kind::Digit && (key != '0' || m_operatorCount > 0))
+            {
+                m_operatorCount = appendDigit(m_operatorCount, key);
+                return Pending;
+            }
+            if (key == m_operatorKey)
+                return complete(Action::Operate, Motion::WholeLine);
+            switch (binding.kind)
+            {
+                case Kind::Digit:
+                    return complete(Action::Operate, Motion::LineStart);
+                case Kind::Motion:
+                    return complete(Action::Operate, Motion(binding.value));
+                case Kind::GPrefix:
+                    m_state = State::GPrefix;
+                    return Pending;
+                case Kind::TextObject:
+                    m_around = binding.value != 0;
+                    m_state = State::TextObject;
+                    return Pending;
+                default:
+                    break;
+            }
+            break;
+
+        case State::GPrefix:
+            if (binding.kind == Kind::Motion)
+                return complete(m_command.op == Operator::None ? Action::Move : Action::Operate,
+                                Motion(binding.value));
+            break;
+
+        case State::TextObject:
+            if (binding.kind == Kind::Motion)
+                return complete(Action::Operate, Motion(binding.value + (m_around ? 1 : 0)));
+            break;
+    }
+
+    reset();
+    return Invalid;
+}
+
+void CommandParser::reset()
+{
+    m_command = Command();
+    m_state = State::Start;
+    m_count = 0;
+    m_operatorCount = 0;
+    m_operatorKey = 0;
+    m_around = false;
+    m_keyCount = 0;
+}
+
+/**
+ * @brief the count typed so far, 0 if none
+ */
+quint32 CommandParser::pendingCount() const
+{
+    return combinedCount(m_count, m_operatorCount);
+}
+
+CommandParser::Result CommandParser::complete(Action action, Motion motion)
+{
+    m_command.action = action;
+    m_command.motion = motion;
+    m_command.count = combinedCount(m_count, m_operatorCount);
+
+    m_state = State::Start;
+    m_count = 0;
+    m_operatorCount = 0;
+    m_operatorKey = 0;
+    m_around = false;
+    m_keyCount = 0;
+    return Complete;
+}
+
+// 2d3w deletes 6 words
+quint32 CommandParser::combinedCount(quint32 first, quint32 second)
+{
+    if (first == 0 && second == 0)
+        return 0;
+    const quint64 count = quint64(qMax(1u, first)) * quint64(qMax(1u, second));
+    return quint32(qMin(count, quint64(MAX_COUNT)));
+}
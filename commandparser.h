@@ -0,0 +1,111 @@
+#ifndef COMMANDPARSER_H
+#define COMMANDPARSER_H
+
+#include <QtGlobal>
+#include <QStringView>
+#include <array>
+
+enum Action
+{
+    None = 0,
+    Move,       // a motion (h, 3w, gg, $ ...)
+    Operate,    // an operator over a motion, a text object or the selection (dw, c2e, diw, dd)
+    CharDelete, // delete chars (x)
+    ReplaceChar, // replace chars with the typed one (r)
+
+    SearchNext,     // next search match (n)
+    SearchPrevious, // previous search match (N)
+    CommandLine,    // command line (:N)
+    Repeat,         // repeat the last change (.)
+    Undo,           // undo changes (u)
+    Redo,           // redo undone changes (Ctrl+R)
+    Put,            // put a register after the cursor (p)
+    PutBefore,      // put a register before the cursor (P)
+
+    Navigate,    // Change Mode To Normal
+    Visual,      // Change Mode To Visual
+    VisualLine,  // Change Mode To Visual Line
+    VisualBlock, // Change Mode To Visual Block
+
+    insert, // Change Mode To Insert (curr pos)
+    Insert, // Change Mode To Insert (beg. of line)
+
+    insertLine, // Insert New Line Below Current Line
+    InsertLine, // Insert New Line Above Current Line
+
+    append, // Change Mode To Insert (curr pos + 1)
+    Append, // Change Mode To Insert (eof line)
+};
+
+enum class Operator : quint8 {None = 0, Delete, Change, Yank};
+
+enum class Motion : quint8
+{
+    None = 0,
+    Left, Right, Down, Up,                                  // h l j k
+    WordStart, WordEnd, WordBack, WordEndBack,              // w e b ge
+    BigWordStart, BigWordEnd, BigWordBack, BigWordEndBack,  // W E B gE
+    LineStart, FirstNonBlank, LineEnd,                      // 0 ^ $
+    FirstLine, LastLine,                                    // gg G
+    WholeLine,                                              // doubled operator (dd, cc)
+
+    // text objects, each around variant right after its inner one
+    InnerWord, AroundWord, InnerBigWord, AroundBigWord,     // iw aw iW aW
+};
+
+struct Command
+{
+    Action action = Action::None;
+    Operator op = Operator::None;
+    Motion motion = Motion::None;
+    quint32 count = 0;  // 0 if none was typed
+    char16_t reg = 0;   // register name ("x), 0 for the unnamed one
+    char16_t ch = 0;    // char typed after the command (rx)
+
+    inline quint32 countOr(quint32 fallback) const { return count ? count : fallback; }
+};
+
+/**
+ * @brief parses normal/visual mode keys: [count]["x][operator][count][motion | text object]
+ *
+ * A state machine driven by compile-time key tables, one per state, so a key
+ * costs one array lookup and nothing is allocated. Both counts are combined
+ * into a single count the motion engine applies in one go.
+ */
+class CommandParser
+{
+public:
+    enum Result {Pending = 0, Complete, Invalid};
+    static constexpr char16_t Escape = 0x1B;
+
+    // key: the char typed (Ctrl+letter as a control char, Escape for Esc/Caps Lock)
+    Result feed(char16_t key, bool visual);
+    void reset();
+
+    // the last completed command
+    inline const Command& command() const { return m_command; }
+    // the keys of the command being typed, like Vim's showcmd
+    inline QStringView pendingKeys() const { return QStringView(m_keys.data(), m_keyCount); }
+    inline bool isPending() const { return m_keyCount > 0; }
+    quint32 pendingCount() const;
+
+    static constexpr quint32 MAX_COUNT = 999999;
+    static constexpr int MAX_KEYS = 32;
+
+private:
+    enum class State : quint8 {Start = 0, Register, OperatorPending, GPrefix, TextObject, CharArgument};
+
+    Result complete(Action action, Motion motion = Motion::None);
+    static quint32 combinedCount(quint32 first, quint32 second);
+
+    Command m_command;
+    State m_state = State::Start;
+    quint32 m_count = 0;         // before the operator
+    quint32 m_operatorCount = 0; // after it
+    char16_t m_operatorKey = 0;
+    bool m_around = false;
+    std::array<char16_t, MAX_KEYS> m_keys = {};
+    int m_keyCount = 0;
+};
+
+#endif // COMMANDPARSER_H
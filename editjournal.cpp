@@ -0,0 +1,354 @@
+#include "editjournal.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+    #include <unistd.h>
+#endif
+
+// Layout (native byte order, a journal is only replayed where it was written)
+// --------------
+// header: MAGIC, base size (qint64), base modification time (qint64, ms since epoch)
+// record: payload size (quint32), payload checksum (quint16), payload:
+//         position (qint64), removed length (qint64), inserted UTF-16 text
+static constexpr char MAGIC[8] = {'V', 'I', 'M', 'M', 'Y', 'J', '1', '\n'};
+static constexpr qsizetype HEADER_SIZE = sizeof(MAGIC) + 2 * sizeof(qint64);
+static constexpr qsizetype RECORD_HEADER_SIZE = sizeof(quint32) + sizeof(quint16);
+static constexpr qsizetype PAYLOAD_HEADER_SIZE = 2 * sizeof(qint64);
+// the payload size is 32 bit: longer insertions are split over several records
+static constexpr qsizetype MAX_RECORD_CHARS = 256 * 1024 * 1024;
+// --------------
+
+template <typename T>
+static void appendValue(QByteArray& bytes, T value)
+{
+    bytes.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static T readValue(const char* data)
+{
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+/**
+ * @brief the journal file, only touched by the writer thread once the journal is started
+ */
+struct EditJournal::Writer
+{
+    QFile file;
+    QLockFile lock;
+    bool locked = false;
+    bool failed = false;
+    Base base;
+
+    Writer(const QString& path, const Base& base)
+        : file(path)
+        , lock(path + ".lock")
+        , base(base)
+    {
+    }
+
+    // runs on the writer thread
+    void write(const std::vector<Record>& records)
+    {
+        if (failed)
+            return;
+
+        QByteArray bytes;
+        if (!file.isOpen())
+        {
+            // the file is only created once there is something to recover
+            if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            {
+                failed = true;
+                return;
+            }
+            bytes.append(MAGIC, sizeof(MAGIC));
+            appendValue<qint64>(bytes, base.size);
+            appendValue<qint64>(bytes, base.modified);
+        }
+
+        QByteArray payload;
+        for (const Record& record : records)
+        {
+            payload.clear();
+            appendValue<qint64>(payload, record.position);
+            appendValue<qint64>(payload, record.removed);
+            const qsizetype length = record.inserted.length();
+            for (qsizetype pos = 0; pos < length;)
+            {
+                const TextBuffer::Span span = record.inserted.spanAt(pos);
+                const QStringView slice = span.text.mid(pos - span.start);
+                payload.append(reinterpret_cast<const char*>(slice.utf16()), slice.size() * qsizetype(sizeof(QChar)));
+                pos += slice.size();
+            }
+            appendValue<quint32>(bytes, quint32(payload.size()));
+            appendValue<quint16>(bytes, qChecksum(payload));
+            bytes.append(payload);
+        }
+
+        if (file.write(bytes) != bytes.size() || !file.flush())
+        {
+            failed = true;
+            return;
+        }
+#ifdef Q_OS_UNIX
+        ::fsync(file.handle());
+#endif
+    }
+};
+
+// one thread, so the batches of every journal are written in the order they were handed over
+struct WriterPool : QThreadPool
+{
+    WriterPool() { setMaxThreadCount(1); }
+};
+
+static QThreadPool& writerPool()
+{
+    static WriterPool pool;
+    return pool;
+}
+
+EditJournal::EditJournal()
+{
+    m_timer.setSingleShot(true);
+    m_timer.setInterval(SYNC_INTERVAL);
+    QObject::connect(&m_timer, &QTimer::timeout, &m_timer, [this] { sync(); });
+}
+
+/**
+ * @brief flushes what is left, the journal stays for recovery
+ */
+EditJournal::~EditJournal()
+{
+    stop(false);
+}
+
+/**
+ * @brief journals the edits of a text that is (or was loaded from) base from now on,
+ *        a previous journal of this object is finished and removed
+ */
+void EditJournal::start(const QString& path, const Base& base)
+{
+    stop(true);
+    m_saving = false;
+    m_sinceSave = std::vector<Record>();
+    m_path = path;
+    m_writer = std::make_shared<Writer>(path, base);
+}
+
+/**
+ * @brief queues an edit that replaced [position, position + removed) with inserted
+ */
+void EditJournal::record(qsizetype position, qsizetype removed, const TextBuffer& inserted)
+{
+    if (!m_writer || (removed == 0 && inserted.isEmpty()))
+        return;
+
+    // the first part replaces what was removed, the others are inserted after it
+    const qsizetype length = inserted.length();
+    qsizetype offset = 0;
+    do
+    {
+        const qsizetype part = qMin(length - offset, MAX_RECORD_CHARS);
+        m_pending.push_back(Record{position + offset, offset == 0 ? removed : 0,
+                                   part == length ? inserted : inserted.mid(offset, part)});
+        if (m_saving)
+            m_sinceSave.push_back(m_pending.back());
+        offset += part;
+    } while (offset < length);
+    if (!m_timer.isActive())
+        m_timer.start();
+}
+
+/**
+ * @brief remembers the edits from now on, the text as it is now is being saved
+ */
+void EditJournal::saveStarted()
+{
+    m_sinceSave.clear();
+    m_saving = m_writer != nullptr;
+}
+
+/**
+ * @brief starts over from the saved file (path and base), with only the edits made while saving
+ */
+void EditJournal::saveFinished(const QString& path, const Base& base)
+{
+    std::vector<Record> edits = std::move(m_sinceSave);
+    start(path, base);
+    for (const Record& edit : edits)
+        record(edit.position, edit.removed, edit.inserted);
+}
+
+/**
+ * @brief the file wasn't saved, the journal goes on as it is
+ */
+void EditJournal::saveFailed()
+{
+    m_saving = false;
+    m_sinceSave = std::vector<Record>();
+}
+
+/**
+ * @brief hands the queued edits to the writer thread
+ */
+void EditJournal::sync()
+{
+    m_timer.stop();
+    if (!m_writer || m_pending.empty())
+        return;
+
+    if (!m_writer->locked)
+    {
+        // another running instance journals this file
+        if (!m_writer->lock.tryLock(0))
+        {
+            m_writer.reset();
+            m_pending.clear();
+            return;
+        }
+        m_writer->locked = true;
+    }
+
+    writerPool().start([writer = m_writer, records = std::move(m_pending)] {
+        writer->write(records);
+    });
+    m_pending = std::vector<Record>();
+}
+
+/**
+ * @brief writes the queued edits and closes the journal, removing it if its edits are safe elsewhere
+ */
+void EditJournal::stop(bool remove)
+{
+    if (!m_writer)
+        return;
+    sync();
+    if (m_writer)
+    {
+        writerPool().start([writer = m_writer, remove] {
+            if (writer->file.isOpen())
+                writer->file.close();
+            // never remove a journal some other instance locked
+            if (writer->locked)
+            {
+                if (remove)
+                    writer->file.remove();
+                writer->lock.unlock();
+            }
+        });
+    }
+    m_writer.reset();
+    m_path.clear();
+}
+
+/**
+ * @brief the journal of a file: hidden, next to it
+ */
+QString EditJournal::pathFor(const QString& filename)
+{
+    const QFileInfo info(filename);
+    return info.absolutePath() + "/." + info.fileName() + ".vjournal";
+}
+
+static QString untitledDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation) + "/journal";
+}
+
+/**
+ * @brief a new journal path for an untitled document
+ */
+QString EditJournal::untitledPath()
+{
+    static int untitledCount = 0;
+    const QString directory = untitledDirectory();
+    QDir().mkpath(directory);
+    return QString("%1/untitled-%2-%3.vjournal")
+        .arg(directory)
+        .arg(QCoreApplication::applicationPid())
+        .arg(++untitledCount);
+}
+
+/**
+ * @brief the journals of untitled documents, of this instance and of crashed ones
+ */
+QStringList EditJournal::untitledJournals()
+{
+    const QDir directory(untitledDirectory());
+    QStringList journals;
+    for (const QString& name : directory.entryList({"untitled-*.vjournal"}, QDir::Files))
+        journals.append(directory.absoluteFilePath(name));
+    return journals;
+}
+
+EditJournal::Base EditJournal::baseOf(const QString& filename)
+{
+    const QFileInfo info(filename);
+    if (filename.isEmpty() || !info.exists())
+        return Base();
+    return Base{info.size(), info.lastModified().toMSecsSinceEpoch()};
+}
+
+/**
+ * @brief reads the edits of a journal left behind by a crash, false if there is none for base
+ *
+ * A journal still in use by a running instance isn't read, and the edits
+ * end at the first record that isn't complete.
+ */
+bool EditJournal::read(const QString& path, const Base& base, QList<Edit>& edits)
+{
+    QLockFile lock(path + ".lock");
+    if (!lock.tryLock(0))
+        return false;
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    const QByteArray bytes = file.readAll();
+    const char* data = bytes.constData();
+    if (bytes.size() < HEADER_SIZE || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0)
+        return false;
+    const Base written{readValue<qint64>(data + sizeof(MAGIC)),
+                       readValue<qint64>(data + sizeof(MAGIC) + sizeof(qint64))};
+    if (written != base)
+        return false;
+
+    edits.clear();
+    for (qsizetype offset = HEADER_SIZE; offset + RECORD_HEADER_SIZE <= bytes.size();)
+    {
+        const qsizetype size = readValue<quint32>(data + offset);
+        const quint16 checksum = readValue<quint16>(data + offset + sizeof(quint32));
+        const char* payload = data + offset + RECORD_HEADER_SIZE;
+        if (size < PAYLOAD_HEADER_SIZE || (size - PAYLOAD_HEADER_SIZE) % qsizetype(sizeof(QChar)) != 0 ||
+            offset + RECORD_HEADER_SIZE + size > bytes.size() ||
+            qChecksum(QByteArrayView(payload, size)) != checksum)
+            break;
+
+        Edit edit;
+        edit.position = readValue<qint64>(payload);
+        edit.removed = readValue<qint64>(payload + sizeof(qint64));
+        const qsizetype length = (size - PAYLOAD_HEADER_SIZE) / qsizetype(sizeof(QChar));
+        edit.text = QString(reinterpret_cast<const QChar*>(payload + PAYLOAD_HEADER_SIZE), length);
+        edits.append(std::move(edit));
+        offset += RECORD_HEADER_SIZE + size;
+    }
+    return true;
+}
+
+void EditJournal::remove(const QString& path)
+{
+    QFile::remove(path);
+}
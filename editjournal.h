@@ -0,0 +1,93 @@
+#ifndef EDITJOURNAL_H
+#define EDITJOURNAL_H
+
+#include "textbuffer.h"
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief append-only crash-recovery journal of the edits made to a file since it was last saved
+ *
+ * Every edit is one small binary record: where it happened, how much it
+ * removed and the text it inserted. Recording only queues the position and
+ * a TextBuffer slice of the inserted text, so it's O(1) whatever the size
+ * of the edit or the document; the records are encoded, appended and
+ * fsync'd in batches on a background thread at most SYNC_INTERVAL apart.
+ *
+ * The journal starts with the size and modification time of the file the
+ * edits apply to, and every record carries its length and a checksum, so
+ * replaying after a crash stops cleanly at a record that was only half
+ * written. A lock file next to the journal tells a journal in use by a
+ * running instance from one left behind by a crash.
+ *
+ * Edits made while a save runs are kept as well (slices, like the queue), and
+ * once the file is on disk they are all the new journal starts with.
+ */
+class EditJournal
+{
+public:
+    // the file the edits apply to: size and modification time, -1 if there's none
+    struct Base
+    {
+        qint64 size = -1;
+        qint64 modified = -1;
+
+        inline bool operator==(const Base& other) const { return size == other.size && modified == other.modified; }
+        inline bool operator!=(const Base& other) const { return !(*this == other); }
+    };
+
+    // replace [position, position + removed) with text
+    struct Edit
+    {
+        qsizetype position = 0;
+        qsizetype removed = 0;
+        QString text;
+    };
+
+    EditJournal();
+    ~EditJournal();
+    EditJournal(const EditJournal&) = delete;
+    EditJournal& operator=(const EditJournal&) = delete;
+
+    void start(const QString& path, const Base& base);
+    void record(qsizetype position, qsizetype removed, const TextBuffer& inserted);
+    void sync();
+    void stop(bool remove);
+    void saveStarted();
+    void saveFinished(const QString& path, const Base& base);
+    void saveFailed();
+    inline bool isActive() const { return m_writer != nullptr; }
+    inline const QString& path() const { return m_path; }
+
+    static QString pathFor(const QString& filename);
+    static QString untitledPath();
+    static QStringList untitledJournals();
+    static Base baseOf(const QString& filename);
+    static bool read(const QString& path, const Base& base, QList<Edit>& edits);
+    static void remove(const QString& path);
+
+    static constexpr int SYNC_INTERVAL = 500; // ms
+
+private:
+    struct Record
+    {
+        qsizetype position = 0;
+        qsizetype removed = 0;
+        TextBuffer inserted;
+    };
+    struct Writer;
+
+    std::shared_ptr<Writer> m_writer;
+    std::vector<Record> m_pending;
+    // edits since the snapshot being saved was taken
+    std::vector<Record> m_sinceSave;
+    bool m_saving = false;
+    QTimer m_timer;
+    QString m_path;
+};
+
+#endif // EDITJOURNAL_H
@@ -0,0 +1,148 @@
+#include "exparser.h"
+
+static inline bool isDigit(QChar ch)
+{
+    return ch >= '0' && ch <= '9';
+}
+
+static inline bool isLetter(QChar ch)
+{
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z');
+}
+
+static inline void skipSpaces(QStringView text, qsizetype& pos)
+{
+    while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t'))
+        ++pos;
+}
+
+ExCommand ExParser::parse(QStringView text, const Context& context)
+{
+    ExCommand command;
+    command.firstLine = command.lastLine = context.cursorLine;
+
+    qsizetype pos = 0;
+    skipSpaces(text, pos);
+
+    // Range
+    if (pos < text.size() && text[pos] == '%')
+    {
+        ++pos;
+        command.firstLine = 0;
+        command.lastLine = context.lineCount - 1;
+        command.hasRange = true;
+    }
+    else
+    {
+        qsizetype first = context.cursorLine;
+        command.hasRange = parseAddress(text, pos, context, first, command.error);
+        if (!command.isValid())
+            return command;
+        qsizetype last = first;
+
+        skipSpaces(text, pos);
+        if (pos < text.size() && (text[pos] == ',' || text[pos] == ';'))
+        {
+            ++pos;
+            command.hasRange = true;
+            last = context.cursorLine;
+            parseAddress(text, pos, context, last, command.error);
+            if (!command.isValid())
+                return command;
+        }
+
+        if (first < 0 || last < 0 || first >= context.lineCount || last >= context.lineCount)
+        {
+            command.error = "E16: Invalid range";
+            return command;
+        }
+        // a backwards range is turned around
+        command.firstLine = qMin(first, last);
+        command.lastLine = qMax(first, last);
+    }
+
+    // Name
+    skipSpaces(text, pos);
+    const qsizetype nameStart = pos;
+    while (pos < text.size() && isLetter(text[pos]))
+        ++pos;
+    command.name = text.mid(nameStart, pos - nameStart).toString();
+    if (pos < text.size() && text[pos] == '!')
+    {
+        command.bang = true;
+        ++pos;
+    }
+    command.argument = text.mid(pos).toString();
+
+    if (command.name.isEmpty() && !command.argument.trimmed().isEmpty())
+        command.error = "E492: Not an editor command: " + text.toString();
+    return command;
+}
+
+/**
+ * @brief parses the address at pos into line (0 based), false if there's none there
+ */
+bool ExParser::parseAddress(QStringView text, qsizetype& pos, const Context& context,
+                            qsizetype& line, QString& error)
+{
+    skipSpaces(text, pos);
+    if (pos >= text.size())
+        return false;
+
+    const QChar ch = text[pos];
+    if (isDigit(ch))
+    {
+        // line 0 is the first line as far as ranges go
+        line = qMax(qsizetype(0), parseNumber(text, pos) - 1);
+    }
+    else if (ch == '.')
+    {
+        line = context.cursorLine;
+        ++pos;
+    }
+    else if (ch == '$')
+    {
+        line = context.lineCount - 1;
+        ++pos;
+    }
+    else if (ch == '\'')
+    {
+        const QChar mark = pos + 1 < text.size() ? text[pos + 1] : QChar();
+        if ((mark != '<' && mark != '>') || context.visualFirst < 0)
+        {
+            error = "E20: Mark not set";
+            return false;
+        }
+        line = mark == '<' ? context.visualFirst : context.visualLast;
+        pos += 2;
+    }
+    else if (ch == '+' || ch == '-')
+    {
+        // an offset alone counts from the cursor
+        line = context.cursorLine;
+    }
+    else
+    {
+        return false;
+    }
+
+    // offsets: +N, -N, a sign alone is 1
+    for (skipSpaces(text, pos); pos < text.size() && (text[pos] == '+' || text[pos] == '-'); skipSpaces(text, pos))
+    {
+        const bool minus = text[pos++] == '-';
+        const qsizetype offset = pos < text.size() && isDigit(text[pos]) ? parseNumber(text, pos) : 1;
+        line += minus ? -offset : offset;
+    }
+    return true;
+}
+
+qsizetype ExParser::parseNumber(QStringView text, qsizetype& pos)
+{
+    qsizetype number = 0;
+    for (; pos < text.size() && isDigit(text[pos]); ++pos)
+    {
+        // clamped, the range check rejects it anyway
+        number = qMin(number * 10 + (text[pos].unicode() - '0'), qsizetype(1) << 48);
+    }
+    return number;
+}
@@ -0,0 +1,49 @@
+#ifndef EXPARSER_H
+#define EXPARSER_H
+
+#include <QString>
+#include <QStringView>
+
+struct ExCommand
+{
+    // 0 based, inclusive; the cursor's line if no range was given
+    qsizetype firstLine = 0;
+    qsizetype lastLine = 0;
+    bool hasRange = false;
+    QString name;       // empty for a bare range (:42, :$)
+    bool bang = false;  // :g!
+    QString argument;   // the rest of the line, as typed
+    QString error;      // empty if the line parsed
+
+    inline bool isValid() const { return error.isEmpty(); }
+};
+
+/**
+ * @brief parses a : command line: [range]name[!] argument
+ *
+ * A range is '%' (every line) or one or two addresses separated by ',' or
+ * ';'. An address is a line number, '.' (the cursor's line), '$' (the last
+ * line) or a visual mark ('< and '>), followed by any number of +N / -N
+ * offsets; a missing address around the separator is the cursor's line.
+ */
+class ExParser
+{
+public:
+    struct Context
+    {
+        qsizetype cursorLine = 0;
+        qsizetype lineCount = 1;
+        // lines of the last visual selection, -1 if there was none
+        qsizetype visualFirst = -1;
+        qsizetype visualLast = -1;
+    };
+
+    static ExCommand parse(QStringView text, const Context& context);
+
+private:
+    static bool parseAddress(QStringView text, qsizetype& pos, const Context& context,
+                             qsizetype& line, QString& error);
+    static qsizetype parseNumber(QStringView text, qsizetype& pos);
+};
+
+#endif // EXPARSER_H
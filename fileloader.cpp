@@ -0,0 +1,127 @@
+#include "fileloader.h"
+#include <QFile>
+#include <QtEndian>
+
+FileLoader::FileLoader(const QString& filename, QObject* parent)
+    : QObject(parent)
+    , m_filename(filename)
+{
+}
+
+FileLoader::~FileLoader()
+{
+    cancel();
+    if (m_thread)
+    {
+        m_thread->wait();
+        delete m_thread;
+    }
+}
+
+void FileLoader::start()
+{
+    if (m_thread)
+        return;
+    m_thread = QThread::create([this] { load(); });
+    m_thread->start();
+}
+
+void FileLoader::cancel()
+{
+    m_cancelled = true;
+    // wake the worker up if it waits for the receiver
+    m_pending.release(MAX_PENDING_CHUNKS);
+}
+
+/**
+ * @brief end of the chunk starting at offset: just after its last line ending,
+ *        or at a char boundary if the chunk holds no line ending
+ */
+static qint64 chunkEnd(const uchar* data, qint64 size, qint64 offset, qint64 chunkSize,
+                       const TextCodec::Format& format)
+{
+    qint64 end = qMin(size, offset + chunkSize);
+    if (end == size)
+        return end;
+
+    // whole code units only
+    const int unit = TextCodec::unitSize(format.encoding);
+    end -= (end - offset) % unit;
+    auto unitAt = [&](qint64 i) -> char16_t {
+        if (format.encoding == TextCodec::Utf16LE)
+            return qFromLittleEndian<quint16>(data + i);
+        if (format.encoding == TextCodec::Utf16BE)
+            return qFromBigEndian<quint16>(data + i);
+        return data[i];
+    };
+
+    const char16_t lineEnd = format.lineEnding == TextCodec::CR ? '\r' : '\n';
+    for (qint64 i = end - unit; i > offset; i -= unit)
+        if (unitAt(i) == lineEnd)
+            return i + unit;
+
+    if (format.encoding == TextCodec::Utf8)
+    {
+        // skip back over UTF-8 continuation bytes (10xxxxxx)
+        while (end > offset + 1 && (data[end] & 0xC0) == 0x80)
+            --end;
+    }
+    else if (unit == 2 && end - unit > offset && QChar::isHighSurrogate(unitAt(end - unit)))
+    {
+        // keep surrogate pairs together
+        end -= unit;
+    }
+    // and "\r\n" too, it's decoded as one line feed
+    if (end - unit > offset && unitAt(end - unit) == '\r')
+        end -= unit;
+    return end;
+}
+
+void FileLoader::load()
+{
+    QFile file(m_filename);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        emit failed(file.errorString());
+        return;
+    }
+
+    const qint64 size = file.size();
+    const uchar* data = size > 0 ? file.map(0, size) : nullptr;
+
+    // files that can't be mapped are read in one go
+    QByteArray contents;
+    if (!data && size > 0)
+    {
+        contents = file.readAll();
+        data = reinterpret_cast<const uchar*>(contents.constData());
+    }
+
+    const TextCodec::Format format = TextCodec::detect(reinterpret_cast<const char*>(data), size);
+    emit formatDetected(format);
+
+    qint64 offset = TextCodec::bomLength(format);
+
+    qint64 chunkSize = FIRST_CHUNK_SIZE;
+    while (offset < size && !m_cancelled)
+    {
+        qint64 end = chunkEnd(data, size, offset, chunkSize, format);
+        QString text = TextCodec::decode(reinterpret_cast<const char*>(data + offset), end - offset, format);
+
+        m_pending.acquire();
+        if (m_cancelled)
+            break;
+
+        emit chunkLoaded(text);
+        emit progressChanged(int(end * 100 / size));
+
+        offset = end;
+        chunkSize = CHUNK_SIZE;
+    }
+
+    if (contents.isEmpty() && data)
+        file.unmap(const_cast<uchar*>(data));
+
+    if (!m_cancelled)
+        emit finished();
+}
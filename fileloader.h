@@ -0,0 +1,54 @@
+#ifndef FILELOADER_H
+#define FILELOADER_H
+
+#include "textcodec.h"
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QSemaphore>
+#include <atomic>
+
+/**
+ * @brief loads a file on a worker thread in batches of whole lines
+ *
+ * The file is memory mapped, its format detected (formatDetected() comes
+ * before the first chunk) and then decoded chunk by chunk, every decoded
+ * chunk is handed out through chunkLoaded(). The first chunk is kept small
+ * so the first screen shows up right away.
+ * At most a few chunks are in flight: the receiver calls chunkConsumed()
+ * once it has taken a chunk, so a slow receiver throttles the decoding.
+ */
+class FileLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit FileLoader(const QString& filename, QObject* parent = nullptr);
+    ~FileLoader();
+
+    void start();
+    void cancel();
+    inline void chunkConsumed() { m_pending.release(); }
+    inline const QString& filename() const { return m_filename; }
+
+signals:
+    void formatDetected(const TextCodec::Format& format);
+    void chunkLoaded(const QString& text);
+    void progressChanged(int percent);
+    void finished();
+    void failed(const QString& error);
+
+private:
+    void load(); // runs on m_thread
+
+    static constexpr qint64 FIRST_CHUNK_SIZE = 64 * 1024;
+    static constexpr qint64 CHUNK_SIZE = 4 * 1024 * 1024;
+    static constexpr int MAX_PENDING_CHUNKS = 4;
+
+    QString m_filename;
+    QThread* m_thread = nullptr;
+    QSemaphore m_pending{MAX_PENDING_CHUNKS};
+    std::atomic<bool> m_cancelled{false};
+};
+
+#endif // FILELOADER_H
@@ -0,0 +1,105 @@
+#include "filesaver.h"
+#include <QSaveFile>
+
+#ifdef Q_OS_UNIX
+    #include <unistd.h>
+#endif
+
+FileSaver::FileSaver(const QString& filename, const TextBuffer& text, const TextCodec::Format& format,
+                     QObject* parent)
+    : QObject(parent)
+    , m_filename(filename)
+    , m_text(text)
+    , m_format(format)
+{
+}
+
+FileSaver::~FileSaver()
+{
+    // a save is never abandoned halfway
+    if (m_thread)
+    {
+        m_thread->wait();
+        delete m_thread;
+    }
+}
+
+void FileSaver::start()
+{
+    if (m_thread)
+        return;
+    m_thread = QThread::create([this] { save(); });
+    m_thread->start();
+}
+
+void FileSaver::save()
+{
+    QSaveFile file(m_filename);
+    // binary: line endings are the format's business
+    if (!file.open(QIODevice::WriteOnly))
+    {
+        emit failed(file.errorString());
+        return;
+    }
+
+    QByteArray bytes = TextCodec::bom(m_format);
+    const qsizetype length = m_text.length();
+    qsizetype pos = 0;
+    while (pos < length)
+    {
+        TextBuffer::Span span = m_text.spanAt(pos);
+        QStringView slice = span.text.mid(pos - span.start);
+        if (slice.size() > ENCODE_SLICE_SIZE)
+            slice = slice.first(ENCODE_SLICE_SIZE);
+
+        // keep surrogate pairs together, even across pieces
+        QString pair;
+        if (slice.back().isHighSurrogate() && pos + slice.size() < length)
+        {
+            slice.chop(1);
+            if (slice.isEmpty())
+            {
+                pair = m_text.text(pos, 2);
+                slice = pair;
+            }
+        }
+
+        if (!TextCodec::encode(slice, m_format, bytes))
+        {
+            emit failed(QString("The text has characters %1 can't encode, see :set fileencoding")
+                        .arg(TextCodec::nameOf(m_format.encoding)));
+            return;
+        }
+        if (file.write(bytes) != bytes.size())
+        {
+            emit failed(file.errorString());
+            return; // QSaveFile discards the temporary file
+        }
+        bytes.resize(0);
+        pos += slice.size();
+    }
+
+    // an empty file still gets its BOM
+    if (!bytes.isEmpty() && file.write(bytes) != bytes.size())
+    {
+        emit failed(file.errorString());
+        return;
+    }
+
+    if (!file.flush())
+    {
+        emit failed(file.errorString());
+        return;
+    }
+#ifdef Q_OS_UNIX
+    // make sure the data is on disk before the rename makes it visible
+    ::fsync(file.handle());
+#endif
+
+    if (!file.commit())
+    {
+        emit failed(file.errorString());
+        return;
+    }
+    emit finished();
+}
@@ -0,0 +1,46 @@
+#ifndef FILESAVER_H
+#define FILESAVER_H
+
+#include "textbuffer.h"
+#include "textcodec.h"
+#include <QObject>
+#include <QString>
+#include <QThread>
+
+/**
+ * @brief writes a snapshot of a TextBuffer to disk on a worker thread
+ *
+ * The text is encoded piece by piece in the file's format (encoding, BOM and
+ * line ending) into a temporary file next to the target, synced to disk and
+ * then renamed over the target, so a crash mid-save never leaves a
+ * truncated file behind.
+ */
+class FileSaver : public QObject
+{
+    Q_OBJECT
+
+public:
+    FileSaver(const QString& filename, const TextBuffer& text, const TextCodec::Format& format,
+              QObject* parent = nullptr);
+    ~FileSaver();
+
+    void start();
+    inline const QString& filename() const { return m_filename; }
+
+signals:
+    void finished();
+    void failed(const QString& error);
+
+private:
+    void save(); // runs on m_thread
+
+    // encode at most this many chars at once
+    static constexpr qsizetype ENCODE_SLICE_SIZE = 1024 * 1024;
+
+    QString m_filename;
+    TextBuffer m_text;
+    TextCodec::Format m_format;
+    QThread* m_thread = nullptr;
+};
+
+#endif // FILESAVER_H
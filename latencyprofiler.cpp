@@ -0,0 +1,134 @@
+#include "latencyprofiler.h"
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <vector>
+
+LatencyProfiler::LatencyProfiler()
+{
+    m_clock.start();
+}
+
+LatencyProfiler& LatencyProfiler::instance()
+{
+    static LatencyProfiler profiler;
+    return profiler;
+}
+
+void LatencyProfiler::record(Stage stage, qint64 start, qint64 end)
+{
+    const quint64 index = m_head.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = m_ring[index & (CAPACITY - 1)];
+
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.duration.store(end - start, std::memory_order_relaxed);
+    slot.stage.store(stage, std::memory_order_relaxed);
+    slot.sequence.store(index + 1, std::memory_order_release);
+}
+
+void LatencyProfiler::painted()
+{
+    const qint64 key = m_pendingKey.exchange(-1, std::memory_order_relaxed);
+    if (key >= 0)
+        record(KeyToPaint, key, now());
+}
+
+/**
+ * @brief the samples still in the ring, oldest first
+ */
+QList<LatencyProfiler::Sample> LatencyProfiler::samples() const
+{
+    const quint64 head = m_head.load(std::memory_order_acquire);
+    const quint64 first = head > CAPACITY ? head - CAPACITY : 0;
+
+    QList<Sample> result;
+    result.reserve(qsizetype(head - first));
+    for (quint64 index = first; index < head; ++index)
+    {
+        const Slot& slot = m_ring[index & (CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != index + 1)
+            continue;
+
+        Sample sample;
+        sample.stage = Stage(slot.stage.load(std::memory_order_relaxed));
+        sample.start = slot.start.load(std::memory_order_relaxed);
+        sample.duration = slot.duration.load(std::memory_order_relaxed);
+
+        // skip it if it got overwritten meanwhile
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == index + 1)
+            result.append(sample);
+    }
+    return result;
+}
+
+/**
+ * @brief p50/p99 of the last samples of stage
+ */
+LatencyProfiler::Stats LatencyProfiler::stats(Stage stage, qsizetype last) const
+{
+    const QList<Sample> all = samples();
+    std::vector<qint64> durations;
+    for (auto it = all.crbegin(); it != all.crend() && qsizetype(durations.size()) < last; ++it)
+        if (it->stage == stage)
+            durations.push_back(it->duration);
+
+    Stats result;
+    if (durations.empty())
+        return result;
+
+    std::sort(durations.begin(), durations.end());
+    auto percentile = [&](double p) {
+        return double(durations[size_t(p * double(durations.size() - 1) + 0.5)]) / 1e6;
+    };
+    result.count = qsizetype(durations.size());
+    result.p50 = percentile(0.50);
+    result.p99 = percentile(0.99);
+    return result;
+}
+
+/**
+ * @brief the samples in the Chrome trace event format (complete events, microseconds)
+ */
+QByteArray LatencyProfiler::chromeTrace() const
+{
+    QJsonArray events;
+    for (const Sample& sample : samples())
+    {
+        events.append(QJsonObject{
+            {"name", stageName(sample.stage)},
+            {"cat", "vimmy"},
+            {"ph", "X"},
+            {"ts", double(sample.start) / 1000.0},
+            {"dur", double(sample.duration) / 1000.0},
+            {"pid", 1},
+            // key-to-paint spans the others, give it a track of its own
+            {"tid", sample.stage == KeyToPaint ? 2 : 1},
+        });
+    }
+    QJsonObject trace{
+        {"traceEvents", events},
+        {"displayTimeUnit", "ms"},
+    };
+    return QJsonDocument(trace).toJson(QJsonDocument::Compact);
+}
+
+QString LatencyProfiler::stageName(Stage stage)
+{
+    switch (stage)
+    {
+        case KeyEvent:    return "keyPressEvent";
+        case Lookup:      return "parse";
+        case Execute:     return "executeAction";
+        case Cursor:      return "moveCursor";
+        case BufferSync:  return "syncBuffer";
+        case TextChanged: return "textChanged";
+        case Paint:       return "paint";
+        case KeyToPaint:  return "key to paint";
+        case FirstPaint:  return "first paint";
+        default:          return "unknown";
+    }
+}
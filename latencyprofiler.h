@@ -0,0 +1,105 @@
+#ifndef LATENCYPROFILER_H
+#define LATENCYPROFILER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QElapsedTimer>
+#include <atomic>
+#include <array>
+
+/**
+ * @brief records how long each stage of handling a keystroke takes
+ *
+ * Samples go into a fixed-size lock-free ring buffer (the oldest ones are
+ * overwritten), recording one costs two clock reads and an atomic increment,
+ * so the editor records all the time. The samples can be summarized as
+ * p50/p99 or exported as a Chrome trace (chrome://tracing, Perfetto).
+ */
+class LatencyProfiler
+{
+public:
+    enum Stage : quint8
+    {
+        KeyEvent = 0, // VimTextEdit::keyPressEvent as a whole
+        Lookup,       // parsing the key into a command
+        Execute,      // executeAction
+        Cursor,       // cursor movement
+        BufferSync,   // folding a document change into the TextBuffer
+        TextChanged,  // MainWindow's textChanged handling
+        Paint,        // editor repaint
+        KeyToPaint,   // from the key press to the end of the next repaint
+        FirstPaint,   // from the start of the process to the first repaint showing text
+        StageCount
+    };
+
+    struct Sample
+    {
+        Stage stage = KeyEvent;
+        qint64 start = 0;    // ns since the profiler started
+        qint64 duration = 0; // ns
+    };
+
+    struct Stats
+    {
+        qsizetype count = 0;
+        double p50 = 0; // ms
+        double p99 = 0; // ms
+    };
+
+    static LatencyProfiler& instance();
+
+    inline qint64 now() const { return m_clock.nsecsElapsed(); }
+    void record(Stage stage, qint64 start, qint64 end);
+
+    // key-to-paint: a key press starts it, the next finished paint records it
+    inline void keyPressed() { m_pendingKey.store(now(), std::memory_order_relaxed); }
+    void painted();
+
+    QList<Sample> samples() const;
+    Stats stats(Stage stage, qsizetype last = 1024) const;
+    QByteArray chromeTrace() const;
+
+    static QString stageName(Stage stage);
+
+private:
+    LatencyProfiler();
+
+    struct Slot
+    {
+        // index + 1 of the sample stored, 0 while it's being written
+        std::atomic<quint64> sequence{0};
+        std::atomic<qint64> start{0};
+        std::atomic<qint64> duration{0};
+        std::atomic<quint8> stage{0};
+    };
+
+    static constexpr quint64 CAPACITY = 1 << 15; // power of two
+    std::array<Slot, CAPACITY> m_ring;
+    std::atomic<quint64> m_head{0};
+    std::atomic<qint64> m_pendingKey{-1};
+    QElapsedTimer m_clock;
+};
+
+/**
+ * @brief times the enclosing scope as one sample of stage
+ */
+class LatencyScope
+{
+public:
+    explicit inline LatencyScope(LatencyProfiler::Stage stage)
+        : m_stage(stage)
+        , m_start(LatencyProfiler::instance().now())
+    {
+    }
+    inline ~LatencyScope() { LatencyProfiler::instance().record(m_stage, m_start, LatencyProfiler::instance().now()); }
+
+    LatencyScope(const LatencyScope&) = delete;
+    LatencyScope& operator=(const LatencyScope&) = delete;
+
+private:
+    LatencyProfiler::Stage m_stage;
+    qint64 m_start;
+};
+
+#endif // LATENCYPROFILER_H
@@ -0,0 +1,18 @@
+#include "linenumberarea.h"
+#include "vimtextedit.h"
+
+LineNumberArea::LineNumberArea(VimTextEdit* editor)
+    : QWidget(editor)
+    , m_editor(editor)
+{
+}
+
+QSize LineNumberArea::sizeHint() const
+{
+    return QSize(m_editor->lineNumberAreaWidth(), 0);
+}
+
+void LineNumberArea::paintEvent(QPaintEvent* event)
+{
+    m_editor->paintLineNumbers(event);
+}
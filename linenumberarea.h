@@ -0,0 +1,27 @@
+#ifndef LINENUMBERAREA_H
+#define LINENUMBERAREA_H
+
+#include <QWidget>
+#include <QSize>
+#include <QPaintEvent>
+
+class VimTextEdit;
+
+/**
+ * @brief gutter to the left of a VimTextEdit showing its line numbers
+ */
+class LineNumberArea : public QWidget
+{
+public:
+    explicit LineNumberArea(VimTextEdit* editor);
+
+    QSize sizeHint() const override;
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+
+private:
+    VimTextEdit* m_editor;
+};
+
+#endif // LINENUMBERAREA_H
@@ -1,12 +1,116 @@
 #include "mainwindow.h"
+#include "vimtextedit.h"
+#include "batchrunner.h"
+#include "latencyprofiler.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
+#include <QThread>
+#include <QTimer>
+#include <cstring>
+
+/**
+ * @brief vimmy --batch -c script.vim file...: runs the script over the files without a window
+ */
+static int runBatch(QApplication& app)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs a Vim script over files without a window.");
+    parser.addHelpOption();
+    parser.addOption({"batch", "Run the scripts given with -c over the files, without a window."});
+    parser.addOption({"c", "Script of Ex commands (and :normal keys) to run, may be repeated.", "script"});
+    parser.addOption({{"j", "jobs"}, "Files read and written at once.", "count",
+                      QString::number(QThread::idealThreadCount())});
+    parser.addPositionalArgument("files", "Files to run the scripts over.", "file...");
+    parser.process(app);
+
+    QTextStream log(stderr);
+    QStringList script;
+    for (const QString& filename : parser.values("c"))
+    {
+        QString error;
+        if (!BatchRunner::readScript(filename, script, error))
+        {
+            log << error << Qt::endl;
+            return 2;
+        }
+    }
+    if (!parser.isSet("c") || parser.positionalArguments().isEmpty())
+    {
+        log << "usage: vimmy --batch -c script.vim file..." << Qt::endl;
+        return 2;
+    }
+
+    BatchRunner runner(script, parser.positionalArguments(), parser.value("jobs").toInt());
+    QObject::connect(&runner, &BatchRunner::finished, &app,
+                     [&] { app.exit(runner.failures() ? 1 : 0); });
+    // started from the event loop, so finishing right away still ends it
+    QTimer::singleShot(0, &runner, &BatchRunner::start);
+    return app.exec();
+}
+
+/**
+ * @brief vimmy [file] [+line]: the file starts loading before the window is built,
+ *        vimmy --view [--follow] file shows it read-only a page at a time
+ */
+static int runEditor(QApplication& app)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription("A simple notepad with Vim motions.");
+    parser.addHelpOption();
+    parser.addOption({"batch", "Run scripts over files without a window, see --batch --help."});
+    parser.addOption({"startup-time", "Print the milliseconds until the first text is painted, then quit."});
+    parser.addOption({{"R", "view"}, "View the file read-only, a page at a time, whatever its size."});
+    parser.addOption({{"f", "follow"}, "View the file and follow what's appended to it, like tail -f."});
+    parser.addPositionalArgument("file", "File to open, created when it's saved if it doesn't exist.", "[file]");
+    parser.addPositionalArgument("+line", "Line to show, the last one for + alone.", "[+line]");
+    parser.process(app);
+
+    // +line may come before the file, like in Vim
+    QString filename;
+    qsizetype line = 0;
+    for (const QString& argument : parser.positionalArguments())
+    {
+        if (argument.startsWith('+'))
+            line = argument.size() == 1 ? -1 : qMax(qsizetype(1), qsizetype(argument.mid(1).toLongLong()));
+        else if (filename.isEmpty())
+            filename = argument;
+    }
+
+    app.setStyle("fusion");
+    const bool follow = parser.isSet("follow");
+    const bool view = follow || parser.isSet("view");
+    // a viewed file is mapped, not loaded, it shows up right away
+    MainWindow w(view ? QString() : filename, view ? 0 : line);
+    if (view && !filename.isEmpty())
+        w.viewFile(filename, follow, line);
+    if (parser.isSet("startup-time"))
+    {
+        // vimmy_bench's startup scenario reads this
+        QObject::connect(w.findChild<VimTextEdit*>(), &VimTextEdit::textPainted, &app, [&] {
+            const LatencyProfiler& profiler = LatencyProfiler::instance();
+            QTextStream(stdout) << "{\"first_paint_ms\": " << double(profiler.now()) / 1e6 << "}" << Qt::endl;
+            app.quit();
+        });
+    }
+    w.show();
+    return app.exec();
+}
 
 int main(int argc, char *argv[])
 {
+    // startup is timed from here
+    LatencyProfiler::instance();
+
+    bool batch = false;
+    for (int i = 1; i < argc; ++i)
+        batch = batch || std::strcmp(argv[i], "--batch") == 0;
+    // no window system needed
+    if (batch && qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
     QApplication a(argc, argv);
-    a.setStyle("fusion");
-    MainWindow w;
-    w.show();
-    return a.exec();
+    if (batch)
+        return runBatch(a);
+    return runEditor(a);
 }
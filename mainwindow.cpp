@@ -1,19 +1,34 @@
 #include "mainwindow.h"
 #include "./ui_mainwindow.h"
 #include "searchdialog.h"
+#include "fileloader.h"
+#include "filesaver.h"
+#include "latencyprofiler.h"
 #include <QDebug>
 #include <QLabel>
 #include <QFileDialog>
-#include <QTextEdit>
+#include <QPlainTextEdit>
 #include <QMessageBox>
+#include <QProgressBar>
+#include <QTimer>
+#include <QSaveFile>
+#include <QTabBar>
+#include <QFileInfo>
+#include <QSignalBlocker>
+#include <QCloseEvent>
+#include <QEventLoop>
 
 /*
-- Close/New/Open
+- Close (every buffer, each one shown while asked about)
     - untitled (empty) => do nothing
     - existing (saved) => do nothing
 
     - untitled (non-empty) => askToSave -> Save -> [save as]
     - existing (non-saved) => askToSave -> Save
+    => Cancel, a dismissed save as or a failed save keep the window open
+------------------------------------------
+- New/Open
+    => a buffer (tab) of its own, an untouched untitled one is reused
 ------------------------------------------
 - Save
     - untitled (empty/non-empty) => Save As
@@ -26,16 +41,25 @@
 */
 
 
-MainWindow::MainWindow(QWidget *parent)
+MainWindow::MainWindow(const QString& filename, qsizetype line, QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
+    , m_startupLine(line)
 {
+    // a file given on the command line is read and decoded while the window is built
+    const QString path = filename.isEmpty() ? QString() : QFileInfo(filename).absoluteFilePath();
+    const bool exists = !path.isEmpty() && QFileInfo::exists(path);
+    if (exists)
+        startLoader(path);
+
     ui->setupUi(this);
 
     // setting up window
     // -------------------
     setWindowTitle("Vimmy - untitled[*]");
     setIconSize(QSize(64, 64));
+    ui->progress->hide();
+    ui->latency->hide();
     // QMainWindow::setWindowIcon(QIcon("./resources/vimmy-logo.png"));
     // QMainWindow::setIconSize(QSize(64, 64));
 
@@ -49,8 +73,18 @@ MainWindow::MainWindow(QWidget *parent)
 
     connect(ui->search, &QAction::triggered, this, &MainWindow::search);
 
-    connect(ui->editor, &QTextEdit::textChanged, this,
+    m_latencyTimer = new QTimer(this);
+    m_latencyTimer->setInterval(LATENCY_INTERVAL);
+    connect(m_latencyTimer, &QTimer::timeout, this, &MainWindow::updateLatency);
+    connect(ui->showLatency, &QAction::toggled, this, &MainWindow::showLatency);
+    connect(ui->exportLatency, &QAction::triggered, this, &MainWindow::exportLatency);
+
+    connect(ui->editor, &QPlainTextEdit::textChanged, this,
             [this] {
+                LatencyScope latency(LatencyProfiler::TextChanged);
+                // a viewed file's window slides, the file itself never changes
+                if (ui->editor->isViewing())
+                    return;
                 if (isDocumentUntitled())
                     setFilename("");
                 setSavedStatus(false);
@@ -65,33 +99,65 @@ MainWindow::MainWindow(QWidget *parent)
 
     connect(ui->editor, &VimTextEdit::commandChanged,
             ui->command, &QLabel::setText);
+
+    // buffers: one tab each, shown once there's more than one
+    m_tabs = new QTabBar(this);
+    m_tabs->setDocumentMode(true);
+    m_tabs->setExpanding(false);
+    ui->verticalLayout->insertWidget(0, m_tabs);
+    updateTabs();
+    connect(m_tabs, &QTabBar::currentChanged, this, &MainWindow::showBuffer);
+
+    connect(ui->editor, &VimTextEdit::editRequested, this, &MainWindow::editFile);
+    connect(ui->editor, &VimTextEdit::bufferRequested, this,
+            [this](int number) { showBuffer(number - 1); });
+    connect(ui->editor, &VimTextEdit::bufferStepRequested, this, &MainWindow::stepBuffer);
+    connect(ui->editor, &VimTextEdit::bufferListRequested, this, &MainWindow::listBuffers);
+    connect(ui->editor, &VimTextEdit::formatOptionRequested, this, &MainWindow::setFormatOption);
+
+    // edits are journaled until saved, a crash leaves the journal behind for recovery
+    ui->editor->setJournal(m_buffers.at(m_buffers.current()).journal.get());
+    if (!path.isEmpty())
+    {
+        setFilename(path);
+        ui->editor->setLanguage(SyntaxTokenizer::languageOf(path));
+    }
+    // a file that doesn't exist yet starts empty, like in Vim
+    if (exists)
+    {
+        // the loader started above, its chunks arrive once the event loop runs
+        ui->editor->beginLoad();
+        ui->progress->setValue(0);
+        ui->progress->show();
+    }
+    else
+    {
+        startJournal();
+    }
+    QTimer::singleShot(0, this, &MainWindow::recoverUntitled);
 }
 
 MainWindow::~MainWindow()
 {
+    delete m_loader;
+    delete m_saver; // waits for the save to finish
+
+    // journals of saved buffers have nothing left to recover
+    ui->editor->setJournal(nullptr);
+    for (int i = 0; i < m_buffers.count(); ++i)
+    {
+        BufferList::Buffer& buffer = m_buffers.at(i);
+        buffer.journal->stop(i == m_buffers.current() ? m_saved : buffer.saved);
+    }
     delete ui;
 }
 
 void MainWindow::openDocument()
 {
-// - Close/New/Open
-//     - untitled (empty) => do nothing
-//     - existing (saved) => do nothing
-
-//     - untitled (non-empty) => Save -> [save as]
-//     - existing (non-saved) => Save
-
-    if ((isDocumentUntitled() && !isDocumentEmpty()) ||
-    (!isDocumentUntitled() && !isDocumentSaved()))
-    {
-        auto response = askToSave();
-        if (response == QMessageBox::Save)
-            saveDocument();
-        else if (response == QMessageBox::Cancel)
-            return;
-    }
-
-    
+// - Open
+//     => the file gets a buffer of its own, the shown one stays open in its tab
+    if (refuseInView())
+        return;
 
     QString filename = QFileDialog::getOpenFileName(
                                     this,
@@ -108,13 +174,75 @@ void MainWindow::openDocument()
         QMessageBox::warning(this, "Warning", "Cannot open file: " + file.errorString());
         return;
     }
+    file.close();
 
-    setFilename(filename);
+    editFile(filename);
+}
 
-    QTextStream in(&file);
-    ui->editor->setText(in.readAll());
+/**
+ * @brief streams the file into the editor, the first lines show up before the rest is decoded
+ */
+void MainWindow::loadDocument(const QString& filename, bool keepHistory)
+{
+    startLoader(filename);
 
-    file.close();
+    // nothing arrives before the event loop runs, the editor is ready by then
+    ui->editor->beginLoad(keepHistory);
+    ui->progress->setValue(0);
+    ui->progress->show();
+}
+
+/**
+ * @brief starts reading and decoding filename on the loader's thread, before anything is shown of it
+ */
+void MainWindow::startLoader(const QString& filename)
+{
+    delete m_loader;
+    m_loader = new FileLoader(filename, this);
+
+    // the loader is the context object, so chunks still queued when
+    // it gets deleted (another file opened) are dropped with it
+    connect(m_loader, &FileLoader::formatDetected, m_loader,
+            [this](const TextCodec::Format& format) {
+                m_buffers.at(m_buffers.current()).format = format;
+                updateTabs();
+    });
+
+    connect(m_loader, &FileLoader::chunkLoaded, m_loader,
+            [this](const QString& text) {
+                ui->editor->appendLoaded(text);
+                m_loader->chunkConsumed();
+    });
+
+    connect(m_loader, &FileLoader::progressChanged, m_loader,
+            [this](int percent) { ui->progress->setValue(percent); });
+
+    connect(m_loader, &FileLoader::finished, m_loader,
+            [this] {
+                ui->editor->endLoad();
+                ui->progress->hide();
+                setSavedStatus(true);
+                m_loader->deleteLater();
+                m_loader = nullptr;
+                // vimmy file +N
+                if (m_startupLine != 0)
+                {
+                    const qsizetype lineCount = ui->editor->buffer().lineCount();
+                    ui->editor->goToLine(m_startupLine < 0 ? lineCount - 1 : qMin(m_startupLine, lineCount) - 1);
+                    ui->editor->centerCursor();
+                    m_startupLine = 0;
+                }
+                recoverJournal();
+    });
+
+    connect(m_loader, &FileLoader::failed, m_loader,
+            [this](const QString& error) {
+                ui->editor->endLoad();
+                ui->progress->hide();
+                QMessageBox::warning(this, "Warning", "Cannot open file: " + error);
+    });
+
+    m_loader->start();
 }
 
 bool MainWindow::isDocumentEmpty() const
@@ -122,27 +250,302 @@ bool MainWindow::isDocumentEmpty() const
     return ui->editor->isEmpty();
 }
 
-void MainWindow::newDocument()
+/**
+ * @brief shows filename read-only, a few pages at a time whatever its size (vimmy --view)
+ *
+ * Nothing of the file is edited, journaled or saved, and it stays the only buffer.
+ */
+void MainWindow::viewFile(const QString& filename, bool follow, qsizetype line)
 {
-// - Close/New/Open
-//     - untitled (empty) => do nothing
-//     - existing (saved) => do nothing
+    const QString path = QFileInfo(filename).absoluteFilePath();
+    QString error;
+    if (!ui->editor->openView(path, follow, error))
+    {
+        QMessageBox::warning(this, "Warning", "Cannot open file: " + error);
+        return;
+    }
 
-//     - untitled (non-empty) => Save -> [save as]
-//     - existing (non-saved) => Save
+    // the untitled buffer's journal has nothing to record
+    m_buffers.at(m_buffers.current()).journal->stop(true);
+    setFilename(path);
+    setWindowTitle("Vimmy - " + path + " [view][*]");
+    ui->editor->setLanguage(SyntaxTokenizer::languageOf(path));
+    setSavedStatus(true);
+    if (line != 0)
+        ui->editor->showFileLine(line < 0 ? -1 : line - 1);
+}
+
+bool MainWindow::refuseInView()
+{
+    if (!ui->editor->isViewing())
+        return false;
+    ui->command->setText("E45: The file is viewed read-only, open it without --view to edit it");
+    return true;
+}
+
+// Buffers
+// --------------
+/**
+ * @brief shows buffer index, parking the one shown so far
+ */
+void MainWindow::showBuffer(int index)
+{
+    if (index < 0 || index >= m_buffers.count() || index == m_buffers.current() || refuseInView())
+    {
+        updateTabs();
+        return;
+    }
+
+    // a file still loading is loaded again when its buffer comes back
+    const bool loading = m_loader != nullptr;
+    if (loading)
+    {
+        delete m_loader;
+        m_loader = nullptr;
+        ui->progress->hide();
+        ui->editor->endLoad();
+    }
+
+    BufferList::Buffer& shown = m_buffers.at(m_buffers.current());
+    BufferList::Buffer& next = m_buffers.at(index);
+    shown.saved = m_saved;
+
+    BufferState state = std::move(next.state);
+    next.state = BufferState();
+    ui->editor->swapBuffer(state);
+    shown.state = std::move(state);
+    ui->editor->setJournal(next.journal.get());
+    if (loading)
+    {
+        shown.loaded = false;
+        shown.state.text = TextBuffer();
+        delete shown.state.document;
+        shown.state.document = nullptr;
+    }
+
+    m_buffers.setCurrent(index);
+    setFilename(next.filename);
+    setSavedStatus(next.saved);
+    updateTabs();
+
+    if (!next.loaded)
+    {
+        // the history is kept if the file is still the one it was recorded for
+        const bool keepHistory = next.fileModified.isValid() &&
+                                 QFileInfo(next.filename).lastModified() == next.fileModified;
+        next.loaded = true;
+        loadDocument(next.filename, keepHistory);
+    }
+    m_buffers.evict();
+}
+
+/**
+ * @brief shows the buffer of filename (:e), opening the file in a new one if needed
+ */
+void MainWindow::editFile(const QString& filename)
+{
+    if (refuseInView())
+        return;
 
-    if ((isDocumentUntitled() && !isDocumentEmpty()) ||
-    (!isDocumentUntitled() && !isDocumentSaved()))
+    const QString path = QFileInfo(filename).absoluteFilePath();
+    const int index = m_buffers.indexOf(path);
+    if (index >= 0)
     {
-        auto response = askToSave();
-        if (response == QMessageBox::Save)
-            saveDocument();
-        else if (response == QMessageBox::Cancel)
+        showBuffer(index);
+        return;
+    }
+
+    // an untouched untitled buffer takes the file instead
+    if (!isBufferPristine())
+        showBuffer(m_buffers.add(path));
+
+    setFilename(path);
+    ui->editor->setLanguage(SyntaxTokenizer::languageOf(path));
+    // a file that doesn't exist yet starts empty, like in Vim
+    if (QFileInfo::exists(path))
+        loadDocument(path);
+    else
+        startJournal();
+}
+
+void MainWindow::stepBuffer(int step)
+{
+    const int count = m_buffers.count();
+    showBuffer(((m_buffers.current() + step) % count + count) % count);
+}
+
+/**
+ * @brief lists the buffers (:ls) in the command line: number, %a for the shown one, + if modified
+ */
+void MainWindow::listBuffers()
+{
+    QStringList buffers;
+    for (int i = 0; i < m_buffers.count(); ++i)
+    {
+        const BufferList::Buffer& buffer = m_buffers.at(i);
+        const bool shown = i == m_buffers.current();
+        const bool saved = shown ? m_saved : buffer.saved;
+        buffers.append(QString("%1%2%3 \"%4\"")
+                       .arg(i + 1)
+                       .arg(shown ? " %a" : "")
+                       .arg(saved ? "" : " +")
+                       .arg(buffer.filename.isEmpty() ? "[No Name]" : QFileInfo(buffer.filename).fileName()));
+    }
+    ui->command->setText(buffers.join("  |  "));
+}
+
+/**
+ * @brief :set ff=..., fenc=... or [no]bomb changes the shown file's format, :set alone shows it
+ */
+void MainWindow::setFormatOption(const QString& option)
+{
+    TextCodec::Format& format = m_buffers.at(m_buffers.current()).format;
+    if (!option.isEmpty())
+    {
+        TextCodec::Format changed = format;
+        if (!TextCodec::setOption(changed, option))
+        {
+            ui->command->setText("Invalid argument: " + option);
             return;
+        }
+        // the file on disk no longer matches
+        if (changed != format)
+        {
+            format = changed;
+            setSavedStatus(false);
+            updateTabs();
+        }
     }
+    ui->command->setText(TextCodec::nameOf(format));
+}
 
-    ui->editor->setText(QString());
-    setSavedStatus(true);
+void MainWindow::updateTabs()
+{
+    if (!m_tabs)
+        return;
+
+    // rebuilding the tabs must not switch buffers
+    QSignalBlocker blocker(m_tabs);
+    while (m_tabs->count() > m_buffers.count())
+        m_tabs->removeTab(m_tabs->count() - 1);
+    for (int i = 0; i < m_buffers.count(); ++i)
+    {
+        const QString& filename = m_buffers.at(i).filename;
+        const QString name = filename.isEmpty() ? "untitled" : QFileInfo(filename).fileName();
+        if (i < m_tabs->count())
+            m_tabs->setTabText(i, name);
+        else
+            m_tabs->addTab(name);
+        m_tabs->setTabToolTip(i, (filename.isEmpty() ? "untitled" : filename) + "\n" +
+                                 TextCodec::nameOf(m_buffers.at(i).format));
+    }
+    m_tabs->setCurrentIndex(m_buffers.current());
+    m_tabs->setVisible(m_buffers.count() > 1);
+}
+
+// Crash Recovery
+// --------------
+/**
+ * @brief journals the edits of the buffer shown from now on, against its file as it is on disk
+ */
+void MainWindow::startJournal()
+{
+    EditJournal& journal = *m_buffers.at(m_buffers.current()).journal;
+    journal.start(isDocumentUntitled() ? EditJournal::untitledPath() : EditJournal::pathFor(m_filename),
+                  EditJournal::baseOf(m_filename));
+}
+
+/**
+ * @brief offers to replay the journal a crash left behind for the file just loaded
+ */
+void MainWindow::recoverJournal()
+{
+    const QString path = EditJournal::pathFor(m_filename);
+    QList<EditJournal::Edit> edits;
+    const bool found = EditJournal::read(path, EditJournal::baseOf(m_filename), edits) && !edits.isEmpty();
+
+    // the recovered edits are journaled again, as they are made
+    startJournal();
+    if (!found)
+        return;
+
+    const auto response = QMessageBox::question(this, "Recover",
+            QString("Unsaved changes to %1 were left behind by a session that ended unexpectedly.\n"
+                    "Do you want to recover them?").arg(QFileInfo(m_filename).fileName()));
+    if (response == QMessageBox::Yes)
+        ui->editor->replayEdits(edits);
+    else
+        EditJournal::remove(path);
+}
+
+/**
+ * @brief offers to recover the untitled documents of sessions that ended unexpectedly
+ */
+void MainWindow::recoverUntitled()
+{
+    QStringList paths;
+    QList<QList<EditJournal::Edit>> documents;
+    for (const QString& path : EditJournal::untitledJournals())
+    {
+        QList<EditJournal::Edit> edits;
+        if (!EditJournal::read(path, EditJournal::Base(), edits))
+            continue;
+        if (edits.isEmpty())
+        {
+            EditJournal::remove(path);
+            continue;
+        }
+        paths.append(path);
+        documents.append(edits);
+    }
+    // they're recovered by the next session that can edit
+    if (documents.isEmpty() || ui->editor->isViewing())
+        return;
+
+    const auto response = QMessageBox::question(this, "Recover",
+            QString("%1 untitled document(s) with unsaved changes were left behind by a session that ended unexpectedly.\n"
+                    "Do you want to recover them?").arg(documents.size()));
+    for (qsizetype i = 0; i < documents.size(); ++i)
+    {
+        if (response == QMessageBox::Yes)
+        {
+            if (!isBufferPristine())
+            {
+                showBuffer(m_buffers.add(QString()));
+                startJournal();
+            }
+            ui->editor->replayEdits(documents[i]);
+        }
+        EditJournal::remove(paths[i]);
+    }
+}
+// --------------
+
+// nothing would be lost by showing something else in it
+bool MainWindow::isBufferPristine() const
+{
+    return isDocumentUntitled() && isDocumentEmpty() && !m_loader;
+}
+
+// closing would lose changes: unsaved, and not just an emptied untitled buffer
+bool MainWindow::isBufferModified(int index) const
+{
+    const BufferList::Buffer& buffer = m_buffers.at(index);
+    if (index == m_buffers.current())
+        return !isDocumentSaved() && !(isDocumentUntitled() && isDocumentEmpty());
+    return !buffer.saved && !(buffer.filename.isEmpty() && buffer.state.text.isEmpty());
+}
+// --------------
+
+void MainWindow::newDocument()
+{
+// - New
+//     => a new untitled buffer, the shown one stays open in its tab
+
+    if (isBufferPristine() || refuseInView())
+        return;
+    showBuffer(m_buffers.add(QString()));
+    startJournal();
 }
 
 void MainWindow::saveAsDocument()
@@ -151,6 +554,8 @@ void MainWindow::saveAsDocument()
 //     - untitled (empty/non-empty)
 //     - existing (saved/non-saved)
 //         =>> save as dialog in all cases
+    if (refuseInView())
+        return;
     qDebug() << "in save as";
     QString tempFilename = QFileDialog::getSaveFileName(this,
             "Save As",
@@ -160,9 +565,8 @@ void MainWindow::saveAsDocument()
     if (tempFilename.isEmpty())
         return;
     setFilename(tempFilename);
-    saveDocument();
-
-    setSavedStatus(true);
+    ui->editor->setLanguage(SyntaxTokenizer::languageOf(tempFilename));
+    writeDocument();
 }
 
 void MainWindow::saveDocument()
@@ -175,6 +579,8 @@ void MainWindow::saveDocument()
 //     - existing (non-saved) => save dialog
 //     - existing (saved) => do nothing
 
+    if (refuseInView())
+        return;
     if (isDocumentUntitled())
     {
         qDebug() << "in save going to save as";
@@ -184,27 +590,185 @@ void MainWindow::saveDocument()
     else if (isDocumentSaved())
         return;
 
-    QFile file(m_filename);
-    if (!file.open(QIODevice::WriteOnly | QFile::Text))
+    writeDocument();
+}
+
+/**
+ * @brief saves a snapshot of the editor text in the background,
+ *        the document is marked saved once the file is safely on disk
+ */
+void MainWindow::writeDocument()
+{
+    // one save at a time, a save requested meanwhile runs right after
+    if (m_saver)
     {
-        QMessageBox::warning(this, "Warning", "Cannot save file: " + file.errorString());
+        m_saveQueued = true;
         return;
     }
 
-    QString text = ui->editor->toPlainText();
+    m_savingRevision = ui->editor->revision();
+    m_buffers.at(m_buffers.current()).journal->saveStarted();
+    m_saver = new FileSaver(m_filename, ui->editor->buffer(),
+                            m_buffers.at(m_buffers.current()).format, this);
 
-    QTextStream out(&file);
-    out << text;
+    connect(m_saver, &FileSaver::finished, this,
+            [this] {
+                // the buffer saved may have been parked meanwhile
+                const int index = m_buffers.indexOf(m_saver->filename());
+                if (index >= 0)
+                {
+                    BufferList::Buffer& buffer = m_buffers.at(index);
+                    const bool shown = index == m_buffers.current();
+                    const quint64 revision = shown ? ui->editor->revision() : buffer.state.revision;
+
+                    // the journal starts over from the saved file, with the edits made while saving
+                    buffer.journal->saveFinished(EditJournal::pathFor(buffer.filename),
+                                                 EditJournal::baseOf(buffer.filename));
+                    // saved only if nothing changed while saving
+                    if (revision == m_savingRevision)
+                    {
+                        if (shown)
+                            setSavedStatus(true);
+                        else
+                            buffer.saved = true;
+                    }
+                }
+                finishSave();
+    });
 
-    file.close();
+    connect(m_saver, &FileSaver::failed, this,
+            [this](const QString& error) {
+                const int index = m_buffers.indexOf(m_saver->filename());
+                if (index >= 0)
+                    m_buffers.at(index).journal->saveFailed();
+                QMessageBox::warning(this, "Warning", "Cannot save file: " + error);
+                finishSave();
+    });
 
-    setSavedStatus(true);
+    m_saver->start();
+}
+
+/**
+ * @brief offers to save every modified buffer, the window stays open unless all of them are handled
+ */
+void MainWindow::closeEvent(QCloseEvent* event)
+{
+    std::vector<int> discarded;
+    for (int i = 0; i < m_buffers.count(); ++i)
+    {
+        if (!isBufferModified(i))
+            continue;
+        // it's saved from the editor, and the user sees what they're asked about
+        showBuffer(i);
+
+        const int response = askToSave();
+        if (response == QMessageBox::Cancel)
+        {
+            event->ignore();
+            return;
+        }
+        if (response == QMessageBox::Discard)
+        {
+            discarded.push_back(i);
+            continue;
+        }
+
+        saveDocument();
+        waitForSave();
+        if (!isDocumentSaved())
+        {
+            event->ignore();
+            return;
+        }
+    }
+
+    // the changes were let go of, there's nothing to recover
+    for (int i : discarded)
+        m_buffers.at(i).journal->stop(true);
+    event->accept();
+}
+
+/**
+ * @brief runs the event loop until the save in progress, and one queued after it, are done
+ */
+void MainWindow::waitForSave()
+{
+    while (m_saver)
+    {
+        // connected after the save's own handlers, so it quits once they ran
+        QEventLoop loop;
+        connect(m_saver, &FileSaver::finished, &loop, &QEventLoop::quit);
+        connect(m_saver, &FileSaver::failed, &loop, &QEventLoop::quit);
+        loop.exec();
+    }
+}
+
+void MainWindow::finishSave()
+{
+    m_saver->deleteLater();
+    m_saver = nullptr;
+
+    if (m_saveQueued)
+    {
+        m_saveQueued = false;
+        if (!isDocumentUntitled())
+            writeDocument();
+    }
 }
 
 void MainWindow::search()
 {
-    SearchDialog dialog;
-    dialog.exec();
+    // built on first use, it isn't needed to show the text
+    if (!m_searchDialog)
+    {
+        m_searchDialog = new SearchDialog(this);
+        connect(m_searchDialog, &SearchDialog::searchRequested,
+                ui->editor, &VimTextEdit::search);
+    }
+    m_searchDialog->show();
+    m_searchDialog->raise();
+    m_searchDialog->activateWindow();
+}
+
+void MainWindow::showLatency(bool show)
+{
+    ui->latency->setVisible(show);
+    if (show)
+    {
+        updateLatency();
+        m_latencyTimer->start();
+    }
+    else
+        m_latencyTimer->stop();
+}
+
+void MainWindow::updateLatency()
+{
+    auto stats = LatencyProfiler::instance().stats(LatencyProfiler::KeyToPaint);
+    if (stats.count == 0)
+    {
+        ui->latency->setText("key to paint: -");
+        return;
+    }
+    ui->latency->setText(QString("key to paint p50 %1 ms, p99 %2 ms")
+                         .arg(stats.p50, 0, 'f', 2)
+                         .arg(stats.p99, 0, 'f', 2));
+}
+
+void MainWindow::exportLatency()
+{
+    QString filename = QFileDialog::getSaveFileName(this,
+            "Export Latency Trace",
+            "vimmy-trace.json",
+            "Chrome trace (*.json)");
+    if (filename.isEmpty())
+        return;
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly) ||
+        file.write(LatencyProfiler::instance().chromeTrace()) < 0 ||
+        !file.commit())
+        QMessageBox::warning(this, "Warning", "Cannot export trace: " + file.errorString());
 }
 
 int MainWindow::askToSave()
@@ -3,6 +3,13 @@
 
 #include <QMainWindow>
 #include <QMessageBox>
+#include "bufferlist.h"
+
+class FileLoader;
+class FileSaver;
+class SearchDialog;
+class QTimer;
+class QTabBar;
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -15,28 +22,60 @@ class MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
-    MainWindow(QWidget *parent = nullptr);
+    // filename is opened right away, at line (1 based, -1 for the last one, 0 to leave it at the top)
+    explicit MainWindow(const QString& filename = QString(), qsizetype line = 0, QWidget *parent = nullptr);
     ~MainWindow();
 
     inline bool isDocumentUntitled() const { return m_filename.isEmpty(); }
     inline bool isDocumentSaved() const { return m_saved; }
     bool isDocumentEmpty() const;
+    // read-only, paged and optionally followed like tail -f (vimmy --view / --follow)
+    void viewFile(const QString& filename, bool follow, qsizetype line = 0);
+
+protected:
+    void closeEvent(QCloseEvent* event) override;
 
 private:
     void saveDocument();
     void saveAsDocument();
+    void writeDocument();
+    void finishSave();
+    void waitForSave();
     void openDocument();
+    void loadDocument(const QString& filename, bool keepHistory = false);
+    void startLoader(const QString& filename);
     void newDocument();
+    bool refuseInView();
+    // Buffers
+    void showBuffer(int index);
+    void editFile(const QString& filename);
+    void stepBuffer(int step);
+    void listBuffers();
+    void setFormatOption(const QString& option);
+    void updateTabs();
+    bool isBufferPristine() const;
+    bool isBufferModified(int index) const;
+    // --------------
+    // Crash Recovery
+    void startJournal();
+    void recoverJournal();
+    void recoverUntitled();
+    // --------------
     void search();
+    void showLatency(bool show);
+    void updateLatency();
+    void exportLatency();
     int askToSave();
     inline void setFilename(const QString& filename)
     {
         if (m_filename != filename)
         {
             m_filename = filename;
+            m_buffers.at(m_buffers.current()).filename = filename;
             setWindowTitle("Vimmy - " + 
                             (m_filename.isEmpty() ? "untitled" : m_filename) +
                             "[*]");
+            updateTabs();
         }
     }
 
@@ -57,5 +96,22 @@ private:
     Ui::MainWindow *ui;
     bool m_saved = true;
     QString m_filename;
+    FileLoader* m_loader = nullptr;
+    // line to show once the file from the command line is loaded
+    qsizetype m_startupLine = 0;
+    SearchDialog* m_searchDialog = nullptr; // built on first use
+
+    // every open file; the shown one's name and saved state are m_filename and m_saved
+    BufferList m_buffers;
+    QTabBar* m_tabs = nullptr;
+
+    // background save in progress
+    FileSaver* m_saver = nullptr;
+    quint64 m_savingRevision = 0;
+    bool m_saveQueued = false;
+
+    // refreshes the latency readout
+    QTimer* m_latencyTimer = nullptr;
+    static constexpr int LATENCY_INTERVAL = 500; // ms
 };
 #endif // MAINWINDOW_H
@@ -0,0 +1,502 @@
+#include "pagedfile.h"
+#include "textbuffer.h"
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QtEndian>
+#include <algorithm>
+#include <atomic>
+
+struct PagedFile::IndexJob
+{
+    QString filename;
+    TextCodec::Format format;
+    qint64 from = 0;
+    qint64 to = 0;
+    std::atomic<bool> cancelled{false};
+};
+
+struct PagedFile::FindJob
+{
+    QString filename;
+    TextCodec::Format format;
+    qint64 size = 0;
+    SearchEngine engine;
+    QList<int> pages;
+    bool backward = false;
+    std::atomic<bool> cancelled{false};
+};
+
+// Bytes
+// --------------
+static char16_t unitAt(const uchar* data, const TextCodec::Format& format)
+{
+    if (format.encoding == TextCodec::Utf16LE)
+        return qFromLittleEndian<quint16>(data);
+    if (format.encoding == TextCodec::Utf16BE)
+        return qFromBigEndian<quint16>(data);
+    return *data;
+}
+
+static inline char16_t lineEndOf(const TextCodec::Format& format)
+{
+    return format.lineEnding == TextCodec::CR ? '\r' : '\n';
+}
+
+/**
+ * @brief offset of the first line ending in data, -1 if there's none
+ */
+static qint64 findLineEnd(const uchar* data, qint64 size, const TextCodec::Format& format)
+{
+    const int unit = TextCodec::unitSize(format.encoding);
+    if (unit == 1)
+    {
+        const uchar* end = data + size;
+        const uchar* found = std::find(data, end, uchar(lineEndOf(format)));
+        return found == end ? -1 : found - data;
+    }
+    for (qint64 i = 0; i + unit <= size; i += unit)
+        if (unitAt(data + i, format) == lineEndOf(format))
+            return i;
+    return -1;
+}
+
+static qsizetype countLineEnds(const uchar* data, qint64 size, const TextCodec::Format& format)
+{
+    const int unit = TextCodec::unitSize(format.encoding);
+    if (unit == 1)
+        return std::count(data, data + size, uchar(lineEndOf(format)));
+    qsizetype count = 0;
+    for (qint64 i = 0; i + unit <= size; i += unit)
+        count += unitAt(data + i, format) == lineEndOf(format);
+    return count;
+}
+
+/**
+ * @brief from, or the start of the next char if from falls inside one
+ */
+static qint64 charStartFrom(QFile& file, qint64 from, qint64 size, const TextCodec::Format& format)
+{
+    // a UTF-8 char has at most 3 continuation bytes, a surrogate pair is 4 bytes
+    const qint64 length = qMin(qint64(4), size - from);
+    const uchar* data = length > 0 ? file.map(from, length) : nullptr;
+    if (!data)
+        return from;
+    qint64 skip = 0;
+    if (format.encoding == TextCodec::Utf8)
+    {
+        while (skip < length && (data[skip] & 0xC0) == 0x80)
+            ++skip;
+    }
+    else if (TextCodec::unitSize(format.encoding) == 2 && length >= 2 && QChar::isLowSurrogate(unitAt(data, format)))
+    {
+        skip = 2;
+    }
+    file.unmap(const_cast<uchar*>(data));
+    return from + skip;
+}
+
+/**
+ * @brief start of the first line starting in the page window at from, size if the file ends first
+ *
+ * Only PAGE_SIZE bytes are looked at: a line that runs past them is split
+ * at from (on a char boundary), so pages stay small whatever the lines.
+ * afterLineEnd tells whether a line ending was found, the text past the
+ * last one isn't a line start if the file ends there.
+ */
+static qint64 lineStartFrom(QFile& file, qint64 from, qint64 size, const TextCodec::Format& format,
+                            bool& afterLineEnd)
+{
+    afterLineEnd = false;
+    const qint64 begin = qMin(size, qint64(TextCodec::bomLength(format)));
+    if (from <= begin)
+        return begin;
+
+    // a line starts at from if the unit before it ends a line
+    const int unit = TextCodec::unitSize(format.encoding);
+    const qint64 pos = from - unit;
+    const qint64 length = qMin(PagedFile::PAGE_SIZE, size - pos);
+    const uchar* data = file.map(pos, length);
+    if (!data)
+        return size;
+    const qint64 found = findLineEnd(data, length, format);
+    file.unmap(const_cast<uchar*>(data));
+    if (found >= 0)
+    {
+        afterLineEnd = true;
+        return pos + found + unit;
+    }
+    if (pos + length >= size)
+        return size;
+    return charStartFrom(file, from, size, format);
+}
+
+static qint64 pageStartIn(QFile& file, int page, qint64 size, const TextCodec::Format& format)
+{
+    bool afterLineEnd = false;
+    return lineStartFrom(file, qMin(size, page * PagedFile::PAGE_SIZE), size, format, afterLineEnd);
+}
+
+static QString readRange(QFile& file, qint64 from, qint64 to, const TextCodec::Format& format)
+{
+    if (to <= from)
+        return QString();
+    const uchar* data = file.map(from, to - from);
+    if (!data)
+        return QString();
+    QString text = TextCodec::decode(reinterpret_cast<const char*>(data), to - from, format);
+    file.unmap(const_cast<uchar*>(data));
+    return text;
+}
+
+// PagedFile
+// --------------
+PagedFile::PagedFile(const QString& filename, QObject* parent)
+    : QObject(parent)
+    , m_filename(filename)
+    , m_file(filename)
+{
+    // one worker counts lines while the other searches
+    m_pool.setMaxThreadCount(2);
+}
+
+PagedFile::~PagedFile()
+{
+    cancelFind();
+    if (m_index)
+        m_index->cancelled = true;
+    m_pool.waitForDone();
+}
+
+bool PagedFile::open(QString& error)
+{
+    if (!m_file.open(QIODevice::ReadOnly))
+    {
+        error = m_file.errorString();
+        return false;
+    }
+    m_size = m_file.size();
+
+    // the format is detected on the first lines only, cut at a line feed so no char is cut in two
+    const qint64 sample = qMin(m_size, PAGE_SIZE);
+    const uchar* data = sample > 0 ? m_file.map(0, sample) : nullptr;
+    if (sample > 0 && !data)
+    {
+        error = m_file.errorString();
+        return false;
+    }
+    qint64 end = sample;
+    if (sample < m_size)
+    {
+        while (end > 0 && data[end - 1] != '\n')
+            --end;
+        end = end > 0 ? end - end % 2 : sample;
+    }
+    m_format = TextCodec::detect(reinterpret_cast<const char*>(data), end);
+    if (data)
+        m_file.unmap(const_cast<uchar*>(data));
+
+    // half a UTF-16 unit is left for the next write
+    m_size -= m_size % TextCodec::unitSize(m_format.encoding);
+    startIndex();
+    return true;
+}
+
+/**
+ * @brief byte the first line starting in page starts at, size() past the last page
+ */
+qint64 PagedFile::pageStart(int page)
+{
+    return pageStartIn(m_file, page, m_size, m_format);
+}
+
+QString PagedFile::read(qint64 from, qint64 to)
+{
+    return readRange(m_file, from, qMin(to, m_size), m_format);
+}
+
+// Lines
+// --------------
+int PagedFile::indexedPercent() const
+{
+    return m_size > 0 ? int(m_indexedBytes * 100 / m_size) : 100;
+}
+
+/**
+ * @brief line the page starts at, -1 until the pages before it are counted
+ */
+qsizetype PagedFile::firstLine(int page)
+{
+    if (page <= 0)
+        return 0;
+    if (page * PAGE_SIZE > m_indexedBytes)
+        return -1;
+
+    bool afterLineEnd = false;
+    const qint64 start = lineStartFrom(m_file, page * PAGE_SIZE, m_size, m_format, afterLineEnd);
+    qsizetype line = m_lineEnds[size_t(page - 1)];
+    // the line ending before the page's first line belongs to the page itself
+    if (afterLineEnd && start > page * PAGE_SIZE)
+        ++line;
+    return line;
+}
+
+/**
+ * @brief page holding line (or the one before it), -1 until the line is counted
+ */
+int PagedFile::pageOfLine(qsizetype line) const
+{
+    if (line <= 0)
+        return 0;
+    // line starts after the line-th line ending
+    auto found = std::lower_bound(m_lineEnds.begin(), m_lineEnds.end(), line);
+    return found == m_lineEnds.end() ? -1 : int(found - m_lineEnds.begin());
+}
+
+void PagedFile::startIndex()
+{
+    if (m_indexedBytes >= m_size)
+        return;
+
+    auto job = std::make_shared<IndexJob>();
+    job->filename = m_filename;
+    job->format = m_format;
+    job->from = m_indexedBytes;
+    job->to = m_size;
+    m_index = job;
+    m_pool.start([this, job] { runIndex(this, job); });
+}
+
+/**
+ * @brief counts the line endings of the pages in the job, reporting every INDEX_BATCH pages
+ */
+void PagedFile::runIndex(PagedFile* owner, const std::shared_ptr<IndexJob>& job)
+{
+    QFile file(job->filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    std::vector<qsizetype> counts;
+    qint64 batchFrom = job->from;
+    for (qint64 pos = job->from; pos < job->to && !job->cancelled;)
+    {
+        const qint64 end = qMin(job->to, (pos / PAGE_SIZE + 1) * PAGE_SIZE);
+        const uchar* data = file.map(pos, end - pos);
+        if (!data)
+            return;
+        counts.push_back(countLineEnds(data, end - pos, job->format));
+        file.unmap(const_cast<uchar*>(data));
+        pos = end;
+
+        if (counts.size() < size_t(INDEX_BATCH) && pos < job->to)
+            continue;
+
+        QMetaObject::invokeMethod(owner, [owner, job, from = batchFrom, to = pos, counts] {
+            if (job != owner->m_index)
+                return;
+            qint64 start = from;
+            for (qsizetype count : counts)
+            {
+                const qint64 end = qMin(to, (start / PAGE_SIZE + 1) * PAGE_SIZE);
+                owner->addLineEnds(start, end, count);
+                start = end;
+            }
+            if (to >= job->to)
+            {
+                owner->m_index.reset();
+                // bytes appended while counting
+                owner->countAppended();
+            }
+            emit owner->indexProgressed();
+        }, Qt::QueuedConnection);
+
+        counts.clear();
+        batchFrom = pos;
+    }
+}
+
+/**
+ * @brief adds the line endings counted in [from, to), a part of one page following the bytes counted before
+ */
+void PagedFile::addLineEnds(qint64 from, qint64 to, qsizetype count)
+{
+    const size_t page = size_t(from / PAGE_SIZE);
+    // the rest of a page the file ended in when it was counted
+    if (page < m_lineEnds.size())
+        m_lineEnds.back() += count;
+    else
+        m_lineEnds.push_back((m_lineEnds.empty() ? 0 : m_lineEnds.back()) + count);
+    m_indexedBytes = to;
+}
+
+/**
+ * @brief counts the bytes past the counted ones right away, they're only what was appended since
+ */
+void PagedFile::countAppended()
+{
+    for (qint64 pos = m_indexedBytes; pos < m_size;)
+    {
+        const qint64 end = qMin(m_size, (pos / PAGE_SIZE + 1) * PAGE_SIZE);
+        const uchar* data = m_file.map(pos, end - pos);
+        if (!data)
+            return;
+        const qsizetype count = countLineEnds(data, end - pos, m_format);
+        m_file.unmap(const_cast<uchar*>(data));
+        addLineEnds(pos, end, count);
+        pos = end;
+    }
+}
+
+// Following
+// --------------
+void PagedFile::setFollowing(bool following)
+{
+    if (following == isFollowing())
+        return;
+
+    if (!following)
+    {
+        delete m_watcher;
+        m_watcher = nullptr;
+        delete m_followTimer;
+        m_followTimer = nullptr;
+        return;
+    }
+
+    m_followTimer = new QTimer(this);
+    m_followTimer->setSingleShot(true);
+    m_followTimer->setInterval(FOLLOW_DELAY);
+    connect(m_followTimer, &QTimer::timeout, this, &PagedFile::checkSize);
+
+    // the directory shows the file coming back after it was rotated away
+    m_watcher = new QFileSystemWatcher(this);
+    m_watcher->addPath(m_filename);
+    m_watcher->addPath(QFileInfo(m_filename).absolutePath());
+    auto changed = [this] {
+        if (!m_followTimer->isActive())
+            m_followTimer->start();
+    };
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, this, [this, changed] {
+        // removed or renamed, the file at the path is another one
+        if (!m_watcher->files().contains(m_filename))
+            m_replaced = true;
+        changed();
+    });
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, this, changed);
+
+    // catches up on the writes made until now
+    checkSize();
+}
+
+void PagedFile::checkSize()
+{
+    const QFileInfo info(m_filename);
+    if (!info.exists())
+        return;
+
+    if (m_replaced)
+    {
+        m_replaced = false;
+        m_watcher->addPath(m_filename);
+        reopen();
+        return;
+    }
+
+    const qint64 size = info.size() - info.size() % TextCodec::unitSize(m_format.encoding);
+    if (size < m_size)
+    {
+        reopen();
+        return;
+    }
+    if (size == m_size)
+        return;
+
+    const qint64 previous = m_size;
+    m_size = size;
+    // else the running count gets to them
+    if (!m_index)
+        countAppended();
+    emit grown(previous);
+}
+
+/**
+ * @brief reads a truncated or replaced file again from the start, in the same format
+ */
+void PagedFile::reopen()
+{
+    cancelFind();
+    if (m_index)
+        m_index->cancelled = true;
+    m_index.reset();
+
+    m_file.close();
+    m_size = m_file.open(QIODevice::ReadOnly) ? m_file.size() : 0;
+    m_size -= m_size % TextCodec::unitSize(m_format.encoding);
+    m_lineEnds.clear();
+    m_indexedBytes = 0;
+    startIndex();
+    emit truncated();
+}
+
+// Search
+// --------------
+/**
+ * @brief searches the pages in order, the first match (or the last one, backward) is found()
+ */
+void PagedFile::find(const SearchEngine& engine, const QList<int>& pages, bool backward)
+{
+    cancelFind();
+
+    auto job = std::make_shared<FindJob>();
+    job->filename = m_filename;
+    job->format = m_format;
+    job->size = m_size;
+    job->engine = engine;
+    job->pages = pages;
+    job->backward = backward;
+    m_find = job;
+    m_pool.start([this, job] { runFind(this, job); });
+}
+
+void PagedFile::cancelFind()
+{
+    if (m_find)
+        m_find->cancelled = true;
+    m_find.reset();
+}
+
+void PagedFile::runFind(PagedFile* owner, const std::shared_ptr<FindJob>& job)
+{
+    int foundPage = -1;
+    SearchMatch match;
+
+    QFile file(job->filename);
+    if (file.open(QIODevice::ReadOnly))
+    {
+        for (int page : std::as_const(job->pages))
+        {
+            if (job->cancelled)
+                return;
+            const qint64 start = pageStartIn(file, page, job->size, job->format);
+            const qint64 end = pageStartIn(file, page + 1, job->size, job->format);
+            const TextBuffer text(readRange(file, start, end, job->format));
+            match = job->backward ? job->engine.findPrevious(text, text.length())
+                                  : job->engine.findNext(text, 0);
+            if (match.isValid())
+            {
+                foundPage = page;
+                break;
+            }
+        }
+    }
+
+    QMetaObject::invokeMethod(owner, [owner, job, foundPage, match] {
+        if (job != owner->m_find)
+            return;
+        owner->m_find.reset();
+        if (foundPage < 0)
+            emit owner->notFound();
+        else
+            emit owner->found(foundPage, match.position, match.length);
+    }, Qt::QueuedConnection);
+}
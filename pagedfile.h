@@ -0,0 +1,109 @@
+#ifndef PAGEDFILE_H
+#define PAGEDFILE_H
+
+#include "textcodec.h"
+#include "searchengine.h"
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QFile>
+#include <QThreadPool>
+#include <memory>
+#include <vector>
+
+class QFileSystemWatcher;
+class QTimer;
+
+/**
+ * @brief a read-only file of any size, mapped a page at a time
+ *
+ * The file is cut into pages of PAGE_SIZE bytes, and a page holds the
+ * lines starting in it, so it decodes on its own. A line without a line
+ * ending in the PAGE_SIZE bytes from where a page starts is split there
+ * (on a char boundary), so a page is never more than 2 * PAGE_SIZE bytes,
+ * even in a file without line breaks; the parts are shown joined, only a
+ * search match across the split isn't found. A page is mapped only
+ * while it's read, counted or searched, so memory use depends on the pages
+ * in use rather than on the size of the file.
+ *
+ * The line endings of every page are counted in the background, which
+ * turns line numbers into pages; a line is unknown until then.
+ * Following the file like tail -f, writes reported by a QFileSystemWatcher
+ * map and count only the bytes appended since, and a file that shrank or
+ * was replaced (truncated or rotated logs) is read again from the start.
+ */
+class PagedFile : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PagedFile(const QString& filename, QObject* parent = nullptr);
+    ~PagedFile();
+
+    bool open(QString& error);
+    inline const QString& filename() const { return m_filename; }
+    inline const TextCodec::Format& format() const { return m_format; }
+    inline qint64 size() const { return m_size; }
+
+    // Pages
+    inline int pageCount() const { return int(qMax(qint64(1), (m_size + PAGE_SIZE - 1) / PAGE_SIZE)); }
+    qint64 pageStart(int page);
+    QString read(qint64 from, qint64 to);
+
+    // Lines
+    inline bool isIndexed() const { return m_indexedBytes >= m_size; }
+    int indexedPercent() const;
+    inline qsizetype lineCount() const { return (m_lineEnds.empty() ? 0 : m_lineEnds.back()) + 1; }
+    qsizetype firstLine(int page);
+    int pageOfLine(qsizetype line) const;
+
+    // Following
+    void setFollowing(bool following);
+    inline bool isFollowing() const { return m_watcher != nullptr; }
+
+    // Search
+    void find(const SearchEngine& engine, const QList<int>& pages, bool backward);
+    void cancelFind();
+
+    static constexpr qint64 PAGE_SIZE = 1024 * 1024;
+
+signals:
+    void indexProgressed();
+    void grown(qint64 previousSize);
+    void truncated();
+    void found(int page, qsizetype position, qsizetype length);
+    void notFound();
+
+private:
+    struct IndexJob;
+    struct FindJob;
+    void reopen();
+    void startIndex();
+    void addLineEnds(qint64 from, qint64 to, qsizetype count);
+    void countAppended();
+    void checkSize();
+    static void runIndex(PagedFile* owner, const std::shared_ptr<IndexJob>& job);
+    static void runFind(PagedFile* owner, const std::shared_ptr<FindJob>& job);
+
+    QString m_filename;
+    QFile m_file;
+    TextCodec::Format m_format;
+    qint64 m_size = 0;
+
+    // m_lineEnds[i]: line endings in [0, (i + 1) * PAGE_SIZE), for the bytes counted so far
+    std::vector<qsizetype> m_lineEnds;
+    qint64 m_indexedBytes = 0;
+
+    QThreadPool m_pool;
+    std::shared_ptr<IndexJob> m_index;
+    std::shared_ptr<FindJob> m_find;
+
+    QFileSystemWatcher* m_watcher = nullptr;
+    QTimer* m_followTimer = nullptr;
+    bool m_replaced = false;
+
+    static constexpr int INDEX_BATCH = 64;     // pages counted between progress reports
+    static constexpr int FOLLOW_DELAY = 100;   // ms, a burst of writes is read at once
+};
+
+#endif // PAGEDFILE_H
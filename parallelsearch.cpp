@@ -0,0 +1,151 @@
+#include "parallelsearch.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <atomic>
+#include <vector>
+
+struct ParallelSearch::Job
+{
+    ParallelSearch* owner = nullptr;
+    TextBuffer text;
+    SearchEngine engine;
+
+    // chunk i covers [starts[i], ends[i])
+    std::vector<qsizetype> starts;
+    std::vector<qsizetype> ends;
+    std::atomic<qsizetype> nextChunk{0};
+    std::atomic<bool> cancelled{false};
+
+    // merging the chunk results in order
+    QMutex mutex;
+    std::vector<QList<SearchMatch>> results;
+    std::vector<bool> done;
+    qsizetype nextToDeliver = 0;
+    qsizetype lastMatchEnd = -1;
+    qsizetype matchCount = 0;
+};
+
+ParallelSearch::ParallelSearch(QObject* parent)
+    : QObject(parent)
+{
+    m_pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+ParallelSearch::~ParallelSearch()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+void ParallelSearch::start(const TextBuffer& text, const SearchEngine& engine, qsizetype from)
+{
+    cancel();
+    if (!engine.isValid())
+        return;
+
+    auto job = std::make_shared<Job>();
+    job->owner = this;
+    job->text = text;
+    job->engine = engine;
+
+    // chunks from 'from' to the end, then from the start up to 'from'
+    const qsizetype length = text.length();
+    from = qBound(qsizetype(0), from, length);
+    auto addChunks = [&job](qsizetype begin, qsizetype end) {
+        for (qsizetype pos = begin; pos < end; pos += CHUNK_SIZE)
+        {
+            job->starts.push_back(pos);
+            job->ends.push_back(qMin(end, pos + CHUNK_SIZE));
+        }
+    };
+    addChunks(from, length);
+    addChunks(0, from);
+
+    job->results.resize(job->starts.size());
+    job->done.resize(job->starts.size(), false);
+    m_job = job;
+
+    if (job->starts.empty())
+    {
+        deliver(job, {}, true);
+        return;
+    }
+
+    int workers = int(qMin(qsizetype(m_pool.maxThreadCount()), qsizetype(job->starts.size())));
+    for (int i = 0; i < workers; ++i)
+        m_pool.start([job] { runWorker(job); });
+}
+
+void ParallelSearch::cancel()
+{
+    if (m_job)
+        m_job->cancelled = true;
+    m_job.reset();
+}
+
+void ParallelSearch::runWorker(const std::shared_ptr<Job>& job)
+{
+    const qsizetype chunkCount = qsizetype(job->starts.size());
+
+    while (!job->cancelled)
+    {
+        qsizetype chunk = job->nextChunk.fetch_add(1);
+        if (chunk >= chunkCount)
+            return;
+
+        QList<SearchMatch> matches = job->engine.findAll(job->text, job->starts[chunk], job->ends[chunk]);
+
+        QMutexLocker locker(&job->mutex);
+        job->results[chunk] = std::move(matches);
+        job->done[chunk] = true;
+
+        // hand out every finished chunk that has no unfinished chunk before it
+        QList<SearchMatch> ready;
+        while (job->nextToDeliver < chunkCount && job->done[job->nextToDeliver])
+        {
+            qsizetype i = job->nextToDeliver++;
+            if (i > 0 && job->starts[i] != job->ends[i - 1])
+                job->lastMatchEnd = -1;
+            // a match running over the end of the previous chunk hides overlapping ones,
+            // and a sequential scan would go on from its end: scan again from there
+            const QList<SearchMatch>& found = job->results[i];
+            if (!found.isEmpty() && found.first().position < job->lastMatchEnd)
+                job->results[i] = job->lastMatchEnd < job->ends[i]
+                    ? job->engine.findAll(job->text, job->lastMatchEnd, job->ends[i])
+                    : QList<SearchMatch>();
+            for (const SearchMatch& match : job->results[i])
+            {
+                if (match.position < job->lastMatchEnd)
+                    continue;
+                ready.append(match);
+                job->lastMatchEnd = match.end();
+            }
+            job->results[i] = QList<SearchMatch>();
+        }
+        job->matchCount += ready.size();
+        bool finished = job->nextToDeliver == chunkCount;
+
+        // posted under the lock, so batches arrive in order and the last one last
+        if (!ready.isEmpty() || finished)
+            job->owner->deliver(job, ready, finished);
+    }
+}
+
+/**
+ * @brief passes results to the thread of this object, dropping those of cancelled jobs
+ */
+void ParallelSearch::deliver(const std::shared_ptr<Job>& job, const QList<SearchMatch>& matches, bool done)
+{
+    QMetaObject::invokeMethod(this, [this, job, matches, done] {
+        if (job != m_job)
+            return;
+        if (!matches.isEmpty())
+            emit matchesFound(matches);
+        if (done)
+        {
+            m_job.reset();
+            emit finished(job->matchCount);
+        }
+    }, Qt::QueuedConnection);
+}
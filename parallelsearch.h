@@ -0,0 +1,54 @@
+#ifndef PARALLELSEARCH_H
+#define PARALLELSEARCH_H
+
+#include "textbuffer.h"
+#include "searchengine.h"
+#include <QObject>
+#include <QList>
+#include <QThreadPool>
+#include <memory>
+
+/**
+ * @brief runs a SearchEngine over a snapshot of a buffer on all cores
+ *
+ * The text is cut into chunks that idle workers keep taking from a shared
+ * counter, so fast workers pick up the slack of slow ones. A match may run
+ * past the end of its chunk; the next chunk is then scanned again from the
+ * end of that match, so the matches are exactly those of a sequential scan.
+ * Chunks are scanned starting at 'from' and wrapping around, and their
+ * matches are reported in that order as soon as all chunks before them are
+ * done, so the first hits show up long before a huge scan finishes.
+ * Starting another search cancels the running one.
+ */
+class ParallelSearch : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ParallelSearch(QObject* parent = nullptr);
+    ~ParallelSearch();
+
+    void start(const TextBuffer& text, const SearchEngine& engine, qsizetype from = 0);
+    void cancel();
+    inline bool isRunning() const { return m_job != nullptr; }
+    // all cores by default
+    inline void setThreadCount(int count) { m_pool.setMaxThreadCount(count); }
+    inline int threadCount() const { return m_pool.maxThreadCount(); }
+
+    static constexpr qsizetype CHUNK_SIZE = 1024 * 1024;
+
+signals:
+    // matches in scan order (from 'from' to the end, then from the start)
+    void matchesFound(const QList<SearchMatch>& matches);
+    void finished(qsizetype matchCount);
+
+private:
+    struct Job;
+    static void runWorker(const std::shared_ptr<Job>& job);
+    void deliver(const std::shared_ptr<Job>& job, const QList<SearchMatch>& matches, bool done);
+
+    QThreadPool m_pool;
+    std::shared_ptr<Job> m_job;
+};
+
+#endif // PARALLELSEARCH_H
@@ -0,0 +1,122 @@
+#include "parallelsubstitute.h"
+#include <QThread>
+#include <atomic>
+#include <vector>
+
+struct ParallelSubstitute::Job
+{
+    ParallelSubstitute* owner = nullptr;
+    TextBuffer text;
+    Substitution substitution;
+
+    // chunk i covers lines [firstLines[i], lastLines[i]]
+    std::vector<qsizetype> firstLines;
+    std::vector<qsizetype> lastLines;
+    std::vector<Substitution::Result> results;
+    std::atomic<qsizetype> nextChunk{0};
+    std::atomic<qsizetype> remaining{0};
+    std::atomic<bool> cancelled{false};
+};
+
+ParallelSubstitute::ParallelSubstitute(QObject* parent)
+    : QObject(parent)
+{
+    m_pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+ParallelSubstitute::~ParallelSubstitute()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+void ParallelSubstitute::start(const TextBuffer& text, const Substitution& substitution,
+                               qsizetype firstLine, qsizetype lastLine)
+{
+    cancel();
+
+    auto job = std::make_shared<Job>();
+    job->owner = this;
+    job->text = text;
+    job->substitution = substitution;
+
+    // chunks of whole lines, about CHUNK_SIZE chars each
+    lastLine = qMin(lastLine, text.lineCount() - 1);
+    for (qsizetype line = firstLine; line <= lastLine;)
+    {
+        const qsizetype end = qMin(text.length(), text.lineStart(line) + CHUNK_SIZE);
+        const qsizetype last = qBound(line, text.lineAt(end), lastLine);
+        job->firstLines.push_back(line);
+        job->lastLines.push_back(last);
+        line = last + 1;
+    }
+
+    const qsizetype chunkCount = qsizetype(job->firstLines.size());
+    job->results.resize(size_t(chunkCount));
+    job->remaining = chunkCount;
+    m_job = job;
+
+    if (chunkCount == 0)
+    {
+        deliver(job);
+        return;
+    }
+
+    int workers = int(qMin(qsizetype(m_pool.maxThreadCount()), chunkCount));
+    for (int i = 0; i < workers; ++i)
+        m_pool.start([job] { runWorker(job); });
+}
+
+void ParallelSubstitute::cancel()
+{
+    if (m_job)
+        m_job->cancelled = true;
+    m_job.reset();
+}
+
+void ParallelSubstitute::runWorker(const std::shared_ptr<Job>& job)
+{
+    const qsizetype chunkCount = qsizetype(job->firstLines.size());
+
+    while (!job->cancelled)
+    {
+        const qsizetype chunk = job->nextChunk.fetch_add(1);
+        if (chunk >= chunkCount)
+            return;
+
+        // every chunk has a slot of its own, no locking needed
+        job->results[size_t(chunk)] = job->substitution.run(job->text, job->firstLines[size_t(chunk)],
+                                                            job->lastLines[size_t(chunk)]);
+        if (job->remaining.fetch_sub(1) == 1)
+            job->owner->deliver(job);
+    }
+}
+
+/**
+ * @brief joins the chunk results in order on the thread of this object, dropping those of cancelled jobs
+ */
+void ParallelSubstitute::deliver(const std::shared_ptr<Job>& job)
+{
+    QMetaObject::invokeMethod(this, [this, job] {
+        if (job != m_job)
+            return;
+        m_job.reset();
+
+        Substitution::Result result;
+        qsizetype changeCount = 0;
+        for (const Substitution::Result& chunk : job->results)
+            changeCount += chunk.changes.size();
+        result.changes.reserve(changeCount);
+
+        for (Substitution::Result& chunk : job->results)
+        {
+            for (Substitution::Change& change : chunk.changes)
+                result.changes.append(std::move(change));
+            result.matches += chunk.matches;
+            result.lines += chunk.lines;
+            result.deletedLines += chunk.deletedLines;
+            result.deletedLastLine = result.deletedLastLine || chunk.deletedLastLine;
+        }
+        emit finished(result);
+    }, Qt::QueuedConnection);
+}
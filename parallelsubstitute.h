@@ -0,0 +1,46 @@
+#ifndef PARALLELSUBSTITUTE_H
+#define PARALLELSUBSTITUTE_H
+
+#include "textbuffer.h"
+#include "substitution.h"
+#include <QObject>
+#include <QThreadPool>
+#include <memory>
+
+/**
+ * @brief runs a Substitution over lines of a snapshot of a buffer on all cores
+ *
+ * The lines are cut into chunks of about CHUNK_SIZE chars that idle
+ * workers keep taking from a shared counter. Chunks hold whole lines, so
+ * they're substituted independently, and their changes come back in
+ * order, all at once, when the last chunk is done, ready to be applied
+ * to the buffer as one batch.
+ * Starting another substitution cancels the running one.
+ */
+class ParallelSubstitute : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ParallelSubstitute(QObject* parent = nullptr);
+    ~ParallelSubstitute();
+
+    void start(const TextBuffer& text, const Substitution& substitution, qsizetype firstLine, qsizetype lastLine);
+    void cancel();
+    inline bool isRunning() const { return m_job != nullptr; }
+
+    static constexpr qsizetype CHUNK_SIZE = 1024 * 1024;
+
+signals:
+    void finished(const Substitution::Result& result);
+
+private:
+    struct Job;
+    static void runWorker(const std::shared_ptr<Job>& job);
+    void deliver(const std::shared_ptr<Job>& job);
+
+    QThreadPool m_pool;
+    std::shared_ptr<Job> m_job;
+};
+
+#endif // PARALLELSUBSTITUTE_H
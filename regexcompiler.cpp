@@ -0,0 +1,198 @@
+#include "regexcompiler.h"
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+
+QRegularExpression RegexCompiler::compile(const QString& pattern, RegexSyntax syntax,
+                                          bool caseSensitive, bool wholeWords)
+{
+    static QMutex mutex;
+    static QHash<QString, QRegularExpression> cache;
+    static QList<QString> recent; // least recently used first
+
+    const QString key = QString::number(int(syntax)) + (caseSensitive ? 'c' : 'i') +
+                        (wholeWords ? 'w' : '-') + pattern;
+
+    QMutexLocker locker(&mutex);
+    auto cached = cache.constFind(key);
+    if (cached != cache.constEnd())
+    {
+        recent.removeOne(key);
+        recent.append(key);
+        return *cached;
+    }
+
+    QString perl = (syntax == RegexSyntax::Sed) ? fromSed(pattern) : pattern;
+    if (wholeWords)
+        perl = "\\b(?:" + perl + ")\\b";
+
+    QRegularExpression::PatternOptions options = QRegularExpression::MultilineOption;
+    if (!caseSensitive)
+        options |= QRegularExpression::CaseInsensitiveOption;
+
+    QRegularExpression regex(perl, options);
+    regex.optimize();
+
+    if (regex.isValid())
+    {
+        if (recent.size() >= CACHE_SIZE)
+            cache.remove(recent.takeFirst());
+        cache.insert(key, regex);
+        recent.append(key);
+    }
+    return regex;
+}
+
+QString RegexCompiler::fromSed(const QString& pattern)
+{
+    QString perl;
+    perl.reserve(pattern.size() + 8);
+
+    const qsizetype size = pattern.size();
+    // '*' is literal at the start of the pattern or of a group, so is '^' anywhere else
+    bool atStart = true;
+
+    for (qsizetype i = 0; i < size; ++i)
+    {
+        const QChar ch = pattern[i];
+        bool startsGroup = false;
+
+        if (ch == '\\' && i + 1 < size)
+        {
+            const QChar next = pattern[++i];
+            switch (next.unicode())
+            {
+                // escaped, these are the operators
+                case '(': perl += '('; startsGroup = true; break;
+                case '|': perl += '|'; startsGroup = true; break;
+                case ')': case '{': case '}': case '+': case '?':
+                    perl += next;
+                    break;
+                // GNU word boundaries
+                case '<': case '>':
+                    perl += "\\b";
+                    break;
+                default:
+                    perl += '\\';
+                    perl += next;
+                    break;
+            }
+        }
+        else switch (ch.unicode())
+        {
+            // unescaped, these are plain chars
+            case '(': case ')': case '{': case '}': case '+': case '?': case '|':
+                perl += '\\';
+                perl += ch;
+                break;
+
+            case '*':
+                perl += atStart ? "\\*" : "*";
+                break;
+
+            case '^':
+                perl += atStart ? "^" : "\\^";
+                startsGroup = atStart;
+                break;
+
+            case '$':
+            {
+                // an anchor only at the end of the pattern or of a group
+                bool atEnd = i + 1 == size ||
+                             (pattern[i + 1] == '\\' && i + 2 < size &&
+                              (pattern[i + 2] == ')' || pattern[i + 2] == '|'));
+                perl += atEnd ? "$" : "\\$";
+                break;
+            }
+
+            case '[':
+            {
+                // bracket expression: copied as is, but backslashes are literal in it
+                qsizetype j = i + 1;
+                perl += '[';
+                if (j < size && pattern[j] == '^')
+                    perl += pattern[j++];
+                if (j < size && pattern[j] == ']')
+                {
+                    perl += "\\]";
+                    ++j;
+                }
+                for (; j < size && pattern[j] != ']'; ++j)
+                {
+                    // [:alpha:], [=a=] and [.a.]
+                    if (pattern[j] == '[' && j + 1 < size &&
+                        (pattern[j + 1] == ':' || pattern[j + 1] == '=' || pattern[j + 1] == '.'))
+                    {
+                        qsizetype close = pattern.indexOf(QString(pattern[j + 1]) + ']', j + 2);
+                        if (close >= 0)
+                        {
+                            perl += pattern.mid(j, close + 2 - j);
+                            j = close + 1;
+                            continue;
+                        }
+                    }
+                    if (pattern[j] == '\\' || pattern[j] == '[')
+                        perl += '\\';
+                    perl += pattern[j];
+                }
+                perl += ']';
+                i = j;
+                break;
+            }
+
+            default:
+                perl += ch;
+                break;
+        }
+        atStart = startsGroup;
+    }
+    return perl;
+}
+
+QString RegexCompiler::literalPrefix(const QString& pattern)
+{
+    static const QString metaChars = ".[]()*+?{}|^$";
+    const qsizetype size = pattern.size();
+
+    // with alternatives a match may start with any of them
+    bool inBracket = false;
+    for (qsizetype i = 0; i < size; ++i)
+    {
+        if (pattern[i] == '\\')
+            ++i;
+        else if (pattern[i] == '[')
+            inBracket = true;
+        else if (pattern[i] == ']')
+            inBracket = false;
+        else if (pattern[i] == '|' && !inBracket)
+            return QString();
+    }
+
+    QString prefix;
+    qsizetype i = (size > 0 && pattern[0] == '^') ? 1 : 0;
+    while (i < size)
+    {
+        QChar literal = pattern[i];
+        qsizetype next = i + 1;
+        if (literal == '\\')
+        {
+            // only escaped punctuation is a literal, \d, \b, \1 etc. are not
+            if (next >= size || pattern[next].isLetterOrNumber() || pattern[next].unicode() > 127)
+                break;
+            literal = pattern[next];
+            ++next;
+        }
+        else if (metaChars.contains(literal))
+            break;
+
+        // a quantified char may not be there at all
+        if (next < size && (pattern[next] == '*' || pattern[next] == '?' || pattern[next] == '{'))
+            break;
+        prefix += literal;
+        if (next < size && pattern[next] == '+')
+            break;
+        i = next;
+    }
+    return prefix;
+}
@@ -0,0 +1,31 @@
+#ifndef REGEXCOMPILER_H
+#define REGEXCOMPILER_H
+
+#include <QString>
+#include <QRegularExpression>
+
+enum class RegexSyntax {Perl = 0, Sed};
+
+/**
+ * @brief compiles search patterns into (JIT optimized) QRegularExpressions
+ *
+ * Compiled patterns are cached, so searching the same pattern again
+ * (n/N, re-highlighting after an edit) never recompiles it.
+ */
+class RegexCompiler
+{
+public:
+    static QRegularExpression compile(const QString& pattern, RegexSyntax syntax,
+                                      bool caseSensitive, bool wholeWords);
+
+    // translates a sed (POSIX basic + GNU extensions) pattern into Perl syntax
+    static QString fromSed(const QString& pattern);
+
+    // literal text every match of the Perl pattern starts with, empty if there's none
+    static QString literalPrefix(const QString& pattern);
+
+private:
+    static constexpr int CACHE_SIZE = 32;
+};
+
+#endif // REGEXCOMPILER_H
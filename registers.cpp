@@ -0,0 +1,94 @@
+#include "registers.h"
+
+/**
+ * @brief stores a yank in name and the unnamed register ("0 when no name is given)
+ */
+void Registers::yank(char16_t name, const Register& reg)
+{
+    if (name == '_')
+        return;
+    set(slotOf(name) == Unnamed ? u'0' : name, reg);
+}
+
+/**
+ * @brief stores deleted text: in name if given, otherwise in "1 (shifting "1-"8 down)
+ *        or, for less than a line, in "-
+ */
+void Registers::remove(char16_t name, const Register& reg)
+{
+    if (name == '_')
+        return;
+    if (slotOf(name) != Unnamed)
+    {
+        set(name, reg);
+        return;
+    }
+
+    if (!reg.linewise && reg.text.lineCount() == 1)
+    {
+        set('-', reg);
+        return;
+    }
+    // copies of a TextBuffer share everything, shifting is cheap
+    for (int slot = Numbered + 9; slot > Numbered + 1; --slot)
+        m_registers[slot] = m_registers[slot - 1];
+    set('1', reg);
+}
+
+/**
+ * @brief contents of name, an empty register if it isn't one
+ */
+const Registers::Register& Registers::get(char16_t name) const
+{
+    static const Register empty;
+    if (name == '_')
+        return empty;
+    const int slot = slotOf(name);
+    return slot >= 0 ? m_registers[slot] : empty;
+}
+
+// writes name and makes the unnamed register point to it
+void Registers::set(char16_t name, const Register& reg)
+{
+    const int slot = slotOf(name);
+    // registers that aren't stored ("+, "/ ...) only fill the unnamed one
+    if (slot < 0)
+    {
+        m_registers[Unnamed] = reg;
+        return;
+    }
+
+    // "A-"Z append to "a-"z
+    if (name >= 'A' && name <= 'Z')
+    {
+        Register& target = m_registers[slot];
+        if (reg.linewise || target.linewise)
+        {
+            if (!target.text.isEmpty())
+                target.text.append("\n");
+            target.linewise = true;
+        }
+        target.text.insert(target.text.length(), reg.text);
+    }
+    else if (slot > Unnamed)
+    {
+        m_registers[slot] = reg;
+    }
+    m_registers[Unnamed] = m_registers[slot];
+}
+
+// -1 for registers that aren't stored
+int Registers::slotOf(char16_t name)
+{
+    if (name == 0 || name == '"')
+        return Unnamed;
+    if (name >= '0' && name <= '9')
+        return Numbered + (name - '0');
+    if (name >= 'a' && name <= 'z')
+        return Named + (name - 'a');
+    if (name >= 'A' && name <= 'Z')
+        return Named + (name - 'A');
+    if (name == '-')
+        return Small;
+    return -1;
+}
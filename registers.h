@@ -0,0 +1,38 @@
+#ifndef REGISTERS_H
+#define REGISTERS_H
+
+#include "textbuffer.h"
+#include <array>
+
+/**
+ * @brief Vim registers: unnamed, "0-"9, "a-"z and the small delete register "-
+ *
+ * A register holds a TextBuffer slice of the text it was yanked or deleted
+ * from rather than a copy, so yanking even a huge range is O(log n) and
+ * needs no memory for the text. TextBuffer is persistent: editing the
+ * source afterwards builds new pieces and never touches the ones a register
+ * refers to, which is what copy-on-write would give, without any copying.
+ */
+class Registers
+{
+public:
+    struct Register
+    {
+        TextBuffer text;
+        bool linewise = false; // whole lines (yy, dd), without the last line break
+    };
+
+    void yank(char16_t name, const Register& reg);
+    void remove(char16_t name, const Register& reg);
+    const Register& get(char16_t name) const;
+
+private:
+    enum Slot {Unnamed = 0, Numbered = 1, Named = Numbered + 10, Small = Named + 26, SLOT_COUNT};
+
+    void set(char16_t name, const Register& reg);
+    static int slotOf(char16_t name);
+
+    std::array<Register, SLOT_COUNT> m_registers;
+};
+
+#endif // REGISTERS_H
@@ -7,9 +7,18 @@ SearchDialog::SearchDialog(QWidget *parent)
 {
     ui->setupUi(this);
 
+    // the regex flavor only matters for regex searches
+    ui->perl->setChecked(true);
+    ui->perl->setEnabled(false);
+    ui->sed->setEnabled(false);
+
     // setting up actions
     // ------------------
     QObject::connect(ui->closeButton, &QPushButton::clicked, this, &QDialog::close);
+    QObject::connect(ui->searchButton, &QPushButton::clicked, this, &SearchDialog::requestSearch);
+    QObject::connect(ui->search, &QLineEdit::returnPressed, this, &SearchDialog::requestSearch);
+    QObject::connect(ui->regex, &QCheckBox::toggled, ui->perl, &QWidget::setEnabled);
+    QObject::connect(ui->regex, &QCheckBox::toggled, ui->sed, &QWidget::setEnabled);
 }
 
 SearchDialog::~SearchDialog()
@@ -17,3 +26,24 @@ SearchDialog::~SearchDialog()
     delete ui;
 
 }
+
+QString SearchDialog::pattern() const
+{
+    return ui->search->text();
+}
+
+SearchOptions SearchDialog::options() const
+{
+    SearchOptions options;
+    options.caseSensitive = ui->caseSensitive->isChecked();
+    options.wholeWords = ui->wholeWords->isChecked();
+    options.regex = ui->regex->isChecked();
+    options.syntax = ui->sed->isChecked() ? RegexSyntax::Sed : RegexSyntax::Perl;
+    return options;
+}
+
+void SearchDialog::requestSearch()
+{
+    if (!pattern().isEmpty())
+        emit searchRequested(pattern(), options());
+}
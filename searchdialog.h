@@ -2,6 +2,7 @@
 #define SEARCHDIALOG_H
 
 #include <QDialog>
+#include "searchengine.h"
 
 namespace Ui {
 class SearchDialog;
@@ -15,7 +16,15 @@ public:
     explicit SearchDialog(QWidget *parent = nullptr);
     ~SearchDialog();
 
+    QString pattern() const;
+    SearchOptions options() const;
+
+signals:
+    void searchRequested(const QString& pattern, SearchOptions options);
+
 private:
+    void requestSearch();
+
     Ui::SearchDialog *ui;
 };
 
@@ -0,0 +1,320 @@
+#include "searchengine.h"
+#include "textiterator.h"
+#include <QtAlgorithms>
+#include <cstring>
+
+// findPrevious scans backwards in windows of this many chars
+static constexpr qsizetype BACKWARD_WINDOW = 64 * 1024;
+
+SearchEngine::SearchEngine(const QString& pattern, SearchOptions options)
+    : m_original(pattern)
+    , m_options(options)
+{
+    if (pattern.isEmpty())
+        return;
+
+    if (m_options.regex)
+    {
+        m_regex = RegexCompiler::compile(pattern, options.syntax, options.caseSensitive, options.wholeWords);
+        if (!m_regex.isValid())
+            return;
+
+        QString perl = (options.syntax == RegexSyntax::Sed) ? RegexCompiler::fromSed(pattern) : pattern;
+        QString prefix = RegexCompiler::literalPrefix(perl);
+        if (!prefix.isEmpty())
+        {
+            SearchOptions literal;
+            literal.caseSensitive = options.caseSensitive;
+            m_prefilter = std::make_shared<SearchEngine>(prefix, literal);
+        }
+        return;
+    }
+
+    m_pattern.reserve(pattern.size());
+    for (QChar ch : pattern)
+        m_pattern.append(fold(ch));
+
+    const qsizetype m = m_pattern.size();
+    for (quint32& skip : m_skip)
+        skip = quint32(m);
+    for (qsizetype j = 0; j < m - 1; ++j)
+        m_skip[m_pattern[j].unicode() & 0xFF] = quint32(m - 1 - j);
+
+    char16_t first = m_pattern[0].unicode();
+    m_firstA = m_firstB = first;
+    if (!m_options.caseSensitive)
+    {
+        if (first >= 'a' && first <= 'z')
+            m_firstB = first - 32;
+        // KELVIN SIGN folds to 'k' and LONG S to 's', anything non-ASCII may have several forms
+        m_vectorFirst = first < 128 && first != 'k' && first != 's';
+    }
+
+    m_checkStart = m_options.wholeWords && isWordChar(m_pattern.front());
+    m_checkEnd = m_options.wholeWords && isWordChar(m_pattern.back());
+}
+
+bool SearchEngine::isValid() const
+{
+    if (m_options.regex)
+        return !m_original.isEmpty() && m_regex.isValid();
+    return !m_pattern.isEmpty();
+}
+
+QString SearchEngine::errorString() const
+{
+    return m_options.regex ? m_regex.errorString() : QString();
+}
+
+/**
+ * @brief next position in [from, to) holding the first pattern char, -1 if none
+ */
+qsizetype SearchEngine::findFirst(const QChar* text, qsizetype from, qsizetype to) const
+{
+    qsizetype i = from;
+
+    if (!m_vectorFirst)
+    {
+        const QChar first = m_pattern[0];
+        for (; i < to; ++i)
+            if (fold(text[i]) == first)
+                return i;
+        return -1;
+    }
+
+#ifdef VIMMY_SSE2
+    const __m128i a = _mm_set1_epi16(short(m_firstA));
+    const __m128i b = _mm_set1_epi16(short(m_firstB));
+    for (; i + 8 <= to; i += 8)
+    {
+        __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi16(chars, a), _mm_cmpeq_epi16(chars, b));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask)
+            return i + qCountTrailingZeroBits(quint32(mask)) / 2;
+    }
+#endif
+
+    for (; i < to; ++i)
+        if (text[i].unicode() == m_firstA || text[i].unicode() == m_firstB)
+            return i;
+    return -1;
+}
+
+bool SearchEngine::matchesAt(const QChar* text, qsizetype pos) const
+{
+    const qsizetype m = m_pattern.size();
+    if (m_options.caseSensitive)
+        return std::memcmp(text + pos, m_pattern.constData(), m * sizeof(QChar)) == 0;
+
+    for (qsizetype j = m - 1; j >= 0; --j)
+        if (fold(text[pos + j]) != m_pattern[j])
+            return false;
+    return true;
+}
+
+qsizetype SearchEngine::indexIn(QStringView text, qsizetype from, qsizetype to, QChar before, QChar after) const
+{
+    if (m_pattern.isEmpty())
+        return -1;
+
+    const qsizetype m = m_pattern.size();
+    const QChar* data = text.data();
+    from = qMax(qsizetype(0), from);
+    to = qMin(to, text.size() - m + 1);
+
+    qsizetype i = from;
+    while (i < to)
+    {
+        i = findFirst(data, i, to);
+        if (i < 0)
+            return -1;
+
+        if (matchesAt(data, i))
+        {
+            QChar prev = i > 0 ? data[i - 1] : before;
+            QChar next = i + m < text.size() ? data[i + m] : after;
+            if (!(m_checkStart && isWordChar(prev)) && !(m_checkEnd && isWordChar(next)))
+                return i;
+        }
+
+        // Horspool: shift by the char under the end of the window
+        i += m_skip[fold(data[i + m - 1]).unicode() & 0xFF];
+    }
+    return -1;
+}
+
+SearchMatch SearchEngine::findNext(const TextBuffer& buffer, qsizetype from, qsizetype to) const
+{
+    if (!isValid())
+        return SearchMatch();
+
+    if (m_options.regex)
+    {
+        QList<SearchMatch> matches = findRegex(buffer, from, to, 1);
+        return matches.isEmpty() ? SearchMatch() : matches.first();
+    }
+
+    qsizetype position = findLiteral(buffer, from, to);
+    return position < 0 ? SearchMatch() : SearchMatch{position, m_pattern.size()};
+}
+
+qsizetype SearchEngine::findLiteral(const TextBuffer& buffer, qsizetype from, qsizetype to) const
+{
+    const qsizetype m = m_pattern.size();
+    const qsizetype length = buffer.length();
+    if (to < 0 || to > length)
+        to = length;
+
+    qsizetype pos = qMax(qsizetype(0), from);
+    while (pos < to && pos + m <= length)
+    {
+        TextBuffer::Span span = buffer.spanAt(pos);
+        const qsizetype spanEnd = span.start + span.text.size();
+        const qsizetype scanEnd = qMin(to, spanEnd);
+
+        // matches lying inside this piece are found in place
+        QChar before = span.start > 0 ? buffer.at(span.start - 1) : QChar();
+        qsizetype hit = indexIn(span.text, pos - span.start, scanEnd - span.start, before, buffer.at(spanEnd));
+        if (hit >= 0)
+            return span.start + hit;
+
+        // matches running into the next pieces are searched in a small copy of the seam
+        if (m > 1 && spanEnd < length)
+        {
+            qsizetype start = qMax(pos, spanEnd - (m - 1));
+            if (start < scanEnd)
+            {
+                QString seam = buffer.text(start, spanEnd - start + m - 1);
+                before = start > 0 ? buffer.at(start - 1) : QChar();
+                hit = indexIn(seam, 0, scanEnd - start, before, buffer.at(start + seam.size()));
+                if (hit >= 0)
+                    return start + hit;
+            }
+        }
+        pos = spanEnd;
+    }
+    return -1;
+}
+
+SearchMatch SearchEngine::findPrevious(const TextBuffer& buffer, qsizetype before) const
+{
+    if (!isValid())
+        return SearchMatch();
+
+    qsizetype end = qMin(before, buffer.length());
+    while (end > 0)
+    {
+        qsizetype start = qMax(qsizetype(0), end - BACKWARD_WINDOW);
+        SearchMatch last;
+        if (m_options.regex)
+        {
+            QList<SearchMatch> matches = findRegex(buffer, start, end, -1);
+            if (!matches.isEmpty())
+                last = matches.last();
+        }
+        else
+        {
+            for (qsizetype pos = findLiteral(buffer, start, end); pos >= 0; pos = findLiteral(buffer, pos + 1, end))
+                last = SearchMatch{pos, m_pattern.size()};
+        }
+        if (last.isValid())
+            return last;
+        end = start;
+    }
+    return SearchMatch();
+}
+
+QList<SearchMatch> SearchEngine::findAll(const TextBuffer& buffer, qsizetype from, qsizetype to) const
+{
+    if (!isValid())
+        return QList<SearchMatch>();
+    if (m_options.regex)
+        return findRegex(buffer, from, to, -1);
+
+    QList<SearchMatch> matches;
+    for (qsizetype pos = findLiteral(buffer, from, to); pos >= 0; pos = findLiteral(buffer, pos + m_pattern.size(), to))
+        matches.append(SearchMatch{pos, m_pattern.size()});
+    return matches;
+}
+
+/**
+ * @brief up to limit (-1: all) regex matches starting in [from, to)
+ *
+ * The expression runs over copies of whole lines, a chunk at a time,
+ * and only at the prefilter candidates if there is a prefilter.
+ */
+QList<SearchMatch> SearchEngine::findRegex(const TextBuffer& buffer, qsizetype from, qsizetype to, qsizetype limit) const
+{
+    QList<SearchMatch> matches;
+    const qsizetype length = buffer.length();
+    if (to < 0 || to > length)
+        to = length;
+
+    qsizetype pos = qMax(qsizetype(0), from);
+    qsizetype lastEnd = -1;
+    while (pos < to)
+    {
+        const qsizetype chunkEnd = qMin(to, pos + REGEX_CHUNK_SIZE);
+
+        // extend the chunk to whole lines
+        TextIterator it(buffer, pos);
+        while (!it.atStart() && pos - it.position() < MAX_LINE_SPAN)
+        {
+            TextIterator prev = it;
+            if (*--prev == '\n')
+                break;
+            it = prev;
+        }
+        const qsizetype subjectStart = it.position();
+
+        it = TextIterator(buffer, chunkEnd);
+        while (!it.atEnd() && *it != '\n' && it.position() - chunkEnd < MAX_LINE_SPAN)
+            ++it;
+        const qsizetype subjectEnd = it.position();
+
+        const QString subject = buffer.text(subjectStart, subjectEnd - subjectStart);
+        const qsizetype stop = chunkEnd - subjectStart;
+
+        auto add = [&](qsizetype start, qsizetype matchLength) {
+            if (matchLength <= 0 || subjectStart + start < lastEnd)
+                return;
+            matches.append(SearchMatch{subjectStart + start, matchLength});
+            lastEnd = subjectStart + start + matchLength;
+        };
+
+        if (m_prefilter)
+        {
+            qsizetype candidate = m_prefilter->indexIn(subject, pos - subjectStart, stop);
+            while (candidate >= 0)
+            {
+                QRegularExpressionMatch match = m_regex.match(subject, candidate, QRegularExpression::NormalMatch,
+                                                              QRegularExpression::AnchorAtOffsetMatchOption);
+                qsizetype next = candidate + 1;
+                if (match.hasMatch())
+                {
+                    add(match.capturedStart(), match.capturedLength());
+                    next = qMax(next, match.capturedEnd());
+                }
+                if (limit >= 0 && matches.size() >= limit)
+                    return matches;
+                candidate = m_prefilter->indexIn(subject, next, stop);
+            }
+        }
+        else
+        {
+            QRegularExpressionMatchIterator matchIt = m_regex.globalMatch(subject, pos - subjectStart);
+            while (matchIt.hasNext())
+            {
+                QRegularExpressionMatch match = matchIt.next();
+                if (match.capturedStart() >= stop)
+                    break;
+                add(match.capturedStart(), match.capturedLength());
+                if (limit >= 0 && matches.size() >= limit)
+                    return matches;
+            }
+        }
+        pos = chunkEnd;
+    }
+    return matches;
+}
@@ -0,0 +1,111 @@
+#ifndef SEARCHENGINE_H
+#define SEARCHENGINE_H
+
+#include "textbuffer.h"
+#include "regexcompiler.h"
+#include "simd.h"
+#include <QString>
+#include <QStringView>
+#include <QChar>
+#include <QList>
+#include <QRegularExpression>
+#include <memory>
+
+struct SearchOptions
+{
+    bool caseSensitive = false;
+    bool wholeWords = false;
+    bool regex = false;
+    RegexSyntax syntax = RegexSyntax::Perl;
+};
+
+struct SearchMatch
+{
+    qsizetype position = -1;
+    qsizetype length = 0;
+
+    inline bool isValid() const { return position >= 0; }
+    inline qsizetype end() const { return position + length; }
+};
+
+/**
+ * @brief literal or regular expression search over a TextBuffer
+ *
+ * Literal candidates are found with a vectorized scan for the first pattern
+ * char, verified back to front and skipped over Boyer-Moore-Horspool style.
+ * Case folding and the whole-word boundary checks happen inside that loop.
+ *
+ * Regular expressions (Perl or sed syntax) match within lines. If every
+ * match has to start with some literal text, that text is searched with the
+ * literal engine first and the expression only runs at those candidates.
+ *
+ * All search functions are const and reentrant, an engine can be shared
+ * between threads searching snapshots of a buffer.
+ */
+class SearchEngine
+{
+public:
+    SearchEngine() = default;
+    SearchEngine(const QString& pattern, SearchOptions options);
+
+    bool isValid() const;
+    QString errorString() const;
+    inline const QString& pattern() const { return m_original; }
+    inline SearchOptions options() const { return m_options; }
+
+    // first match starting in [from, to)
+    SearchMatch findNext(const TextBuffer& buffer, qsizetype from, qsizetype to = -1) const;
+    // last match starting before 'before'
+    SearchMatch findPrevious(const TextBuffer& buffer, qsizetype before) const;
+    // all (non-overlapping, non-empty) matches starting in [from, to)
+    QList<SearchMatch> findAll(const TextBuffer& buffer, qsizetype from = 0, qsizetype to = -1) const;
+
+    // first match in text starting in [from, to), 'before'/'after' are the chars
+    // around text (null at the ends of the document) for the whole-word checks
+    qsizetype indexIn(QStringView text, qsizetype from, qsizetype to,
+                      QChar before = QChar(), QChar after = QChar()) const;
+
+    static inline bool isWordChar(QChar ch) { return ch.isLetterOrNumber() || ch == '_'; }
+
+private:
+    inline QChar fold(QChar ch) const
+    {
+        if (m_options.caseSensitive)
+            return ch;
+        if (ch.unicode() < 128)
+            return QChar(char16_t(ch.unicode() >= 'A' && ch.unicode() <= 'Z' ? ch.unicode() + 32 : ch.unicode()));
+        return QChar(char16_t(QChar::toCaseFolded(ch.unicode())));
+    }
+    qsizetype findFirst(const QChar* text, qsizetype from, qsizetype to) const;
+    bool matchesAt(const QChar* text, qsizetype pos) const;
+    qsizetype findLiteral(const TextBuffer& buffer, qsizetype from, qsizetype to) const;
+    QList<SearchMatch> findRegex(const TextBuffer& buffer, qsizetype from, qsizetype to, qsizetype limit) const;
+
+    // regex subjects are whole lines of about this many chars
+    static constexpr qsizetype REGEX_CHUNK_SIZE = 256 * 1024;
+    // but lines are only followed this far past the chunk
+    static constexpr qsizetype MAX_LINE_SPAN = 1024 * 1024;
+
+    QString m_original;
+    QString m_pattern;  // case folded unless case sensitive
+    SearchOptions m_options;
+
+    // Horspool shifts indexed by the low byte of the (folded) char
+    quint32 m_skip[256] = {};
+
+    // the (up to two) forms of the first char the vectorized scan looks for,
+    // a scalar scan is used when folding could match other chars too
+    char16_t m_firstA = 0;
+    char16_t m_firstB = 0;
+    bool m_vectorFirst = true;
+
+    // whole words: only pattern ends that are word chars need a boundary
+    bool m_checkStart = false;
+    bool m_checkEnd = false;
+
+    QRegularExpression m_regex;
+    // literal engine for the text every regex match starts with
+    std::shared_ptr<const SearchEngine> m_prefilter;
+};
+
+#endif // SEARCHENGINE_H
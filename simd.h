@@ -0,0 +1,10 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// SSE2 is part of every x86-64 target, the scalar paths cover everything else
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define VIMMY_SSE2
+    #include <emmintrin.h>
+#endif
+
+#endif // SIMD_H
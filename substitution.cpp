@@ -0,0 +1,410 @@
+#include "substitution.h"
+#include "regexcompiler.h"
+
+// Parsing
+// --------------
+static bool isValidDelimiter(QChar ch)
+{
+    return !ch.isLetterOrNumber() && ch != '\\' && ch != '"' && ch != '|' && !ch.isSpace();
+}
+
+/**
+ * @brief text from pos up to the next unescaped delimiter (or the end), pos ends up past it
+ *
+ * An escaped delimiter stands for itself, every other escape is kept as is.
+ */
+QString Substitution::readDelimited(QStringView text, qsizetype& pos, QChar delimiter)
+{
+    QString result;
+    for (; pos < text.size(); ++pos)
+    {
+        const QChar ch = text[pos];
+        if (ch == delimiter)
+        {
+            ++pos;
+            break;
+        }
+        if (ch == '\\' && pos + 1 < text.size())
+        {
+            if (text[pos + 1] != delimiter)
+                result += ch;
+            result += text[++pos];
+            continue;
+        }
+        result += ch;
+    }
+    return result;
+}
+
+Substitution Substitution::substitute(QStringView arguments, const Substitution& previous)
+{
+    Substitution result;
+    arguments = arguments.trimmed();
+
+    // :s alone repeats the previous substitution, without its flags
+    if (arguments.isEmpty())
+    {
+        if (previous.m_pattern.isEmpty())
+        {
+            result.m_error = "E35: No previous regular expression";
+            return result;
+        }
+        result.compile(previous.m_pattern, previous.m_caseSensitive);
+        result.m_replacementText = previous.m_replacementText;
+        result.m_replacement = previous.m_replacement;
+        return result;
+    }
+
+    const QChar delimiter = arguments[0];
+    if (!isValidDelimiter(delimiter))
+    {
+        result.m_error = "E146: Regular expressions can't be delimited by letters";
+        return result;
+    }
+    qsizetype pos = 1;
+    QString pattern = readDelimited(arguments, pos, delimiter);
+    const QString replacement = readDelimited(arguments, pos, delimiter);
+    if (!result.parseFlags(arguments.mid(pos)))
+        return result;
+
+    if (pattern.isEmpty())
+        pattern = previous.m_pattern;
+    if (pattern.isEmpty())
+    {
+        result.m_error = "E35: No previous regular expression";
+        return result;
+    }
+    if (result.compile(pattern, result.m_caseSensitive))
+        result.parseReplacement(replacement, previous.m_replacementText);
+    return result;
+}
+
+Substitution Substitution::global(QStringView arguments, bool invert, const Substitution& previous)
+{
+    Substitution result;
+    arguments = arguments.trimmed();
+    if (arguments.isEmpty() || !isValidDelimiter(arguments[0]))
+    {
+        result.m_error = "E476: Invalid command: a :g pattern is delimited like :g/pattern/";
+        return result;
+    }
+
+    qsizetype pos = 1;
+    QString pattern = readDelimited(arguments, pos, arguments[0]);
+    if (pattern.isEmpty())
+        pattern = previous.m_pattern;
+    if (pattern.isEmpty())
+    {
+        result.m_error = "E35: No previous regular expression";
+        return result;
+    }
+
+    const QStringView command = arguments.mid(pos).trimmed();
+    qsizetype nameLength = 0;
+    while (nameLength < command.size() && command[nameLength].isLetter())
+        ++nameLength;
+    const QStringView name = command.first(nameLength);
+
+    if (command.isEmpty() || command == u"p" || command == u"print")
+    {
+        result.m_action = Count;
+        result.compile(pattern, true);
+    }
+    else if (command == u"d" || command == u"delete")
+    {
+        result.m_action = Delete;
+        result.compile(pattern, true);
+    }
+    else if (name == u"s" || name == u"substitute")
+    {
+        // an empty pattern of the s is the one of the :g
+        Substitution last = previous;
+        last.m_pattern = pattern;
+        result = substitute(command.sliced(nameLength), last);
+    }
+    else
+    {
+        result.m_error = "E492: Not supported by :g: " + command.toString();
+    }
+    if (!result.m_error.isEmpty())
+        return result;
+
+    result.m_isGlobal = true;
+    result.m_invert = invert;
+    result.m_filter = RegexCompiler::compile(pattern, RegexSyntax::Sed, true, false);
+    if (!result.m_filter.isValid())
+        result.m_error = "E486: Invalid pattern: " + result.m_filter.errorString();
+    // acting on the lines without a match, every line has to be looked at
+    if (invert && result.m_action != Replace)
+        result.m_prefilter.reset();
+    return result;
+}
+
+bool Substitution::compile(const QString& pattern, bool caseSensitive)
+{
+    m_pattern = pattern;
+    m_caseSensitive = caseSensitive;
+    m_regex = RegexCompiler::compile(pattern, RegexSyntax::Sed, caseSensitive, false);
+    if (!m_regex.isValid())
+    {
+        m_error = "E486: Invalid pattern: " + m_regex.errorString();
+        return false;
+    }
+
+    const QString prefix = RegexCompiler::literalPrefix(RegexCompiler::fromSed(pattern));
+    m_prefilter.reset();
+    if (!prefix.isEmpty())
+    {
+        SearchOptions literal;
+        literal.caseSensitive = caseSensitive;
+        m_prefilter = std::make_shared<SearchEngine>(prefix, literal);
+    }
+    return true;
+}
+
+bool Substitution::parseFlags(QStringView flags)
+{
+    for (QChar flag : flags)
+    {
+        switch (flag.unicode())
+        {
+            case 'g': m_everyMatch = true;     break;
+            case 'i': m_caseSensitive = false; break;
+            case 'I': m_caseSensitive = true;  break;
+            case 'n': m_countOnly = true;      break;
+            case 'e': m_ignoreNoMatch = true;  break;
+            case ' ':                          break;
+            case 'c':
+                m_error = "Confirming each substitution (c) isn't supported";
+                return false;
+            default:
+                m_error = "E488: Trailing characters: " + flags.toString();
+                return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief splits the replacement into literal text and groups (& and \0 to \9), ~ is the previous one
+ */
+void Substitution::parseReplacement(QStringView replacement, const QString& previous)
+{
+    // what a later ~ stands for, still unparsed
+    m_replacementText.clear();
+    for (qsizetype i = 0; i < replacement.size(); ++i)
+    {
+        if (replacement[i] == '\\' && i + 1 < replacement.size())
+            m_replacementText.append(replacement.mid(i++, 2));
+        else if (replacement[i] == '~')
+            m_replacementText += previous;
+        else
+            m_replacementText += replacement[i];
+    }
+
+    m_replacement.clear();
+    auto addText = [this](QChar ch) {
+        if (m_replacement.isEmpty() || m_replacement.last().group >= 0)
+            m_replacement.append(Part());
+        m_replacement.last().text += ch;
+    };
+    const QString& text = m_replacementText;
+    for (qsizetype i = 0; i < text.size(); ++i)
+    {
+        const QChar ch = text[i];
+        if (ch == '&')
+        {
+            m_replacement.append(Part{QString(), 0});
+        }
+        else if (ch == '\\' && i + 1 < text.size())
+        {
+            const QChar next = text[++i];
+            if (next >= '0' && next <= '9')
+                m_replacement.append(Part{QString(), next.unicode() - '0'});
+            else if (next == 'n' || next == 'r')
+                addText('\n');
+            else if (next == 't')
+                addText('\t');
+            else
+                addText(next);
+        }
+        else
+        {
+            addText(ch);
+        }
+    }
+}
+
+// Running
+// --------------
+/**
+ * @brief line with the matches replaced into result, false if nothing matched
+ */
+bool Substitution::replaceIn(QStringView line, QString& result, qsizetype& matches) const
+{
+    // the regex reads the line in place
+    const QString subject = QString::fromRawData(line.data(), line.size());
+    result.clear();
+    const qsizetype before = matches;
+    qsizetype copied = 0;
+    auto replace = [&](const QRegularExpressionMatch& match) {
+        ++matches;
+        result.append(line.mid(copied, match.capturedStart() - copied));
+        for (const Part& part : m_replacement)
+        {
+            if (part.group < 0)
+                result.append(part.text);
+            else
+                result.append(match.capturedView(part.group));
+        }
+        copied = match.capturedEnd();
+    };
+
+    if (m_everyMatch)
+    {
+        QRegularExpressionMatchIterator it = m_regex.globalMatch(subject);
+        while (it.hasNext())
+            replace(it.next());
+    }
+    else
+    {
+        const QRegularExpressionMatch match = m_regex.match(subject);
+        if (match.hasMatch())
+            replace(match);
+    }
+
+    if (matches == before)
+        return false;
+    result.append(line.mid(copied));
+    return true;
+}
+
+/**
+ * @brief runs over lines [firstLine, lastLine], returning the runs of lines it changed
+ */
+Substitution::Result Substitution::run(const TextBuffer& buffer, qsizetype firstLine, qsizetype lastLine) const
+{
+    Result result;
+    if (!isValid())
+        return result;
+
+    const qsizetype lineCount = buffer.lineCount();
+    lastLine = qMin(lastLine, lineCount - 1);
+    const bool toLastLine = lastLine == lineCount - 1;
+    // the lines with their line breaks
+    const qsizetype start = buffer.lineStart(firstLine);
+    const qsizetype end = toLastLine ? buffer.length() : buffer.lineStart(lastLine + 1);
+    const QString subject = buffer.text(start, end - start);
+    const QStringView view(subject);
+    const qsizetype size = subject.size();
+
+    // the run of lines being rebuilt: [runStart, runEnd) of subject becomes text
+    qsizetype runStart = -1;
+    qsizetype runEnd = -1;
+    QString text;
+    qsizetype lastChanged = 0;
+    auto closeRun = [&]() {
+        if (runStart < 0)
+            return;
+        result.changes.append(Change{start + runStart, runEnd - runStart, std::move(text), lastChanged});
+        text = QString();
+        runStart = -1;
+    };
+    // starts a run at lineStart, or extends the open one up to it if it's close
+    auto extendRun = [&](qsizetype lineStart) {
+        if (runStart >= 0 && lineStart - runEnd <= MERGE_GAP)
+        {
+            text.append(view.mid(runEnd, lineStart - runEnd));
+            return;
+        }
+        closeRun();
+        runStart = lineStart;
+    };
+
+    QString replaced;
+    qsizetype lineStart = 0;
+    // the last line may be empty, starting right at the end
+    while (lineStart < size || (toLastLine && lineStart == size))
+    {
+        if (m_prefilter)
+        {
+            // straight to the line of the next candidate
+            const qsizetype candidate = m_prefilter->indexIn(view, lineStart, size);
+            if (candidate < 0)
+                break;
+            if (candidate > lineStart)
+                lineStart = subject.lastIndexOf(QChar('\n'), candidate - 1) + 1;
+        }
+
+        qsizetype lineEnd = subject.indexOf(QChar('\n'), lineStart);
+        const bool hasBreak = lineEnd >= 0;
+        if (!hasBreak)
+            lineEnd = size;
+        const QStringView line = view.mid(lineStart, lineEnd - lineStart);
+
+        bool selected = true;
+        if (m_isGlobal)
+            selected = m_filter.match(QString::fromRawData(line.data(), line.size())).hasMatch() != m_invert;
+
+        if (selected)
+        {
+            switch (m_action)
+            {
+                case Count:
+                    ++result.lines;
+                    break;
+
+                case Delete:
+                    ++result.lines;
+                    ++result.deletedLines;
+                    extendRun(lineStart);
+                    lastChanged = text.size();
+                    runEnd = hasBreak ? lineEnd + 1 : lineEnd;
+                    // there's no line break after the last line, the one before it goes instead
+                    result.deletedLastLine = !hasBreak;
+                    break;
+
+                case Replace:
+                {
+                    qsizetype matches = 0;
+                    if (!replaceIn(line, replaced, matches))
+                        break;
+                    result.matches += matches;
+                    ++result.lines;
+                    if (m_countOnly)
+                        break;
+                    extendRun(lineStart);
+                    lastChanged = text.size();
+                    text.append(replaced);
+                    runEnd = lineEnd;
+                    break;
+                }
+            }
+        }
+
+        if (!hasBreak)
+            break;
+        lineStart = lineEnd + 1;
+    }
+    closeRun();
+    return result;
+}
+
+QString Substitution::summary(const Result& result) const
+{
+    if (result.lines == 0)
+        return m_ignoreNoMatch ? QString() : "E486: Pattern not found: " + m_pattern;
+
+    switch (m_action)
+    {
+        case Count:
+            return QString("%1 matching lines").arg(result.lines);
+        case Delete:
+            return QString("%1 fewer lines").arg(result.deletedLines);
+        case Replace:
+            break;
+    }
+    return QString(m_countOnly ? "%1 matches on %2 lines" : "%1 substitutions on %2 lines")
+           .arg(result.matches)
+           .arg(result.lines);
+}
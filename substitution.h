@@ -0,0 +1,106 @@
+#ifndef SUBSTITUTION_H
+#define SUBSTITUTION_H
+
+#include "textbuffer.h"
+#include "searchengine.h"
+#include <QString>
+#include <QStringView>
+#include <QList>
+#include <QRegularExpression>
+#include <memory>
+
+/**
+ * @brief :s/pattern/replacement/flags and :g/pattern/command over lines of a TextBuffer
+ *
+ * Patterns use sed syntax (like the search dialog's sed option) and match
+ * within a line. The replacement may hold & and \0 to \9 for the match and
+ * its groups, ~ for the previous replacement and \r or \n for a line break.
+ * Flags: g (every match of a line), i / I (ignore / match case), n (only
+ * count the matches), e (no error if nothing matched).
+ * :g and :g! (:v) run d or s on the lines that (don't) match, or only count
+ * them without a command.
+ *
+ * run() is const and reentrant, so the lines can be split between threads.
+ * It returns the changed lines as runs of whole lines, rebuilt with bulk
+ * appends; lines between changes closer than MERGE_GAP chars join the same
+ * run, so a substitution hitting every line is one edit per chunk rather
+ * than one per line. Lines without a match of the pattern's literal prefix
+ * are skipped by the vectorized literal search without running the regex.
+ */
+class Substitution
+{
+public:
+    // [position, position + length) is replaced with text
+    struct Change
+    {
+        qsizetype position = 0;
+        qsizetype length = 0;
+        QString text;
+        qsizetype lastLine = 0; // offset in text of the last line changed
+    };
+
+    struct Result
+    {
+        QList<Change> changes;
+        qsizetype matches = 0;          // substitutions made (or counted)
+        qsizetype lines = 0;            // lines matched
+        qsizetype deletedLines = 0;
+        bool deletedLastLine = false;   // the line break before it has to go too
+    };
+
+    Substitution() = default;
+    // :s arguments, the previous substitution fills in an empty pattern and ~
+    static Substitution substitute(QStringView arguments, const Substitution& previous);
+    // :g arguments, invert for :g! and :v
+    static Substitution global(QStringView arguments, bool invert, const Substitution& previous);
+
+    inline bool isValid() const { return m_error.isEmpty() && !m_pattern.isEmpty(); }
+    inline const QString& errorString() const { return m_error; }
+    inline const QString& pattern() const { return m_pattern; }
+    inline bool isCountOnly() const { return m_action == Count || m_countOnly; }
+
+    Result run(const TextBuffer& buffer, qsizetype firstLine, qsizetype lastLine) const;
+    // what to tell the user about a result: counts, or that nothing matched
+    QString summary(const Result& result) const;
+
+    static constexpr qsizetype MERGE_GAP = 4096;
+
+private:
+    enum Action {Replace = 0, Delete, Count};
+
+    // a piece of the replacement: literal text, or the text of a group
+    struct Part
+    {
+        QString text;
+        int group = -1;
+    };
+
+    bool compile(const QString& pattern, bool caseSensitive);
+    bool parseFlags(QStringView flags);
+    void parseReplacement(QStringView replacement, const QString& previous);
+    bool replaceIn(QStringView line, QString& result, qsizetype& matches) const;
+
+    static QString readDelimited(QStringView text, qsizetype& pos, QChar delimiter);
+
+    Action m_action = Replace;
+    QString m_pattern;
+    QRegularExpression m_regex;
+    // literal text every match starts with, lines without it are skipped
+    std::shared_ptr<const SearchEngine> m_prefilter;
+
+    // :g: the lines to act on match m_filter (or don't, inverted)
+    bool m_isGlobal = false;
+    bool m_invert = false;
+    QRegularExpression m_filter;
+
+    QString m_replacementText;
+    QList<Part> m_replacement;
+    bool m_everyMatch = false;
+    bool m_caseSensitive = true;
+    bool m_countOnly = false;
+    bool m_ignoreNoMatch = false;
+
+    QString m_error;
+};
+
+#endif // SUBSTITUTION_H
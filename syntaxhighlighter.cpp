@@ -0,0 +1,256 @@
+#include "syntaxhighlighter.h"
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// the line's end state has to be computed again
+static constexpr quint8 DIRTY = 0x80;
+static constexpr quint8 STATE_MASK = 0x7f;
+
+/**
+ * @brief per line start states, only ever touched by the (single) worker
+ *
+ * Lines before dirtyFrom are clean: each one ends in the state stored for
+ * the line after it.
+ */
+struct SyntaxHighlighter::Model
+{
+    std::vector<quint8> states;
+    qsizetype dirtyFrom = 0;
+
+    void reset(qsizetype lineCount)
+    {
+        states.assign(size_t(lineCount), quint8(SyntaxTokenizer::Normal | DIRTY));
+        dirtyFrom = 0;
+    }
+
+    void splice(const Splice& splice)
+    {
+        const qsizetype line = qBound(qsizetype(0), splice.line, qsizetype(states.size()) - 1);
+        if (line < 0)
+            return;
+        auto first = states.begin() + line + 1;
+        const qsizetype removed = qMin(splice.removed, qsizetype(states.end() - first));
+        first = states.erase(first, first + removed);
+        states.insert(first, size_t(splice.added), quint8(SyntaxTokenizer::Normal | DIRTY));
+        states[line] |= DIRTY;
+        dirtyFrom = qMin(dirtyFrom, line);
+    }
+};
+
+struct SyntaxHighlighter::Job
+{
+    SyntaxHighlighter* owner = nullptr;
+    std::shared_ptr<Model> model;
+    TextBuffer text;
+    SyntaxTokenizer::Language language = SyntaxTokenizer::PlainText;
+    bool reset = false;
+    QList<Splice> splices;
+
+    quint64 revision = 0;
+    qsizetype firstLine = 0;
+    qsizetype lastLine = 0;
+    std::atomic<bool> cancelled{false};
+};
+
+/**
+ * @brief reads consecutive lines, viewing the buffer's pieces in place unless a line spans several
+ */
+class LineReader
+{
+public:
+    LineReader(const TextBuffer& text, qsizetype line)
+        : m_text(text)
+        , m_position(text.lineStart(line))
+        , m_length(text.length())
+    {
+    }
+
+    QStringView next()
+    {
+        m_line.clear();
+        bool joined = false;
+        while (m_position < m_length)
+        {
+            if (m_position < m_span.start || m_position >= m_span.start + m_span.text.size())
+                m_span = m_text.spanAt(m_position);
+
+            const QStringView rest = m_span.text.mid(m_position - m_span.start);
+            const qsizetype feed = rest.indexOf(QChar('\n'));
+            const QStringView part = feed < 0 ? rest : rest.left(feed);
+            m_position += part.size();
+            if (feed >= 0)
+            {
+                ++m_position;
+                if (!joined)
+                    return part;
+                m_line.append(part);
+                return m_line;
+            }
+            m_line.append(part);
+            joined = true;
+        }
+        return m_line;
+    }
+
+private:
+    const TextBuffer& m_text;
+    TextBuffer::Span m_span;
+    qsizetype m_position = 0;
+    qsizetype m_length = 0;
+    QString m_line;     // a line split over pieces
+};
+
+SyntaxHighlighter::SyntaxHighlighter(QObject* parent)
+    : QObject(parent)
+    , m_model(std::make_shared<Model>())
+{
+    // one worker, so jobs see the model one after the other
+    m_pool.setMaxThreadCount(1);
+}
+
+SyntaxHighlighter::~SyntaxHighlighter()
+{
+    cancel();
+    m_pool.waitForDone();
+}
+
+void SyntaxHighlighter::setLanguage(SyntaxTokenizer::Language language)
+{
+    if (language == m_language)
+        return;
+    m_language = language;
+    reset();
+}
+
+/**
+ * @brief forgets every line state, the next update tokenizes the text from scratch
+ */
+void SyntaxHighlighter::reset()
+{
+    m_reset = true;
+    m_splices.clear();
+}
+
+void SyntaxHighlighter::linesChanged(qsizetype line, qsizetype removedLines, qsizetype addedLines)
+{
+    // a reset covers the change
+    if (!m_reset)
+        m_splices.append(Splice{line, removedLines, addedLines});
+}
+
+/**
+ * @brief tokenizes text (up to date with every change reported) and reports the lines in view
+ */
+void SyntaxHighlighter::update(const TextBuffer& text, quint64 revision, qsizetype firstLine, qsizetype lastLine)
+{
+    cancel();
+
+    auto job = std::make_shared<Job>();
+    job->owner = this;
+    job->model = m_model;
+    job->text = text;
+    job->language = m_language;
+    job->reset = m_reset;
+    job->splices = std::move(m_splices);
+    job->revision = revision;
+    job->firstLine = qMax(qsizetype(0), firstLine);
+    job->lastLine = qMin(lastLine, text.lineCount() - 1);
+    m_splices = QList<Splice>();
+    m_reset = false;
+    m_job = job;
+
+    m_pool.start([job] { run(job); });
+}
+
+void SyntaxHighlighter::cancel()
+{
+    if (m_job)
+        m_job->cancelled = true;
+    m_job.reset();
+}
+
+void SyntaxHighlighter::run(const std::shared_ptr<Job>& job)
+{
+    // the changes are applied even by a cancelled job, the next one builds on them
+    Model& model = *job->model;
+    const qsizetype lineCount = job->text.lineCount();
+    if (job->reset)
+        model.reset(lineCount);
+    for (const Splice& splice : job->splices)
+        model.splice(splice);
+    if (qsizetype(model.states.size()) != lineCount)
+        model.reset(lineCount);
+
+    if (job->cancelled)
+        return;
+
+    QList<Spans> lines;
+    if (job->language == SyntaxTokenizer::PlainText)
+    {
+        if (job->firstLine <= job->lastLine)
+            lines.resize(job->lastLine - job->firstLine + 1);
+        job->owner->deliver(job, lines);
+        return;
+    }
+
+    // brings the states of the lines before 'end' up to date, false if cancelled
+    auto catchUp = [&job, &model, lineCount](qsizetype end) {
+        auto isDirty = [](quint8 state) { return (state & DIRTY) != 0; };
+        end = qMin(end, lineCount);
+        qsizetype line = model.dirtyFrom;
+        while (line < end)
+        {
+            // a run of dirty lines, it ends where a state comes out as it was before
+            LineReader reader(job->text, line);
+            for (; line < end && isDirty(model.states[size_t(line)]); ++line)
+            {
+                if ((line & 0xff) == 0 && job->cancelled)
+                {
+                    model.dirtyFrom = line;
+                    return false;
+                }
+
+                quint8& state = model.states[size_t(line)];
+                state &= STATE_MASK;
+                const quint8 next = SyntaxTokenizer::tokenize(job->language, reader.next(), SyntaxTokenizer::State(state));
+                if (line + 1 < lineCount && (model.states[size_t(line) + 1] & STATE_MASK) != next)
+                    model.states[size_t(line) + 1] = next | DIRTY;
+            }
+
+            // skip to the next line an edit marked
+            line = qsizetype(std::find_if(model.states.begin() + line, model.states.end(), isDirty) - model.states.begin());
+            model.dirtyFrom = line;
+        }
+        return true;
+    };
+
+    // the lines in view first
+    if (!catchUp(job->lastLine + 1))
+        return;
+
+    LineReader reader(job->text, job->firstLine);
+    for (qsizetype line = job->firstLine; line <= job->lastLine; ++line)
+    {
+        Spans spans;
+        SyntaxTokenizer::tokenize(job->language, reader.next(),
+                                  SyntaxTokenizer::State(model.states[size_t(line)] & STATE_MASK), &spans);
+        lines.append(std::move(spans));
+    }
+    job->owner->deliver(job, lines);
+
+    // then the rest of the file, so scrolling finds the states ready
+    catchUp(lineCount);
+}
+
+/**
+ * @brief passes the tokens to the thread of this object, dropping those of cancelled jobs
+ */
+void SyntaxHighlighter::deliver(const std::shared_ptr<Job>& job, const QList<Spans>& lines)
+{
+    QMetaObject::invokeMethod(this, [this, job, lines] {
+        if (job != m_job)
+            return;
+        emit highlighted(job->revision, job->firstLine, lines);
+    }, Qt::QueuedConnection);
+}
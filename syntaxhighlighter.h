@@ -0,0 +1,67 @@
+#ifndef SYNTAXHIGHLIGHTER_H
+#define SYNTAXHIGHLIGHTER_H
+
+#include "textbuffer.h"
+#include "syntaxtokenizer.h"
+#include <QObject>
+#include <QList>
+#include <QThreadPool>
+#include <memory>
+
+/**
+ * @brief tokenizes a buffer in the background, visible lines first
+ *
+ * The state every line starts in is kept between runs. An edit only marks
+ * the lines it replaced, and a run re-tokenizes from the first marked line
+ * just until the states it computes match the stored ones again, so typing
+ * costs a line or two however big the file is. The lines in view are
+ * tokenized (and reported) as soon as the states before them are known,
+ * the rest of the file is caught up with afterwards.
+ * Starting another update cancels the running one, keeping its progress.
+ */
+class SyntaxHighlighter : public QObject
+{
+    Q_OBJECT
+
+public:
+    using Spans = QList<SyntaxTokenizer::Span>;
+
+    explicit SyntaxHighlighter(QObject* parent = nullptr);
+    ~SyntaxHighlighter();
+
+    void setLanguage(SyntaxTokenizer::Language language);
+    inline SyntaxTokenizer::Language language() const { return m_language; }
+
+    void reset();
+    void linesChanged(qsizetype line, qsizetype removedLines, qsizetype addedLines);
+    void update(const TextBuffer& text, quint64 revision, qsizetype firstLine, qsizetype lastLine);
+    void cancel();
+
+signals:
+    // the tokens of the lines from firstLine on, as of revision
+    void highlighted(quint64 revision, qsizetype firstLine, const QList<SyntaxHighlighter::Spans>& lines);
+
+private:
+    // lines [line, line + removed] became [line, line + added]
+    struct Splice
+    {
+        qsizetype line = 0;
+        qsizetype removed = 0;
+        qsizetype added = 0;
+    };
+    struct Model;
+    struct Job;
+    static void run(const std::shared_ptr<Job>& job);
+    void deliver(const std::shared_ptr<Job>& job, const QList<Spans>& lines);
+
+    QThreadPool m_pool;
+    std::shared_ptr<Model> m_model;
+    std::shared_ptr<Job> m_job;
+
+    // changes not handed to a job yet
+    QList<Splice> m_splices;
+    bool m_reset = true;
+    SyntaxTokenizer::Language m_language = SyntaxTokenizer::PlainText;
+};
+
+#endif // SYNTAXHIGHLIGHTER_H
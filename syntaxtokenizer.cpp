@@ -0,0 +1,151 @@
+#include "syntaxtokenizer.h"
+#include <QFileInfo>
+#include <QStringList>
+#include <algorithm>
+#include <array>
+#include <string_view>
+
+// Keywords
+// --------------
+// common to C, C++, C#, Java, JavaScript, Go and Rust, sorted for binary search
+static constexpr std::array<std::u16string_view, 78> keywords = {
+    u"abstract", u"auto", u"bool", u"break", u"case", u"catch", u"char", u"class",
+    u"const", u"constexpr", u"continue", u"default", u"delete", u"do", u"double", u"else",
+    u"enum", u"explicit", u"export", u"extends", u"extern", u"false", u"final", u"float",
+    u"fn", u"for", u"func", u"function", u"go", u"goto", u"if", u"impl",
+    u"implements", u"import", u"inline", u"int", u"interface", u"let", u"long", u"match",
+    u"mod", u"mut", u"namespace", u"new", u"noexcept", u"null", u"nullptr", u"operator",
+    u"override", u"package", u"private", u"protected", u"pub", u"public", u"return", u"self",
+    u"short", u"signed", u"sizeof", u"static", u"struct", u"super", u"switch", u"template",
+    u"this", u"throw", u"true", u"try", u"typedef", u"typename", u"union", u"unsigned",
+    u"use", u"using", u"var", u"virtual", u"void", u"while",
+};
+
+static constexpr bool isSorted()
+{
+    for (size_t i = 1; i < keywords.size(); ++i)
+        if (!(keywords[i - 1] < keywords[i]))
+            return false;
+    return true;
+}
+static_assert(isSorted(), "keywords must stay sorted");
+
+bool SyntaxTokenizer::isKeyword(QStringView word)
+{
+    const std::u16string_view key(word.utf16(), size_t(word.size()));
+    return std::binary_search(keywords.begin(), keywords.end(), key);
+}
+// --------------
+
+static inline bool isIdentifierStart(QChar ch)
+{
+    return ch.isLetter() || ch == '_';
+}
+
+static inline bool isIdentifierPart(QChar ch)
+{
+    return ch.isLetterOrNumber() || ch == '_';
+}
+
+SyntaxTokenizer::State SyntaxTokenizer::tokenize(Language language, QStringView line, State state, QList<Span>* spans)
+{
+    if (language == PlainText)
+        return Normal;
+
+    const qsizetype length = line.size();
+    auto add = [spans](qsizetype start, qsizetype end, Token token) {
+        if (spans && end > start)
+            spans->append(Span{qint32(start), qint32(end - start), token});
+    };
+
+    qsizetype i = 0;
+    if (state == BlockComment)
+    {
+        const qsizetype end = line.indexOf(u"*/");
+        if (end < 0)
+        {
+            add(0, length, Comment);
+            return BlockComment;
+        }
+        add(0, end + 2, Comment);
+        i = end + 2;
+    }
+    else
+    {
+        // # directives take the whole line
+        qsizetype first = 0;
+        while (first < length && (line[first] == ' ' || line[first] == '\t'))
+            ++first;
+        if (first < length && line[first] == '#')
+        {
+            add(first, length, Preprocessor);
+            return Normal;
+        }
+    }
+
+    while (i < length)
+    {
+        const QChar ch = line[i];
+        const QChar next = i + 1 < length ? line[i + 1] : QChar();
+
+        if (ch == '/' && next == '/')
+        {
+            add(i, length, Comment);
+            return Normal;
+        }
+        if (ch == '/' && next == '*')
+        {
+            const qsizetype end = line.indexOf(u"*/", i + 2);
+            if (end < 0)
+            {
+                add(i, length, Comment);
+                return BlockComment;
+            }
+            add(i, end + 2, Comment);
+            i = end + 2;
+            continue;
+        }
+        if (ch == '"' || ch == '\'')
+        {
+            // up to the closing quote, skipping escaped chars
+            qsizetype end = i + 1;
+            while (end < length && line[end] != ch)
+                end += line[end] == '\\' ? 2 : 1;
+            end = qMin(end + 1, length);
+            add(i, end, String);
+            i = end;
+            continue;
+        }
+        if (ch.isDigit())
+        {
+            qsizetype end = i + 1;
+            while (end < length && (isIdentifierPart(line[end]) || line[end] == '.'))
+                ++end;
+            add(i, end, Number);
+            i = end;
+            continue;
+        }
+        if (isIdentifierStart(ch))
+        {
+            qsizetype end = i + 1;
+            while (end < length && isIdentifierPart(line[end]))
+                ++end;
+            // only looked up when the tokens are wanted
+            if (spans && isKeyword(line.mid(i, end - i)))
+                add(i, end, Keyword);
+            i = end;
+            continue;
+        }
+        ++i;
+    }
+    return Normal;
+}
+
+SyntaxTokenizer::Language SyntaxTokenizer::languageOf(const QString& filename)
+{
+    static const QStringList extensions = {
+        "c", "h", "cc", "cpp", "cxx", "hh", "hpp", "hxx", "cs", "java", "js", "jsx",
+        "ts", "tsx", "go", "rs", "kt", "swift", "scala", "dart", "m", "mm",
+    };
+    return extensions.contains(QFileInfo(filename).suffix().toLower()) ? CLike : PlainText;
+}
@@ -0,0 +1,39 @@
+#ifndef SYNTAXTOKENIZER_H
+#define SYNTAXTOKENIZER_H
+
+#include <QList>
+#include <QString>
+#include <QStringView>
+
+/**
+ * @brief line by line tokenizer for syntax highlighting
+ *
+ * A line is tokenized from the state the previous line ended in (inside a
+ * block comment or not), so a line only has to be looked at again when its
+ * own text or its start state changes.
+ */
+class SyntaxTokenizer
+{
+public:
+    enum Language : quint8 {PlainText = 0, CLike};
+    enum Token : quint8 {Plain = 0, Keyword, Number, String, Comment, Preprocessor};
+    // the state a line starts in
+    enum State : quint8 {Normal = 0, BlockComment};
+
+    struct Span
+    {
+        qint32 start = 0;
+        qint32 length = 0;
+        Token token = Plain;
+    };
+
+    // the state the next line starts in; spans (if given) receive the tokens
+    static State tokenize(Language language, QStringView line, State state, QList<Span>* spans = nullptr);
+    // by the file extension
+    static Language languageOf(const QString& filename);
+
+private:
+    static bool isKeyword(QStringView word);
+};
+
+#endif // SYNTAXTOKENIZER_H
@@ -0,0 +1,554 @@
+#include "textbuffer.h"
+#include <algorithm>
+#include <limits>
+#include <unordered_set>
+#include <vector>
+
+// insertions are copied into add chunks of at most this many chars,
+// longer texts get a chunk of their own
+static constexpr qsizetype MaxAddChunkSize = 64 * 1024;
+static constexpr qsizetype MinAddChunkSize = 512;
+
+struct TextBuffer::Chunk
+{
+    // never modified once a piece refers to it
+    // (add chunks are only written past their used part)
+    QString text;                // original text, shared with the string it came from
+    std::vector<char16_t> added; // or an add chunk: a fixed block, never resized so it never moves
+    const QChar* data = nullptr; // the chars of whichever one holds them
+    qsizetype size = 0;
+    // offsets of the line feeds in text, only built for chunks that are
+    // complete when created, add chunks are counted piece by piece instead
+    std::vector<quint32> lineFeeds;
+    bool indexed = false;
+};
+
+struct TextBuffer::Piece
+{
+    std::shared_ptr<const Chunk> chunk;
+    qsizetype start = 0;
+    qsizetype length = 0;
+    qsizetype lineFeeds = 0;
+};
+
+struct TextBuffer::Node
+{
+    Piece piece;
+    NodePtr left;
+    NodePtr right;
+    quint32 priority = 0;
+    qsizetype length = 0;    // length of the whole subtree
+    qsizetype lineFeeds = 0; // line feeds in the whole subtree
+};
+
+// owned by one buffer only: copies don't get it, so nothing else ever writes to its chunk
+struct TextBuffer::AddBuffer
+{
+    std::shared_ptr<Chunk> chunk;
+    qsizetype used = 0;
+};
+
+static quint32 randomPriority()
+{
+    // xorshift32, one state per thread so buffers can be built anywhere
+    thread_local quint32 state = 0x9e3779b9u;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+TextBuffer::TextBuffer() = default;
+
+TextBuffer::TextBuffer(const QString& text)
+{
+    if (!text.isEmpty())
+        m_root = makeLeaf(chunkPiece(text));
+}
+
+TextBuffer::TextBuffer(const TextBuffer& other)
+    : m_root(other.m_root)
+{
+}
+
+TextBuffer& TextBuffer::operator=(const TextBuffer& other)
+{
+    m_root = other.m_root;
+    m_add.reset();
+    return *this;
+}
+
+qsizetype TextBuffer::length() const
+{
+    return m_root ? m_root->length : 0;
+}
+
+QChar TextBuffer::at(qsizetype pos) const
+{
+    const Node* node = m_root.get();
+    while (node)
+    {
+        qsizetype leftLength = node->left ? node->left->length : 0;
+        if (pos < leftLength)
+        {
+            node = node->left.get();
+            continue;
+        }
+        pos -= leftLength;
+        if (pos < node->piece.length)
+            return node->piece.chunk->data[node->piece.start + pos];
+        pos -= node->piece.length;
+        node = node->right.get();
+    }
+    return QChar();
+}
+
+/**
+ * @brief the piece containing pos
+ * 
+ * @return Span whose text is the whole piece, empty if pos is out of range
+ */
+TextBuffer::Span TextBuffer::spanAt(qsizetype pos) const
+{
+    if (pos < 0)
+        return Span();
+
+    const Node* node = m_root.get();
+    qsizetype base = 0;
+    while (node)
+    {
+        qsizetype leftLength = node->left ? node->left->length : 0;
+        if (pos < base + leftLength)
+        {
+            node = node->left.get();
+            continue;
+        }
+        base += leftLength;
+        if (pos < base + node->piece.length)
+        {
+            const Piece& piece = node->piece;
+            return Span{QStringView(piece.chunk->data + piece.start, piece.length), base};
+        }
+        base += node->piece.length;
+        node = node->right.get();
+    }
+    return Span{QStringView(), length()};
+}
+
+QString TextBuffer::text(qsizetype pos, qsizetype len) const
+{
+    pos = qBound(qsizetype(0), pos, length());
+    qsizetype end = (len < 0) ? length() : qMin(length(), pos + len);
+
+    QString result;
+    result.reserve(end - pos);
+    while (pos < end)
+    {
+        Span span = spanAt(pos);
+        QStringView view = span.text.mid(pos - span.start, qMin(span.start + span.text.size(), end) - pos);
+        result.append(view);
+        pos += view.size();
+    }
+    return result;
+}
+
+QString TextBuffer::toString() const
+{
+    return text(0, length());
+}
+
+/**
+ * @brief slice of the text sharing the same chunks (nothing is copied)
+ */
+TextBuffer TextBuffer::mid(qsizetype pos, qsizetype len) const
+{
+    pos = qBound(qsizetype(0), pos, length());
+    if (len < 0 || pos + len > length())
+        len = length() - pos;
+
+    TextBuffer slice;
+    slice.m_root = split(split(m_root, pos).second, len).first;
+    return slice;
+}
+
+qsizetype TextBuffer::lineCount() const
+{
+    return lineFeedsOf(m_root) + 1;
+}
+
+/**
+ * @brief line containing pos (the number of line feeds before it)
+ */
+qsizetype TextBuffer::lineAt(qsizetype pos) const
+{
+    pos = qBound(qsizetype(0), pos, length());
+
+    const Node* node = m_root.get();
+    qsizetype line = 0;
+    while (node)
+    {
+        qsizetype leftLength = lengthOf(node->left);
+        if (pos < leftLength)
+        {
+            node = node->left.get();
+            continue;
+        }
+        pos -= leftLength;
+        line += lineFeedsOf(node->left);
+        if (pos < node->piece.length)
+            return line + countLineFeeds(node->piece, 0, pos);
+        pos -= node->piece.length;
+        line += node->piece.lineFeeds;
+        node = node->right.get();
+    }
+    return line;
+}
+
+/**
+ * @brief position of the first char of line (clamped to the existing lines)
+ */
+qsizetype TextBuffer::lineStart(qsizetype line) const
+{
+    // the line starts right after its n-th line feed
+    qsizetype n = qBound(qsizetype(0), line, lineFeedsOf(m_root));
+    if (n == 0)
+        return 0;
+
+    const Node* node = m_root.get();
+    qsizetype base = 0;
+    while (node)
+    {
+        qsizetype leftLineFeeds = lineFeedsOf(node->left);
+        if (n <= leftLineFeeds)
+        {
+            node = node->left.get();
+            continue;
+        }
+        n -= leftLineFeeds;
+        base += lengthOf(node->left);
+        if (n <= node->piece.lineFeeds)
+            return base + findLineFeed(node->piece, n - 1) + 1;
+        n -= node->piece.lineFeeds;
+        base += node->piece.length;
+        node = node->right.get();
+    }
+    return length();
+}
+
+/**
+ * @brief position of the line feed ending line (the buffer length for the last line)
+ */
+qsizetype TextBuffer::lineEnd(qsizetype line) const
+{
+    if (line + 1 >= lineCount())
+        return length();
+    return lineStart(line + 1) - 1;
+}
+
+void TextBuffer::insert(qsizetype pos, QStringView text)
+{
+    if (text.isEmpty())
+        return;
+    if (text.size() > MaxAddChunkSize / 4)
+        insertPiece(pos, chunkPiece(text.toString()));
+    else
+        insertPiece(pos, addPiece(text));
+}
+
+void TextBuffer::insert(qsizetype pos, const QString& text)
+{
+    // long strings are shared instead of copied
+    if (text.size() > MaxAddChunkSize / 4)
+        insertPiece(pos, chunkPiece(text));
+    else
+        insert(pos, QStringView(text));
+}
+
+void TextBuffer::insert(qsizetype pos, const TextBuffer& text)
+{
+    if (text.isEmpty())
+        return;
+    pos = qBound(qsizetype(0), pos, length());
+
+    auto [left, right] = split(m_root, pos);
+    m_root = merge(merge(left, text.m_root), right);
+}
+
+void TextBuffer::remove(qsizetype pos, qsizetype len)
+{
+    pos = qBound(qsizetype(0), pos, length());
+    len = qMin(len, length() - pos);
+    if (len <= 0)
+        return;
+
+    auto [left, rest] = split(m_root, pos);
+    m_root = merge(left, split(rest, len).second);
+}
+
+void TextBuffer::replace(qsizetype pos, qsizetype len, QStringView text)
+{
+    remove(pos, len);
+    insert(pos, text);
+}
+
+void TextBuffer::append(const QString& text)
+{
+    if (!text.isEmpty())
+        insertPiece(length(), chunkPiece(text));
+}
+
+void TextBuffer::clear()
+{
+    m_root.reset();
+}
+
+/**
+ * @brief bytes of the chunks texts refer to and except doesn't
+ *
+ * Snapshots and slices share nodes and chunks, so what a set of them costs
+ * is the chunks nothing else holds: the subtrees they share with except
+ * are skipped without being walked. O(nodes of all of them).
+ */
+qsizetype TextBuffer::chunkBytes(const std::vector<const TextBuffer*>& texts, const TextBuffer& except)
+{
+    std::unordered_set<const Node*> exceptNodes;
+    std::unordered_set<const Chunk*> chunks;
+    std::vector<const Node*> stack;
+    if (except.m_root)
+        stack.push_back(except.m_root.get());
+    while (!stack.empty())
+    {
+        const Node* node = stack.back();
+        stack.pop_back();
+        if (!exceptNodes.insert(node).second)
+            continue;
+        chunks.insert(node->piece.chunk.get());
+        if (node->left)
+            stack.push_back(node->left.get());
+        if (node->right)
+            stack.push_back(node->right.get());
+    }
+
+    qsizetype bytes = 0;
+    std::unordered_set<const Node*> seen;
+    for (const TextBuffer* text : texts)
+    {
+        if (text->m_root)
+            stack.push_back(text->m_root.get());
+        while (!stack.empty())
+        {
+            const Node* node = stack.back();
+            stack.pop_back();
+            if (exceptNodes.count(node) || !seen.insert(node).second)
+                continue;
+            const Chunk* chunk = node->piece.chunk.get();
+            if (chunks.insert(chunk).second)
+                bytes += chunk->size * qsizetype(sizeof(QChar));
+            if (node->left)
+                stack.push_back(node->left.get());
+            if (node->right)
+                stack.push_back(node->right.get());
+        }
+    }
+    return bytes;
+}
+
+// Pieces
+// --------------
+TextBuffer::Piece TextBuffer::chunkPiece(const QString& text)
+{
+    auto chunk = std::make_shared<Chunk>();
+    chunk->text = text;
+    chunk->data = chunk->text.constData();
+    chunk->size = text.size();
+
+    // offsets are 32 bit, a (hardly ever seen) bigger chunk is scanned instead
+    chunk->indexed = text.size() <= qsizetype(std::numeric_limits<quint32>::max());
+    if (chunk->indexed)
+    {
+        const QChar* data = text.constData();
+        for (qsizetype i = 0; i < text.size(); ++i)
+            if (data[i] == '\n')
+                chunk->lineFeeds.push_back(quint32(i));
+    }
+
+    Piece piece{chunk, 0, text.size()};
+    piece.lineFeeds = countLineFeeds(piece, 0, piece.length);
+    return piece;
+}
+
+TextBuffer::Piece TextBuffer::addPiece(QStringView text)
+{
+    if (!m_add)
+        m_add = std::make_shared<AddBuffer>();
+    // pieces of snapshots end at used, writing past it would still be safe, but
+    // a second writer would hand out the same chars twice
+    Q_ASSERT(m_add.use_count() == 1);
+
+    qsizetype capacity = m_add->chunk ? m_add->chunk->size : 0;
+    if (m_add->used + text.size() > capacity)
+    {
+        // start a new chunk, growing up to MaxAddChunkSize
+        capacity = qMax(text.size(), qBound(MinAddChunkSize, capacity * 2, MaxAddChunkSize));
+        m_add->chunk = std::make_shared<Chunk>();
+        m_add->chunk->added.resize(size_t(capacity));
+        m_add->chunk->data = reinterpret_cast<const QChar*>(m_add->chunk->added.data());
+        m_add->chunk->size = capacity;
+        m_add->used = 0;
+    }
+
+    std::copy(text.utf16(), text.utf16() + text.size(), m_add->chunk->added.data() + m_add->used);
+    Piece piece{m_add->chunk, m_add->used, text.size()};
+    piece.lineFeeds = countLineFeeds(piece, 0, piece.length);
+    m_add->used += text.size();
+    return piece;
+}
+
+void TextBuffer::insertPiece(qsizetype pos, const Piece& piece)
+{
+    if (piece.length == 0)
+        return;
+    pos = qBound(qsizetype(0), pos, length());
+
+    auto [left, right] = split(m_root, pos);
+
+    // typing appends to the add chunk right after the previous insertion,
+    // so grow the previous piece instead of adding a node per keystroke
+    const Piece* last = lastPiece(left);
+    if (last && last->chunk == piece.chunk && last->start + last->length == piece.start)
+        left = extendLast(left, piece.length, piece.lineFeeds);
+    else
+        left = merge(left, makeLeaf(piece));
+
+    m_root = merge(left, right);
+}
+
+/**
+ * @brief line feeds in [offset, offset + len) of the piece
+ */
+qsizetype TextBuffer::countLineFeeds(const Piece& piece, qsizetype offset, qsizetype len)
+{
+    const Chunk& chunk = *piece.chunk;
+    const qsizetype from = piece.start + offset;
+    if (chunk.indexed)
+    {
+        auto first = std::lower_bound(chunk.lineFeeds.begin(), chunk.lineFeeds.end(), quint32(from));
+        auto last = std::lower_bound(first, chunk.lineFeeds.end(), quint32(from + len));
+        return last - first;
+    }
+    const QChar* data = chunk.data + from;
+    return std::count(data, data + len, QChar('\n'));
+}
+
+/**
+ * @brief offset in the piece of its n-th (0 based) line feed
+ */
+qsizetype TextBuffer::findLineFeed(const Piece& piece, qsizetype n)
+{
+    const Chunk& chunk = *piece.chunk;
+    if (chunk.indexed)
+    {
+        auto first = std::lower_bound(chunk.lineFeeds.begin(), chunk.lineFeeds.end(), quint32(piece.start));
+        return qsizetype(first[n]) - piece.start;
+    }
+    const QChar* data = chunk.data + piece.start;
+    for (qsizetype i = 0; i < piece.length; ++i)
+        if (data[i] == '\n' && n-- == 0)
+            return i;
+    return piece.length;
+}
+// --------------
+
+// Treap
+// --------------
+qsizetype TextBuffer::lengthOf(const NodePtr& node)
+{
+    return node ? node->length : 0;
+}
+
+qsizetype TextBuffer::lineFeedsOf(const NodePtr& node)
+{
+    return node ? node->lineFeeds : 0;
+}
+
+TextBuffer::NodePtr TextBuffer::makeNode(const Piece& piece, const NodePtr& left, const NodePtr& right, quint32 priority)
+{
+    auto node = std::make_shared<Node>();
+    node->piece = piece;
+    node->left = left;
+    node->right = right;
+    node->priority = priority;
+    node->length = lengthOf(left) + piece.length + lengthOf(right);
+    node->lineFeeds = lineFeedsOf(left) + piece.lineFeeds + lineFeedsOf(right);
+    return node;
+}
+
+TextBuffer::NodePtr TextBuffer::makeLeaf(const Piece& piece)
+{
+    return makeNode(piece, nullptr, nullptr, randomPriority());
+}
+
+/**
+ * @brief splits a tree into the first pos chars and the rest, copying only the nodes on the split path
+ */
+std::pair<TextBuffer::NodePtr, TextBuffer::NodePtr> TextBuffer::split(const NodePtr& node, qsizetype pos)
+{
+    if (!node)
+        return {nullptr, nullptr};
+
+    qsizetype leftLength = lengthOf(node->left);
+    qsizetype pieceEnd = leftLength + node->piece.length;
+
+    if (pos <= leftLength)
+    {
+        auto [first, second] = split(node->left, pos);
+        return {first, makeNode(node->piece, second, node->right, node->priority)};
+    }
+
+    if (pos >= pieceEnd)
+    {
+        auto [first, second] = split(node->right, pos - pieceEnd);
+        return {makeNode(node->piece, node->left, first, node->priority), second};
+    }
+
+    // the split point falls inside this node's piece
+    qsizetype offset = pos - leftLength;
+    Piece head{node->piece.chunk, node->piece.start, offset};
+    Piece tail{node->piece.chunk, node->piece.start + offset, node->piece.length - offset};
+    head.lineFeeds = countLineFeeds(node->piece, 0, offset);
+    tail.lineFeeds = node->piece.lineFeeds - head.lineFeeds;
+    return {makeNode(head, node->left, nullptr, node->priority),
+            makeNode(tail, nullptr, node->right, node->priority)};
+}
+
+TextBuffer::NodePtr TextBuffer::merge(const NodePtr& left, const NodePtr& right)
+{
+    if (!left)
+        return right;
+    if (!right)
+        return left;
+
+    if (left->priority > right->priority)
+        return makeNode(left->piece, left->left, merge(left->right, right), left->priority);
+    return makeNode(right->piece, merge(left, right->left), right->right, right->priority);
+}
+
+TextBuffer::NodePtr TextBuffer::extendLast(const NodePtr& node, qsizetype extra, qsizetype extraLineFeeds)
+{
+    if (node->right)
+        return makeNode(node->piece, node->left, extendLast(node->right, extra, extraLineFeeds), node->priority);
+
+    Piece piece = node->piece;
+    piece.length += extra;
+    piece.lineFeeds += extraLineFeeds;
+    return makeNode(piece, node->left, nullptr, node->priority);
+}
+
+const TextBuffer::Piece* TextBuffer::lastPiece(const NodePtr& node)
+{
+    const Node* last = node.get();
+    while (last && last->right)
+        last = last->right.get();
+    return last ? &last->piece : nullptr;
+}
+// --------------
@@ -0,0 +1,99 @@
+#ifndef TEXTBUFFER_H
+#define TEXTBUFFER_H
+
+#include <QString>
+#include <QStringView>
+#include <QChar>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief plain-text piece table holding the authoritative text of a document
+ *
+ * The text is a sequence of pieces, each one a span of an immutable chunk:
+ * either original text (a loaded file) or the append-only add buffer that
+ * receives every insertion. Pieces are kept in a persistent treap ordered by
+ * position, so at/insert/remove/mid are O(log n), and copying a TextBuffer is
+ * O(1): the copy is a snapshot sharing every node and chunk with the source.
+ *
+ * Every node also counts the line feeds in its subtree, so converting between
+ * positions and line numbers is O(log n) too and stays up to date with every
+ * edit without ever rescanning the text.
+ *
+ * A buffer and its snapshots may be read from any thread, but a buffer must
+ * only be modified from the thread that owns it.
+ */
+class TextBuffer
+{
+public:
+    // a piece of the text: a contiguous view starting at buffer position 'start'
+    struct Span
+    {
+        QStringView text;
+        qsizetype start = 0;
+    };
+
+    TextBuffer();
+    explicit TextBuffer(const QString& text);
+
+    // copies share the text but never the add buffer, so a snapshot handed to
+    // another thread is never written behind its back
+    TextBuffer(const TextBuffer& other);
+    TextBuffer& operator=(const TextBuffer& other);
+    TextBuffer(TextBuffer&& other) = default;
+    TextBuffer& operator=(TextBuffer&& other) = default;
+
+    qsizetype length() const;
+    inline bool isEmpty() const { return length() == 0; }
+
+    QChar at(qsizetype pos) const;
+    Span spanAt(qsizetype pos) const;
+    QString text(qsizetype pos, qsizetype len) const;
+    QString toString() const;
+    TextBuffer mid(qsizetype pos, qsizetype len = -1) const;
+
+    // Lines (0 based, separated by '\n')
+    qsizetype lineCount() const;
+    qsizetype lineAt(qsizetype pos) const;
+    qsizetype lineStart(qsizetype line) const;
+    qsizetype lineEnd(qsizetype line) const;
+
+    void insert(qsizetype pos, QStringView text);
+    void insert(qsizetype pos, const QString& text);
+    void insert(qsizetype pos, const TextBuffer& text);
+    void remove(qsizetype pos, qsizetype len);
+    void replace(qsizetype pos, qsizetype len, QStringView text);
+    void append(const QString& text);
+    void clear();
+
+    // bytes of the chunks texts refer to and except doesn't: the memory only they keep alive
+    static qsizetype chunkBytes(const std::vector<const TextBuffer*>& texts, const TextBuffer& except);
+
+private:
+    struct Chunk;
+    struct Piece;
+    struct Node;
+    struct AddBuffer;
+    using NodePtr = std::shared_ptr<const Node>;
+
+    static qsizetype lengthOf(const NodePtr& node);
+    static qsizetype lineFeedsOf(const NodePtr& node);
+    static qsizetype countLineFeeds(const Piece& piece, qsizetype offset, qsizetype len);
+    static qsizetype findLineFeed(const Piece& piece, qsizetype n);
+    static NodePtr makeNode(const Piece& piece, const NodePtr& left, const NodePtr& right, quint32 priority);
+    static NodePtr makeLeaf(const Piece& piece);
+    static std::pair<NodePtr, NodePtr> split(const NodePtr& node, qsizetype pos);
+    static NodePtr merge(const NodePtr& left, const NodePtr& right);
+    static NodePtr extendLast(const NodePtr& node, qsizetype extra, qsizetype extraLineFeeds);
+    static const Piece* lastPiece(const NodePtr& node);
+
+    static Piece chunkPiece(const QString& text);
+    Piece addPiece(QStringView text);
+    void insertPiece(qsizetype pos, const Piece& piece);
+
+    NodePtr m_root;
+    std::shared_ptr<AddBuffer> m_add;
+};
+
+#endif // TEXTBUFFER_H
@@ -0,0 +1,626 @@
+#include "textcodec.h"
+#include "simd.h"
+#include <QtAlgorithms>
+#include <QtEndian>
+#include <cstring>
+
+// UTF-8
+// --------------
+/**
+ * @brief length of the valid UTF-8 sequence at p, its code point in code; 0 if it's invalid
+ *
+ * Overlong forms, surrogates and code points past U+10FFFF are invalid.
+ */
+static inline int sequenceLength(const uchar* p, const uchar* end, char32_t& code)
+{
+    const uchar lead = p[0];
+    int length;
+    char32_t min;
+    if (lead < 0x80)
+    {
+        code = lead;
+        return 1;
+    }
+    else if ((lead & 0xE0) == 0xC0)
+    {
+        length = 2;
+        code = lead & 0x1F;
+        min = 0x80;
+    }
+    else if ((lead & 0xF0) == 0xE0)
+    {
+        length = 3;
+        code = lead & 0x0F;
+        min = 0x800;
+    }
+    else if ((lead & 0xF8) == 0xF0)
+    {
+        length = 4;
+        code = lead & 0x07;
+        min = 0x10000;
+    }
+    else
+    {
+        return 0;
+    }
+
+    if (end - p < length)
+        return 0;
+    for (int i = 1; i < length; ++i)
+    {
+        if ((p[i] & 0xC0) != 0x80)
+            return 0;
+        code = (code << 6) | (p[i] & 0x3F);
+    }
+    if (code < min || code > 0x10FFFF || (code >= 0xD800 && code <= 0xDFFF))
+        return 0;
+    return length;
+}
+
+bool TextCodec::isValidUtf8(const char* data, qint64 size)
+{
+    const uchar* p = reinterpret_cast<const uchar*>(data);
+    const uchar* end = p + size;
+    while (p < end)
+    {
+#ifdef VIMMY_SSE2
+        // skip ASCII 16 bytes at a time
+        while (end - p >= 16)
+        {
+            const int mask = _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+            if (mask != 0)
+            {
+                p += qCountTrailingZeroBits(uint(mask));
+                break;
+            }
+            p += 16;
+        }
+        if (p == end)
+            break;
+#endif
+        char32_t code;
+        const int length = sequenceLength(p, end, code);
+        if (length == 0)
+            return false;
+        p += length;
+    }
+    return true;
+}
+
+static qsizetype decodeUtf8(const uchar* p, const uchar* end, char16_t* out)
+{
+    char16_t* const begin = out;
+    while (p < end)
+    {
+#ifdef VIMMY_SSE2
+        // widen ASCII 16 bytes at a time; a byte never decodes to more than one char,
+        // so the whole block fits even when only its first bytes are ASCII
+        const __m128i zero = _mm_setzero_si128();
+        while (end - p >= 16)
+        {
+            const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(bytes, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpackhi_epi8(bytes, zero));
+            const int mask = _mm_movemask_epi8(bytes);
+            if (mask != 0)
+            {
+                const int ascii = qCountTrailingZeroBits(uint(mask));
+                p += ascii;
+                out += ascii;
+                break;
+            }
+            p += 16;
+            out += 16;
+        }
+        if (p == end)
+            break;
+#endif
+        char32_t code;
+        const int length = sequenceLength(p, end, code);
+        if (length == 0)
+        {
+            // one replacement char per invalid byte
+            *out++ = 0xFFFD;
+            ++p;
+            continue;
+        }
+
+        if (code >= 0x10000)
+        {
+            *out++ = char16_t(0xD800 + ((code - 0x10000) >> 10));
+            *out++ = char16_t(0xDC00 + ((code - 0x10000) & 0x3FF));
+        }
+        else
+        {
+            *out++ = char16_t(code);
+        }
+        p += length;
+    }
+    return out - begin;
+}
+
+/**
+ * @brief encodes text as UTF-8 at out, at most 3 bytes per char
+ */
+static uchar* encodeUtf8(QStringView text, uchar* out)
+{
+    const char16_t* p = text.utf16();
+    const char16_t* end = p + text.size();
+    while (p < end)
+    {
+#ifdef VIMMY_SSE2
+        // narrow ASCII 16 chars at a time
+        const __m128i nonAscii = _mm_set1_epi16(short(0xFF80));
+        const __m128i zero = _mm_setzero_si128();
+        while (end - p >= 16)
+        {
+            const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+            const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 8));
+            const __m128i bits = _mm_and_si128(_mm_or_si128(low, high), nonAscii);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(bits, zero)) != 0xFFFF)
+                break;
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(low, high));
+            p += 16;
+            out += 16;
+        }
+        if (p == end)
+            break;
+#endif
+        char32_t code = *p++;
+        if (QChar::isHighSurrogate(code) && p < end && QChar::isLowSurrogate(*p))
+            code = QChar::surrogateToUcs4(char16_t(code), *p++);
+        else if (QChar::isSurrogate(code))
+            code = 0xFFFD; // unpaired
+
+        if (code < 0x80)
+        {
+            *out++ = uchar(code);
+        }
+        else if (code < 0x800)
+        {
+            *out++ = uchar(0xC0 | (code >> 6));
+            *out++ = uchar(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000)
+        {
+            *out++ = uchar(0xE0 | (code >> 12));
+            *out++ = uchar(0x80 | ((code >> 6) & 0x3F));
+            *out++ = uchar(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            *out++ = uchar(0xF0 | (code >> 18));
+            *out++ = uchar(0x80 | ((code >> 12) & 0x3F));
+            *out++ = uchar(0x80 | ((code >> 6) & 0x3F));
+            *out++ = uchar(0x80 | (code & 0x3F));
+        }
+    }
+    return out;
+}
+
+// Latin-1
+// --------------
+/**
+ * @brief encodes text as Latin-1 at out, null if a char is past U+00FF
+ */
+static uchar* encodeLatin1(QStringView text, uchar* out)
+{
+    const char16_t* p = text.utf16();
+    const char16_t* end = p + text.size();
+#ifdef VIMMY_SSE2
+    const __m128i nonLatin1 = _mm_set1_epi16(short(0xFF00));
+    const __m128i zero = _mm_setzero_si128();
+    while (end - p >= 16)
+    {
+        const __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 8));
+        const __m128i bits = _mm_and_si128(_mm_or_si128(low, high), nonLatin1);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(bits, zero)) != 0xFFFF)
+            return nullptr;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_packus_epi16(low, high));
+        p += 16;
+        out += 16;
+    }
+#endif
+    for (; p < end; ++p)
+    {
+        if (*p > 0xFF)
+            return nullptr;
+        *out++ = uchar(*p);
+    }
+    return out;
+}
+
+// Line endings
+// --------------
+namespace {
+struct LineEndingCount
+{
+    qint64 lineFeeds = 0;
+    qint64 carriageReturns = 0;
+    qint64 crlfs = 0;   // line feeds preceded by a carriage return
+
+    // the count can't be CRLF or CR any more, whatever follows
+    inline bool isMixed() const { return crlfs != lineFeeds; }
+
+    TextCodec::LineEnding lineEnding() const
+    {
+        if (lineFeeds > 0 && crlfs == lineFeeds)
+            return TextCodec::CRLF;
+        if (lineFeeds == 0 && carriageReturns > 0)
+            return TextCodec::CR;
+        return TextCodec::LF;
+    }
+};
+}
+
+static TextCodec::LineEnding lineEndingOfBytes(const uchar* p, const uchar* end)
+{
+    LineEndingCount count;
+    bool afterCr = false;
+#ifdef VIMMY_SSE2
+    const __m128i lineFeed = _mm_set1_epi8('\n');
+    const __m128i carriageReturn = _mm_set1_epi8('\r');
+    while (end - p >= 16)
+    {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        const uint lf = uint(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, lineFeed)));
+        const uint cr = uint(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, carriageReturn)));
+        p += 16;
+        if ((lf | cr) == 0)
+        {
+            afterCr = false;
+            continue;
+        }
+
+        count.lineFeeds += qPopulationCount(lf);
+        count.carriageReturns += qPopulationCount(cr);
+        count.crlfs += qPopulationCount(lf & ((cr << 1) | uint(afterCr)));
+        afterCr = cr & 0x8000;
+        // a plain LF file is decided by its first line
+        if (count.isMixed())
+            return TextCodec::LF;
+    }
+#endif
+    for (; p < end; ++p)
+    {
+        if (*p == '\n')
+        {
+            ++count.lineFeeds;
+            count.crlfs += afterCr;
+        }
+        else if (*p == '\r')
+        {
+            ++count.carriageReturns;
+        }
+        afterCr = *p == '\r';
+    }
+    return count.lineEnding();
+}
+
+static TextCodec::LineEnding lineEndingOfUtf16(const uchar* p, const uchar* end, bool bigEndian)
+{
+    LineEndingCount count;
+    bool afterCr = false;
+    for (; end - p >= 2 && !count.isMixed(); p += 2)
+    {
+        const char16_t unit = bigEndian ? qFromBigEndian<quint16>(p) : qFromLittleEndian<quint16>(p);
+        if (unit == '\n')
+        {
+            ++count.lineFeeds;
+            count.crlfs += afterCr;
+        }
+        else if (unit == '\r')
+        {
+            ++count.carriageReturns;
+        }
+        afterCr = unit == '\r';
+    }
+    return count.lineEnding();
+}
+
+/**
+ * @brief turns the line endings of decoded text into line feeds
+ */
+static void toLineFeeds(QString& text, TextCodec::LineEnding lineEnding)
+{
+    if (lineEnding == TextCodec::CR)
+    {
+        text.replace(QChar('\r'), QChar('\n'));
+        return;
+    }
+    if (lineEnding != TextCodec::CRLF)
+        return;
+
+    const qsizetype first = text.indexOf(QChar('\r'));
+    if (first < 0)
+        return;
+
+    // drop every carriage return that is followed by a line feed, in place
+    char16_t* begin = reinterpret_cast<char16_t*>(text.data());
+    const char16_t* end = begin + text.size();
+    const char16_t* in = begin + first;
+    char16_t* out = begin + first;
+    for (; in < end; ++in)
+    {
+        if (*in == '\r' && in + 1 < end && in[1] == '\n')
+            continue;
+        *out++ = *in;
+    }
+    text.truncate(out - begin);
+}
+
+// Detection
+// --------------
+/**
+ * @brief UTF-16 without a BOM: mostly ASCII text has a NUL in every other byte
+ */
+static bool looksLikeUtf16(const uchar* data, qint64 size, TextCodec::Encoding& encoding)
+{
+    constexpr qint64 SAMPLE_SIZE = 4096;
+    const qint64 units = qMin(size, SAMPLE_SIZE) / 2;
+    if (units == 0)
+        return false;
+
+    qint64 evenNuls = 0;
+    qint64 oddNuls = 0;
+    for (qint64 i = 0; i < units; ++i)
+    {
+        evenNuls += data[2 * i] == 0;
+        oddNuls += data[2 * i + 1] == 0;
+    }
+
+    // NULs on one side only, for at least 2 chars out of 5
+    if (oddNuls * 5 >= units * 2 && evenNuls * 20 <= units)
+        encoding = TextCodec::Utf16LE;
+    else if (evenNuls * 5 >= units * 2 && oddNuls * 20 <= units)
+        encoding = TextCodec::Utf16BE;
+    else
+        return false;
+    return true;
+}
+
+/**
+ * @brief format of a file's contents: BOM first, then UTF-16 by its NULs, then UTF-8 if
+ *        the whole file is valid UTF-8, and Latin-1 otherwise
+ */
+TextCodec::Format TextCodec::detect(const char* data, qint64 size)
+{
+    const uchar* bytes = reinterpret_cast<const uchar*>(data);
+    if (size == 0)
+        return defaultFormat();
+
+    Format format;
+    if (size >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF)
+    {
+        format.encoding = Utf8;
+        format.bom = true;
+    }
+    else if (size >= 2 && bytes[0] == 0xFF && bytes[1] == 0xFE)
+    {
+        format.encoding = Utf16LE;
+        format.bom = true;
+    }
+    else if (size >= 2 && bytes[0] == 0xFE && bytes[1] == 0xFF)
+    {
+        format.encoding = Utf16BE;
+        format.bom = true;
+    }
+    else if (!looksLikeUtf16(bytes, size, format.encoding))
+    {
+        format.encoding = isValidUtf8(data, size) ? Utf8 : Latin1;
+    }
+
+    const uchar* text = bytes + bomLength(format);
+    if (unitSize(format.encoding) == 2)
+        format.lineEnding = lineEndingOfUtf16(text, bytes + size, format.encoding == Utf16BE);
+    else
+        format.lineEnding = lineEndingOfBytes(text, bytes + size);
+    return format;
+}
+
+/**
+ * @brief format of new files: UTF-8 without a BOM, with the platform's line ending
+ */
+TextCodec::Format TextCodec::defaultFormat()
+{
+    Format format;
+#ifdef Q_OS_WIN
+    format.lineEnding = CRLF;
+#endif
+    return format;
+}
+
+qsizetype TextCodec::bomLength(const Format& format)
+{
+    if (!format.bom)
+        return 0;
+    return format.encoding == Utf8 ? 3 : format.encoding == Latin1 ? 0 : 2;
+}
+
+QByteArray TextCodec::bom(const Format& format)
+{
+    if (!format.bom)
+        return QByteArray();
+    switch (format.encoding)
+    {
+        case Utf8:    return QByteArray("\xEF\xBB\xBF", 3);
+        case Utf16LE: return QByteArray("\xFF\xFE", 2);
+        case Utf16BE: return QByteArray("\xFE\xFF", 2);
+        default:      return QByteArray();
+    }
+}
+
+// Transcoding
+// --------------
+/**
+ * @brief decodes the bytes of whole chars in format, line endings become '\n'
+ */
+QString TextCodec::decode(const char* data, qint64 size, const Format& format)
+{
+    const uchar* bytes = reinterpret_cast<const uchar*>(data);
+    QString text;
+    switch (format.encoding)
+    {
+        case Utf8:
+        {
+            text.resize(size);
+            text.truncate(decodeUtf8(bytes, bytes + size, reinterpret_cast<char16_t*>(text.data())));
+            break;
+        }
+        case Latin1:
+            text = QString::fromLatin1(data, size);
+            break;
+        case Utf16LE:
+        case Utf16BE:
+        {
+            const qsizetype units = size / 2;
+            text.resize(units + (size & 1));
+            if (format.encoding == Utf16LE)
+                qFromLittleEndian<quint16>(bytes, units, text.data());
+            else
+                qFromBigEndian<quint16>(bytes, units, text.data());
+            // a stray last byte
+            if (size & 1)
+                text[units] = QChar(QChar::ReplacementCharacter);
+            break;
+        }
+    }
+
+    toLineFeeds(text, format.lineEnding);
+    return text;
+}
+
+/**
+ * @brief encodes a run of text without line feeds at out, null if the encoding can't represent it
+ */
+static uchar* encodeRun(QStringView text, TextCodec::Encoding encoding, uchar* out)
+{
+    switch (encoding)
+    {
+        case TextCodec::Utf8:
+            return encodeUtf8(text, out);
+        case TextCodec::Latin1:
+            return encodeLatin1(text, out);
+        case TextCodec::Utf16LE:
+            qToLittleEndian<quint16>(text.utf16(), text.size(), out);
+            return out + 2 * text.size();
+        case TextCodec::Utf16BE:
+            qToBigEndian<quint16>(text.utf16(), text.size(), out);
+            return out + 2 * text.size();
+    }
+    return nullptr;
+}
+
+/**
+ * @brief appends text encoded in format to out, '\n' written as the format's line ending
+ *
+ * Returns false, leaving out as it was, if the encoding can't represent a char.
+ * A surrogate pair split across two calls isn't put back together, so text
+ * should end on a whole char.
+ */
+bool TextCodec::encode(QStringView text, const Format& format, QByteArray& out)
+{
+    // at most 4 bytes per char: "\r\n" in UTF-16
+    const qsizetype start = out.size();
+    out.resize(start + 4 * text.size());
+    uchar* const begin = reinterpret_cast<uchar*>(out.data());
+    uchar* end = begin + start;
+
+    if (format.lineEnding == LF)
+    {
+        end = encodeRun(text, format.encoding, end);
+    }
+    else
+    {
+        const QStringView lineEnding = format.lineEnding == CRLF ? QStringView(u"\r\n") : QStringView(u"\r");
+        qsizetype pos = 0;
+        while (end)
+        {
+            const qsizetype lineFeed = text.indexOf(QChar('\n'), pos);
+            if (lineFeed < 0)
+            {
+                end = encodeRun(text.sliced(pos), format.encoding, end);
+                break;
+            }
+            end = encodeRun(text.sliced(pos, lineFeed - pos), format.encoding, end);
+            if (end)
+                end = encodeRun(lineEnding, format.encoding, end);
+            pos = lineFeed + 1;
+        }
+    }
+
+    if (!end)
+    {
+        out.truncate(start);
+        return false;
+    }
+    out.truncate(end - begin);
+    return true;
+}
+
+// Names
+// --------------
+QString TextCodec::nameOf(Encoding encoding)
+{
+    static const char* names[] = {"UTF-8", "UTF-16 LE", "UTF-16 BE", "Latin-1"};
+    return names[encoding];
+}
+
+/**
+ * @brief short description, like "UTF-8 CRLF" or "UTF-16 LE with BOM LF"
+ */
+QString TextCodec::nameOf(const Format& format)
+{
+    static const char* lineEndings[] = {"LF", "CRLF", "CR"};
+    return QString("%1%2 %3")
+           .arg(nameOf(format.encoding))
+           .arg(format.bom ? " with BOM" : "")
+           .arg(lineEndings[format.lineEnding]);
+}
+
+bool TextCodec::setOption(Format& format, const QString& option)
+{
+    if (option == "bomb" || option == "nobomb")
+    {
+        // Latin-1 has no BOM
+        format.bom = option == "bomb" && format.encoding != Latin1;
+        return true;
+    }
+
+    const qsizetype equals = option.indexOf('=');
+    const QString name = option.left(equals);
+    const QString value = option.mid(equals + 1).toLower();
+    if (equals < 0)
+        return false;
+
+    if (name == "ff" || name == "fileformat")
+    {
+        if (value == "unix")
+            format.lineEnding = LF;
+        else if (value == "dos")
+            format.lineEnding = CRLF;
+        else if (value == "mac")
+            format.lineEnding = CR;
+        else
+            return false;
+        return true;
+    }
+    if (name == "fenc" || name == "fileencoding")
+    {
+        if (value == "utf-8" || value == "utf8")
+            format.encoding = Utf8;
+        else if (value == "utf-16le")
+            format.encoding = Utf16LE;
+        else if (value == "utf-16be" || value == "utf-16")
+            format.encoding = Utf16BE;
+        else if (value == "latin1" || value == "iso-8859-1")
+            format.encoding = Latin1;
+        else
+            return false;
+        if (format.encoding == Latin1)
+            format.bom = false;
+        return true;
+    }
+    return false;
+}
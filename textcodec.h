@@ -0,0 +1,63 @@
+#ifndef TEXTCODEC_H
+#define TEXTCODEC_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringView>
+
+/**
+ * @brief detects, decodes and encodes the text formats files are read and written in
+ *
+ * A file's format is its encoding (UTF-8, UTF-16 LE/BE or Latin-1), whether
+ * it starts with a byte order mark, and its line ending. Decoding turns the
+ * line endings into '\n' and encoding turns them back, so saving writes an
+ * unmodified text back byte for byte.
+ *
+ * Only files whose every line feed is preceded by a carriage return count as
+ * CRLF (and only files without line feeds as CR). Carriage returns that don't
+ * end a line are kept as text, so files mixing line endings round-trip too.
+ *
+ * UTF-8 is validated, decoded and encoded 16 bytes at a time with SIMD while
+ * the text is ASCII, multibyte sequences take the scalar path.
+ */
+class TextCodec
+{
+public:
+    enum Encoding : quint8 {Utf8 = 0, Utf16LE, Utf16BE, Latin1};
+    enum LineEnding : quint8 {LF = 0, CRLF, CR};
+
+    struct Format
+    {
+        Encoding encoding = Utf8;
+        bool bom = false;
+        LineEnding lineEnding = LF;
+
+        inline bool operator==(const Format& other) const
+        {
+            return encoding == other.encoding && bom == other.bom && lineEnding == other.lineEnding;
+        }
+        inline bool operator!=(const Format& other) const { return !(*this == other); }
+    };
+
+    static Format detect(const char* data, qint64 size);
+    static Format defaultFormat();
+    static bool isValidUtf8(const char* data, qint64 size);
+
+    // bytes of the BOM at the start of a file in format, if it has one
+    static qsizetype bomLength(const Format& format);
+    // bytes of one code unit
+    static inline int unitSize(Encoding encoding) { return encoding == Utf16LE || encoding == Utf16BE ? 2 : 1; }
+
+    // decodes bytes following the BOM; invalid UTF-8 decodes to U+FFFD
+    static QString decode(const char* data, qint64 size, const Format& format);
+    // appends text to out, without a BOM; false if the encoding can't represent a char of text
+    static bool encode(QStringView text, const Format& format, QByteArray& out);
+    static QByteArray bom(const Format& format);
+
+    // applies a Vim option: fileformat=unix|dos|mac, fileencoding=utf-8|utf-16le|utf-16be|latin1, [no]bomb
+    static bool setOption(Format& format, const QString& option);
+    static QString nameOf(Encoding encoding);
+    static QString nameOf(const Format& format);
+};
+
+#endif // TEXTCODEC_H
@@ -0,0 +1,53 @@
+#include "textiterator.h"
+
+TextIterator::TextIterator(const TextBuffer& buffer, qsizetype position)
+    : m_buffer(&buffer)
+    , m_end(buffer.length())
+{
+    m_position = qBound(qsizetype(0), position, m_end);
+    loadSpan();
+}
+
+QChar TextIterator::operator*() const
+{
+    qsizetype offset = m_position - m_span.start;
+    if (offset < 0 || offset >= m_span.text.size())
+        return QChar();
+    return m_span.text[offset];
+}
+
+TextIterator& TextIterator::operator++()
+{
+    if (atEnd())
+        return *this;
+
+    ++m_position;
+    if (m_position - m_span.start >= m_span.text.size() && !atEnd())
+        loadSpan();
+    return *this;
+}
+
+TextIterator& TextIterator::operator--()
+{
+    if (atStart())
+        return *this;
+
+    --m_position;
+    if (m_position < m_span.start)
+        loadSpan();
+    return *this;
+}
+
+TextIterator TextIterator::operator++(int)
+{
+    TextIterator it = *this;
+    ++(*this);
+    return it;
+}
+
+TextIterator TextIterator::operator--(int)
+{
+    TextIterator it = *this;
+    --(*this);
+    return it;
+}
@@ -0,0 +1,51 @@
+#ifndef TEXTITERATOR_H
+#define TEXTITERATOR_H
+
+#include "textbuffer.h"
+#include <QChar>
+#include <iterator>
+
+/**
+ * @brief bidirectional character iterator over a TextBuffer
+ *
+ * The piece containing the start position is looked up once (O(log n)) and
+ * then walked directly, another lookup only happens when crossing into the
+ * next/previous piece, so reading around the cursor never copies any text.
+ * The end of the text reads as a null QChar.
+ * Modifying the buffer invalidates its iterators.
+ */
+class TextIterator
+{
+public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = QChar;
+    using difference_type = qsizetype;
+    using pointer = void;
+    using reference = QChar;
+
+    TextIterator() = default;
+    TextIterator(const TextBuffer& buffer, qsizetype position);
+
+    QChar operator*() const;
+    TextIterator& operator++();
+    TextIterator& operator--();
+    TextIterator operator++(int);
+    TextIterator operator--(int);
+
+    inline bool operator==(const TextIterator& other) const { return m_position == other.m_position; }
+    inline bool operator!=(const TextIterator& other) const { return m_position != other.m_position; }
+
+    inline qsizetype position() const { return m_position; }
+    inline bool atStart() const { return m_position <= 0; }
+    inline bool atEnd() const { return m_position >= m_end; }
+
+private:
+    inline void loadSpan() { m_span = m_buffer->spanAt(m_position); }
+
+    const TextBuffer* m_buffer = nullptr;
+    TextBuffer::Span m_span;    // piece containing m_position
+    qsizetype m_position = 0;
+    qsizetype m_end = 0;        // length of the buffer
+};
+
+#endif // TEXTITERATOR_H
@@ -0,0 +1,307 @@
+#include "undohistory.h"
+#include <QByteArray>
+#include <QDir>
+
+struct UndoHistory::Delta
+{
+    qsizetype position = 0;
+    TextBuffer removed;
+    TextBuffer inserted;
+    qsizetype removedLength = 0;
+    qsizetype insertedLength = 0;
+    // once spilled, the removed text followed by the inserted one is at this offset of the spill file
+    qint64 spillOffset = -1;
+
+    inline bool isSpilled() const { return spillOffset >= 0; }
+};
+
+struct UndoHistory::Node
+{
+    qint32 parent = -1;
+    qint32 redoChild = -1; // the child redo goes to: the last one created or undone
+    qint32 firstDelta = 0;
+    qint32 deltaCount = 0;
+};
+
+UndoHistory::UndoHistory()
+{
+    clear();
+}
+
+UndoHistory::~UndoHistory() = default;
+UndoHistory::UndoHistory(UndoHistory&& other) noexcept = default;
+UndoHistory& UndoHistory::operator=(UndoHistory&& other) noexcept = default;
+
+/**
+ * @brief records that [position, position + removed.length()) was replaced with inserted
+ *
+ * The change joins the open step, if any, and starts a new one otherwise.
+ */
+void UndoHistory::record(qsizetype position, const TextBuffer& removed, const TextBuffer& inserted)
+{
+    if (removed.isEmpty() && inserted.isEmpty())
+        return;
+
+    if (!m_open)
+    {
+        // a new step branching off the current state
+        Node node;
+        node.parent = m_current;
+        node.firstDelta = qint32(m_deltas.size());
+        m_nodes.push_back(node);
+        m_current = qint32(m_nodes.size() - 1);
+        m_nodes[node.parent].redoChild = m_current;
+        m_open = true;
+    }
+
+    // the open step's deltas are the last ones
+    Node& node = m_nodes[m_current];
+    if (node.deltaCount > 0 && merge(m_deltas.back(), position, removed, inserted))
+        return;
+
+    Delta delta;
+    delta.position = position;
+    delta.removed = removed;
+    delta.inserted = inserted;
+    delta.removedLength = removed.length();
+    delta.insertedLength = inserted.length();
+    m_recorded += costOf(delta);
+    m_deltas.push_back(std::move(delta));
+    ++node.deltaCount;
+}
+
+/**
+ * @brief ends the open step, the next change starts a new one
+ */
+void UndoHistory::close(const TextBuffer& text)
+{
+    m_open = false;
+    fit(text);
+}
+
+void UndoHistory::clear()
+{
+    m_nodes.assign(1, Node());
+    m_deltas.clear();
+    m_current = ROOT;
+    m_open = false;
+    m_measured = 0;
+    m_recorded = 0;
+    m_spilled = 0;
+    m_spillFile.reset();
+}
+
+/**
+ * @brief steps back to the parent state, returning the edits that restore it (none at the root)
+ */
+QList<UndoHistory::Edit> UndoHistory::undo()
+{
+    m_open = false;
+    QList<Edit> edits;
+    if (m_current == ROOT)
+        return edits;
+
+    const Node& node = m_nodes[m_current];
+    edits.reserve(node.deltaCount);
+    for (qint32 i = node.firstDelta + node.deltaCount - 1; i >= node.firstDelta; --i)
+    {
+        const Delta& delta = m_deltas[i];
+        edits.append(Edit{delta.position, delta.insertedLength, removedText(delta)});
+    }
+
+    m_nodes[node.parent].redoChild = m_current;
+    m_current = node.parent;
+    return edits;
+}
+
+/**
+ * @brief steps forward to the state last undone from, returning the edits that restore it
+ */
+QList<UndoHistory::Edit> UndoHistory::redo()
+{
+    m_open = false;
+    QList<Edit> edits;
+    const qint32 child = m_nodes[m_current].redoChild;
+    if (child < 0)
+        return edits;
+
+    const Node& node = m_nodes[child];
+    edits.reserve(node.deltaCount);
+    for (qint32 i = node.firstDelta; i < node.firstDelta + node.deltaCount; ++i)
+    {
+        const Delta& delta = m_deltas[i];
+        edits.append(Edit{delta.position, delta.removedLength, insertedText(delta)});
+    }
+
+    m_current = child;
+    return edits;
+}
+
+void UndoHistory::setMemoryBudget(qsizetype bytes, const TextBuffer& text)
+{
+    m_budget = qMax(qsizetype(0), bytes);
+    fit(text);
+}
+
+/**
+ * @brief bytes the history keeps in memory besides what it shares with text (spilled text isn't counted)
+ */
+qsizetype UndoHistory::memoryUsage(const TextBuffer& text) const
+{
+    std::vector<const TextBuffer*> slices;
+    slices.reserve(m_deltas.size() * 2);
+    for (const Delta& delta : m_deltas)
+    {
+        if (!delta.removed.isEmpty())
+            slices.push_back(&delta.removed);
+        if (!delta.inserted.isEmpty())
+            slices.push_back(&delta.inserted);
+    }
+    return qsizetype(m_deltas.size() * sizeof(Delta)) + TextBuffer::chunkBytes(slices, text);
+}
+
+/**
+ * @brief folds a change into the delta before it when they touch (typing, backspace, delete)
+ */
+bool UndoHistory::merge(Delta& last, qsizetype position, const TextBuffer& removed, const TextBuffer& inserted)
+{
+    if (last.isSpilled())
+        return false;
+
+    const qsizetype insertedEnd = last.position + last.insertedLength;
+    const qsizetype cost = costOf(last);
+    if (removed.isEmpty() && position == insertedEnd)
+    {
+        // typing on
+        last.inserted.insert(last.insertedLength, inserted);
+    }
+    else if (inserted.isEmpty() && position >= last.position && position + removed.length() <= insertedEnd)
+    {
+        // erasing what was just typed
+        last.inserted.remove(position - last.position, removed.length());
+    }
+    else if (inserted.isEmpty() && position + removed.length() == last.position)
+    {
+        // backspace past the start
+        last.removed.insert(0, removed);
+        last.position = position;
+    }
+    else if (inserted.isEmpty() && position == insertedEnd)
+    {
+        // delete after the end
+        last.removed.insert(last.removedLength, removed);
+    }
+    else
+    {
+        return false;
+    }
+
+    last.removedLength = last.removed.length();
+    last.insertedLength = last.inserted.length();
+    m_recorded += qMax(qsizetype(0), costOf(last) - cost);
+    return true;
+}
+
+/**
+ * @brief spills the oldest closed steps until the history fits its budget
+ *
+ * Measuring walks the history and the text, so it's only done once what was
+ * recorded since the last measure could have taken the history over budget.
+ */
+void UndoHistory::fit(const TextBuffer& text)
+{
+    if (m_measured + m_recorded <= m_budget)
+        return;
+
+    m_measured = memoryUsage(text);
+    m_recorded = 0;
+    while (m_measured > m_budget && spill(m_measured - m_budget))
+        m_measured = memoryUsage(text);
+}
+
+/**
+ * @brief moves the text of the oldest closed steps to the spill file, about bytes of it
+ *
+ * @return false if nothing could be spilled
+ */
+bool UndoHistory::spill(qsizetype bytes)
+{
+    const size_t end = m_open ? size_t(m_nodes[m_current].firstDelta) : m_deltas.size();
+    qsizetype spilled = 0;
+    for (; m_spilled < end && spilled < bytes; ++m_spilled)
+    {
+        Delta& delta = m_deltas[m_spilled];
+        if (delta.isSpilled() || (delta.removed.isEmpty() && delta.inserted.isEmpty()))
+            continue;
+
+        if (!m_spillFile)
+        {
+            m_spillFile = std::make_unique<QTemporaryFile>(QDir::tempPath() + "/vimmy-undo-XXXXXX");
+            if (!m_spillFile->open())
+            {
+                // keep everything in memory rather than lose history
+                m_spillFile.reset();
+                return spilled > 0;
+            }
+        }
+
+        const qint64 offset = m_spillFile->size();
+        m_spillFile->seek(offset);
+        if (!writeSpill(delta.removed) || !writeSpill(delta.inserted))
+        {
+            m_spillFile->resize(offset);
+            return spilled > 0;
+        }
+
+        spilled += costOf(delta);
+        delta.removed = TextBuffer();
+        delta.inserted = TextBuffer();
+        delta.spillOffset = offset;
+    }
+    return spilled > 0;
+}
+
+bool UndoHistory::writeSpill(const TextBuffer& text)
+{
+    const qsizetype length = text.length();
+    qsizetype pos = 0;
+    while (pos < length)
+    {
+        TextBuffer::Span span = text.spanAt(pos);
+        QStringView slice = span.text.mid(pos - span.start);
+        const qint64 bytes = slice.size() * qint64(sizeof(QChar));
+        if (m_spillFile->write(reinterpret_cast<const char*>(slice.utf16()), bytes) != bytes)
+            return false;
+        pos += slice.size();
+    }
+    return true;
+}
+
+TextBuffer UndoHistory::readSpill(qint64 offset, qsizetype length) const
+{
+    if (length == 0 || !m_spillFile || !m_spillFile->seek(offset))
+        return TextBuffer();
+
+    const QByteArray bytes = m_spillFile->read(length * qint64(sizeof(QChar)));
+    return TextBuffer(QString(reinterpret_cast<const QChar*>(bytes.constData()), bytes.size() / qsizetype(sizeof(QChar))));
+}
+
+TextBuffer UndoHistory::removedText(const Delta& delta) const
+{
+    if (!delta.isSpilled())
+        return delta.removed;
+    return readSpill(delta.spillOffset, delta.removedLength);
+}
+
+TextBuffer UndoHistory::insertedText(const Delta& delta) const
+{
+    if (!delta.isSpilled())
+        return delta.inserted;
+    return readSpill(delta.spillOffset + delta.removedLength * qint64(sizeof(QChar)), delta.insertedLength);
+}
+
+// bytes of text a delta refers to, whether it shares them or not
+qsizetype UndoHistory::costOf(const Delta& delta)
+{
+    return qsizetype(sizeof(Delta)) + (delta.removed.length() + delta.inserted.length()) * qsizetype(sizeof(QChar));
+}
@@ -0,0 +1,85 @@
+#ifndef UNDOHISTORY_H
+#define UNDOHISTORY_H
+
+#include "textbuffer.h"
+#include <QList>
+#include <QTemporaryFile>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Vim-like undo tree of the changes made to a TextBuffer
+ *
+ * Every undo step is a node holding the deltas that lead to it from its
+ * parent state; undoing and then changing the text starts a new branch
+ * instead of dropping the undone steps. A delta keeps the removed and the
+ * inserted text as TextBuffer slices, which share the chunks of the buffer
+ * they were cut from, so recording or undoing even a huge paste is
+ * O(log n) and never copies the document.
+ *
+ * Nodes and deltas live in two flat arrays addressed by index. Typing is
+ * merged into the delta before it as it is recorded. The memory the history
+ * uses is the chunks only its slices keep alive (those the text no longer
+ * refers to), and once that exceeds the memory budget, the oldest deltas
+ * are moved to a temporary spill file and only read back when undone to.
+ */
+class UndoHistory
+{
+public:
+    // replace [position, position + length) with text
+    struct Edit
+    {
+        qsizetype position = 0;
+        qsizetype length = 0;
+        TextBuffer text;
+    };
+
+    UndoHistory();
+    ~UndoHistory();
+    UndoHistory(UndoHistory&& other) noexcept;
+    UndoHistory& operator=(UndoHistory&& other) noexcept;
+
+    void record(qsizetype position, const TextBuffer& removed, const TextBuffer& inserted);
+    void close(const TextBuffer& text);
+    void clear();
+
+    QList<Edit> undo();
+    QList<Edit> redo();
+
+    // text: the text the history belongs to, whatever it shares with it is free
+    void setMemoryBudget(qsizetype bytes, const TextBuffer& text);
+    inline qsizetype memoryBudget() const { return m_budget; }
+    qsizetype memoryUsage(const TextBuffer& text) const;
+
+    static constexpr qsizetype DEFAULT_BUDGET = 64 * 1024 * 1024;
+
+private:
+    struct Delta;
+    struct Node;
+
+    bool merge(Delta& last, qsizetype position, const TextBuffer& removed, const TextBuffer& inserted);
+    void fit(const TextBuffer& text);
+    bool spill(qsizetype bytes);
+    bool writeSpill(const TextBuffer& text);
+    TextBuffer readSpill(qint64 offset, qsizetype length) const;
+    TextBuffer removedText(const Delta& delta) const;
+    TextBuffer insertedText(const Delta& delta) const;
+    static qsizetype costOf(const Delta& delta);
+
+    static constexpr qint32 ROOT = 0;
+
+    std::vector<Node> m_nodes;
+    std::vector<Delta> m_deltas;
+    qint32 m_current = ROOT;   // node of the current state
+    bool m_open = false;       // m_current is still receiving deltas
+
+    qsizetype m_budget = DEFAULT_BUDGET;
+    // memory usage when last measured, and the bytes of text recorded since
+    qsizetype m_measured = 0;
+    qsizetype m_recorded = 0;
+    // deltas before this one were considered for spilling already
+    size_t m_spilled = 0;
+    std::unique_ptr<QTemporaryFile> m_spillFile;
+};
+
+#endif // UNDOHISTORY_H
@@ -1,54 +1,47 @@
 #include "vimtextedit.h"
+#include "linenumberarea.h"
 #include <QKeyCombination>
 #include <QKeyEvent>
 #include <QApplication>
 #include <QDebug>
 #include <QStatusBar>
 #include <QFlags>
+#include <QColor>
+#include <QScrollBar>
+#include <QResizeEvent>
+#include <QPainter>
+#include <QFontDatabase>
+#include <QTextBlock>
+#include <QTextLayout>
+#include <algorithm>
+#include <array>
+#include <limits>
 
 #ifdef Q_OS_WIN
     #include <windows.h>
 #elif defined(Q_OS_LINUX)
+    // Xlib's Visual struct would clash with Action::Visual
+    #define Visual XVisual
     #include <X11/XKBlib.h>
     #include <X11/Xlib.h>
+    #undef Visual
+    // Xlib macros clashing with Action::None and QEvent
+    #undef None
+    #undef KeyPress
+    #undef KeyRelease
+    #undef FocusIn
+    #undef FocusOut
 #endif
 
 
-const QHash<QKeyCombination, Action> VimTextEdit::keyToAction = {
-    // Moving
-    {QKeyCombination(Qt::Key_H), Action::Move},
-    {QKeyCombination(Qt::Key_J), Action::Move},
-    {QKeyCombination(Qt::Key_K), Action::Move},
-    {QKeyCombination(Qt::Key_L), Action::Move},
-    {QKeyCombination(Qt::Key_W), Action::Move},
-
-    {QKeyCombination(Qt::Key_B), Action::Move},
-    {QKeyCombination(Qt::Key_E), Action::Move},
-
-    {QKeyCombination(Qt::Key_C), Action::Change},
-    {QKeyCombination(Qt::Key_D), Action::Delete},
-    {QKeyCombination(Qt::Key_X), CharDelete},
-
-    // Switching Modes
-    {QKeyCombination(Qt::Key_CapsLock), Navigate},
-
-    {QKeyCombination(Qt::Key_V), Visual},
-    {QKeyCombination(Qt::Key_V | Qt::ShiftModifier), VisualLine},
-    {QKeyCombination(Qt::Key_V | Qt::ControlModifier), VisualBlock},
-
-    {QKeyCombination(Qt::Key_I), insert},
-    {QKeyCombination(Qt::Key_I | Qt::ShiftModifier), Insert},
-
-    {QKeyCombination(Qt::Key_O), insertLine},
-    {QKeyCombination(Qt::Key_O | Qt::ShiftModifier), InsertLine},
-
-    {QKeyCombination(Qt::Key_A), Action::append},
-    {QKeyCombination(Qt::Key_A | Qt::ShiftModifier), Append}
-};
 
 
 void resetCapsLock()
 {
+    // headless (--batch, benchmarks): there's no keyboard of ours to reset
+    if (QGuiApplication::platformName() == "offscreen")
+        return;
+
 #ifdef Q_OS_WIN
 // Windows: If Caps Lock is on, toggle it off
     if ((GetKeyState(VK_CAPITAL) & 0x0001)!=0)
@@ -72,113 +65,187 @@ void resetCapsLock()
 #endif
 }
 
+/**
+ * @brief text as the document gets it, one char for one char
+ *
+ * QTextCursor::insertText() turns '\r', "\r\n" and the paragraph and frame
+ * separators into a single block break, which would leave the document
+ * shorter than the buffer: they are shown as symbols instead.
+ */
+static QString documentText(const QString& text)
+{
+    auto isBreak = [](QChar ch) {
+        return ch == '\r' || ch == QChar::ParagraphSeparator || ch == QChar(0xFDD0) || ch == QChar(0xFDD1);
+    };
+    // almost always there's none: share the text instead of copying it
+    const auto first = std::find_if(text.cbegin(), text.cend(), isBreak);
+    if (first == text.cend())
+        return text;
+
+    QString shown = text;
+    for (qsizetype i = first - text.cbegin(); i < shown.size(); ++i)
+    {
+        if (!isBreak(shown[i]))
+            continue;
+        shown[i] = shown[i] == '\r' ? QChar(0x240D) : QChar::ReplacementCharacter; // 0x240D: SYMBOL FOR CARRIAGE RETURN
+    }
+    return shown;
+}
+
 VimTextEdit::VimTextEdit(QWidget* parent):
- QTextEdit(parent)
+ QPlainTextEdit(parent)
 {
 
-    // setting font
-    setFontFamily("Cascadia Code");
-    setFontPointSize(14);
+    document()->setUndoRedoEnabled(false);
 
-    // setting cursor width in normal mode
-    QFontMetrics metrics(font());
-    CURSOR_WIDTH_NORMAL = metrics.averageCharWidth() + 4;
+    m_parallelSearch = new ParallelSearch(this);
+    connect(m_parallelSearch, &ParallelSearch::matchesFound,
+            this, &VimTextEdit::addMatches);
+    connect(m_parallelSearch, &ParallelSearch::finished,
+            this, &VimTextEdit::finishSearch);
+    m_substitute = new ParallelSubstitute(this);
+    connect(m_substitute, &ParallelSubstitute::finished,
+            this, &VimTextEdit::applySubstitution);
 
-    updateMode(NORMAL);
-}
+    m_researchTimer = new QTimer(this);
+    m_researchTimer->setSingleShot(true);
+    m_researchTimer->setInterval(RESEARCH_DELAY);
+    connect(m_researchTimer, &QTimer::timeout, this, &VimTextEdit::startSearch);
+    m_highlighter = new SyntaxHighlighter(this);
+    connect(m_highlighter, &SyntaxHighlighter::highlighted,
+            this, &VimTextEdit::applyHighlight);
+    m_highlightTimer = new QTimer(this);
+    m_highlightTimer->setSingleShot(true);
+    m_highlightTimer->setInterval(0);
+    connect(m_highlightTimer, &QTimer::timeout, this, &VimTextEdit::startHighlight);
 
-MoveDir keyToMoveDir(QKeyCombination key) 
-{
-    switch (key)
-    {
-        case Qt::Key_H: return MoveDir::Left;
-        case Qt::Key_J: return MoveDir::Down;
-        case Qt::Key_K: return MoveDir::Up;
-        case Qt::Key_L: return MoveDir::Right;
-        case Qt::Key_W: return MoveDir::NextWord;
-        default:        return MoveDir::NoMove;
-    }
-}
+    connectDocument();
 
+    // only the visible matches and lines are highlighted
+    connect(verticalScrollBar(), &QScrollBar::valueChanged,
+            this, &VimTextEdit::updateHighlights);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged,
+            m_highlightTimer, qOverload<>(&QTimer::start));
 
-void VimTextEdit::Move(QKeyCombination key, QTextCursor::MoveMode mode)
-{
-    auto moveDir = keyToMoveDir(key);
-    if (moveDir != MoveDir::NoMove)
-    {
-        moveCursor(moveDir, mode);
-        return;
-    }
+    // setting font: one fixed pitch font without kerning, so every line is
+    // shaped the same cheap way from a single glyph cache
+    // the system's fixed font stands in if Cascadia Code isn't installed,
+    // rather than a fallback probed for among all the fonts at startup
+    QFont monospace = QFontDatabase::systemFont(QFontDatabase::FixedFont);
+    monospace.setFamilies({"Cascadia Code", monospace.family()});
+    monospace.setPointSize(14);
+    monospace.setStyleHint(QFont::Monospace);
+    monospace.setFixedPitch(true);
+    monospace.setKerning(false);
+    setFont(monospace);
 
-    QChar currCh = currChar(), nextCh = currChar(1);
-    switch (key)
-    {
-        case Qt::Key_E:
-            if ( currCh.isSpace() || currCh.isNull() || nextCh.isSpace() || nextCh.isNull() )
-                moveCursor(MoveDir::NextWord, mode);
+    m_lineNumbers = new LineNumberArea(this);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged,
+            m_lineNumbers, qOverload<>(&QWidget::update));
+    updateLineNumberArea();
 
-            if (nextCh.isNull() || nextCh == '\n')
-                moveCursor(MoveDir::NextWord, mode);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged,
+            this, &VimTextEdit::releaseLayouts);
 
-            moveCursor(MoveDir::EndOfWord, mode);
-            moveCursor(MoveDir::Left, mode);
-            break;
+    // setting cursor width in normal mode
+    QFontMetrics metrics(font());
+    CURSOR_WIDTH_NORMAL = metrics.averageCharWidth() + 4;
 
-        case Qt::Key_B:
-            moveCursor(MoveDir::Left, mode);
-            moveCursor(MoveDir::StartOfWord, mode);
-            break;
-    }
+    updateMode(NORMAL);
 }
 
 void VimTextEdit::keyPressEvent(QKeyEvent* event)
 {
-    QKeyCombination keys = event->keyCombination();
-    QString textEntered = event->text();
+    LatencyProfiler::instance().keyPressed();
+    LatencyScope latency(LatencyProfiler::KeyEvent);
 
-    QChar charPressed = textEntered.isEmpty() ? QChar() : textEntered.at(0);
-    Action action = keyToAction.value(keys);
-
-    if (m_mode == Mode::INSERT && action != Navigate)
+    if (m_exMode)
     {
-        QTextEdit::keyPressEvent(event);
+        editExCommand(event);
         return;
     }
-    else if (charPressed.isDigit())
+
+    const char16_t key = commandKey(event);
+    if (m_mode == Mode::INSERT && key != CommandParser::Escape)
     {
-        updateCount(charPressed);
+        QPlainTextEdit::keyPressEvent(event);
         return;
     }
-    else
+    // modifiers alone and keys without text
+    if (key == 0)
+        return;
+
+    CommandParser::Result result;
     {
-        executeAction(action, keys);
-        // resetting count after action done
-        if (m_count > 1)
-            updateCount('1');
+        LatencyScope parse(LatencyProfiler::Lookup);
+        result = m_parser.feed(key, !normalMode());
     }
+    showPendingCommand(result);
+    if (result == CommandParser::Complete)
+        executeCommand(m_parser.command());
 }
 
-void VimTextEdit::executeAction(Action action, QKeyCombination keys)
+void VimTextEdit::executeCommand(const Command& command)
 {
-    switch (action)
+    LatencyScope latency(LatencyProfiler::Execute);
+
+    // motions still work while a file is loading
+    if (isReadOnly() && isEditing(command.action))
+        return;
+
+    const bool wasInserting = m_mode == Mode::INSERT;
+    // visual changes act on a selection, there's nothing to repeat
+    const bool repeatable = isEditing(command.action) && normalMode() && command.op != Operator::Yank &&
+                            command.action != Action::Repeat && command.action != Action::Undo && command.action != Action::Redo;
+    if (repeatable)
+        m_lastChange = command;
+
+    // however large the count, the command is a single change of the document
+    beginEdit();
+    switch (command.action)
     {
         case Action::Move:
-            if (m_command == Action::Change)
-                Change(keys);
-            else if (m_command == Action::Delete)
-                Delete(keys);
-            else
-                Move(keys);
+            Move(command.motion, command.count);
+            break;
+
+        case Action::Operate:
+            Operate(command);
+            break;
+
+        case Action::CharDelete:
+        {
+            if (!normalMode())
+            {
+                Operate(Command{Action::Operate, Operator::Delete, Motion::None, 0, command.reg});
+                break;
+            }
+            // x stays on its line
+            const int cursor = textCursor().position();
+            const int length = qMin(int(command.countOr(1)), lineEnd(cursor) - cursor);
+            m_registers.remove(command.reg, {m_buffer.mid(cursor, length), false});
+            removeText(cursor, length);
+            setCursorPosition(cursor);
+            break;
+        }
+
+        case Action::ReplaceChar:
+            Replace(command);
             break;
 
         case Action::Navigate:
+            if (wasInserting)
+                finishInsert();
             resetCapsLock(); // reset capslock state
-            updateCommand(Action::None);
             updateMode(Mode::NORMAL);
             break;
 
         case Action::Insert:
-            moveCursor(MoveDir::StartOfLine);
+            if (visualBlockMode())
+            {
+                beginBlockInsert(BlockEdit::Insert);
+                break;
+            }
+            setCursorPosition(lineStart(textCursor().position()));
             updateMode(INSERT);
             break;
 
@@ -188,7 +255,12 @@ void VimTextEdit::executeAction(Action action, QKeyCombination keys)
             break;
 
         case Action::Append:
-            moveCursor(MoveDir::EndOfLine);
+            if (visualBlockMode())
+            {
+                beginBlockInsert(BlockEdit::Append);
+                break;
+            }
+            setCursorPosition(lineEnd(textCursor().position()));
             updateMode(INSERT);
             break;
         
@@ -198,166 +270,2030 @@ void VimTextEdit::executeAction(Action action, QKeyCombination keys)
         case Action::VisualBlock:   updateMode(Mode::VISUAL_BLOCK); break;
         
         case Action::insertLine:
-            moveCursor(MoveDir::EndOfLine);
-            this->insertPlainText("\n");
+        {
+            int end = lineEnd(textCursor().position());
+            insertText(end, "\n");
+            setCursorPosition(end + 1);
             updateMode(INSERT);
             break;
+        }
 
         case Action::InsertLine:
-            moveCursor(MoveDir::StartOfLine);
-            this->insertPlainText("\n");
-            moveCursor(MoveDir::Up);
+        {
+            int start = lineStart(textCursor().position());
+            insertText(start, "\n");
+            setCursorPosition(start);
             updateMode(INSERT);
             break;
+        }
 
-        case Action::Change:
-            if (normalMode())
-                updateCommand(Action::Change);
-            else
-                Change(keys);
+        case Action::CommandLine:
+        {
+            m_exMode = true;
+            m_exCommand.clear();
+            // : on a selection starts with its range, '<,'>
+            if (!normalMode() && m_mode != Mode::INSERT)
+            {
+                const int cursor = textCursor().position();
+                const int anchor = visualBlockMode() ? m_blockAnchor : textCursor().anchor();
+                m_visualFirst = m_buffer.lineAt(qMin(anchor, cursor));
+                m_visualLast = m_buffer.lineAt(qMax(anchor, cursor));
+                m_exCommand = "'<,'>";
+                updateMode(Mode::NORMAL);
+                setCursorPosition(cursor);
+            }
+            emit commandChanged(":" + m_exCommand);
             break;
+        }
 
-        case Action::Delete:
-            if (normalMode())
-                updateCommand(Action::Delete);
-            else
-                Delete(keys);
+        case Action::SearchNext:
+        case Action::SearchPrevious:
+            for (quint32 i = 0; i < command.countOr(1); ++i)
+                findMatch(command.action == Action::SearchPrevious);
             break;
 
-        case Action::CharDelete:
-            Delete(Qt::Key_L);
+        case Action::Repeat:
+            repeatChange(command.count);
+            break;
+
+        case Action::Undo:
+        case Action::Redo:
+            Undo(command.countOr(1), command.action == Action::Redo);
+            break;
+
+        case Action::Put:
+        case Action::PutBefore:
+            Put(command);
             break;
             
         default:
             break;
     }
+    endEdit();
+    // a command is one undo step, together with what is typed after it
+    if (m_mode != Mode::INSERT)
+        m_undo.close(m_buffer);
+
+    // what is typed next belongs to this command
+    if (m_mode == Mode::INSERT && !wasInserting)
+    {
+        m_insertCommand = command;
+        m_insertStart = textCursor().position();
+        m_insertRepeatable = repeatable;
+    }
 }
 
-void VimTextEdit::Change(QKeyCombination key)
+void VimTextEdit::Move(Motion motion, quint32 count)
 {
-    Delete(key);
-    updateMode(Mode::INSERT);
+    // gg and G go to lines of the viewed file, not of the pages shown
+    if (m_view && normalMode() && (motion == Motion::FirstLine || motion == Motion::LastLine))
+    {
+        showFileLine(count ? qsizetype(count) - 1 : motion == Motion::FirstLine ? 0 : -1);
+        return;
+    }
+
+    const int cursor = textCursor().position();
+    const qsizetype goal = goalColumn(cursor);
+    // $ stretches a block to every line's end until the cursor moves sideways
+    if (visualBlockMode())
+        m_blockToLineEnd = motion == Motion::LineEnd ||
+                           (m_blockToLineEnd && (motion == Motion::Down || motion == Motion::Up));
+    // l, j and k may aim at the line break, dl still deletes the last char
+    const int target = motionTarget(motion, count, cursor);
+    setCursorPosition(qMin(target, lastChar(m_buffer.lineAt(target))));
+
+    // j/k remember the column they started from
+    if (motion == Motion::Down || motion == Motion::Up)
+    {
+        m_goalColumn = goal;
+        m_goalPosition = textCursor().position();
+    }
 }
 
-void VimTextEdit::Delete(QKeyCombination key)
+/**
+ * @brief applies the operator of command to its motion, text object or the visual selection
+ */
+void VimTextEdit::Operate(const Command& command)
 {
-    if (normalMode())
-        Move(key, QTextCursor::KeepAnchor);
+    if (visualBlockMode())
+    {
+        OperateBlock(command);
+        return;
+    }
 
-    auto tCursor = textCursor();
-    if (!normalMode())
-        tCursor.movePosition(MoveDir::Right, QTextCursor::KeepAnchor);
-    tCursor.removeSelectedText();
-    setTextCursor(tCursor);
+    bool linewise = false;
+    auto [start, end] = operatorRange(command, linewise);
+
+    // a slice of the buffer, the text itself isn't copied
+    const Registers::Register text{m_buffer.mid(start, end - start), linewise};
+    if (command.op == Operator::Yank)
+    {
+        m_registers.yank(command.reg, text);
+
+        // back to the start of the yanked text (same column for lines)
+        const int from = textCursor().position();
+        updateMode(Mode::NORMAL);
+        setCursorPosition(linewise ? qMin(start + from - lineStart(from), lineEnd(start)) : start);
+        return;
+    }
+    m_registers.remove(command.reg, text);
+
+    if (linewise && command.op == Operator::Delete)
+    {
+        // take the line break along, the one before the range for the last line
+        if (end < m_buffer.length())
+            ++end;
+        else if (start > 0)
+            --start;
+    }
+    removeText(start, end - start);
+
+    // leave visual mode first so the cursor doesn't extend a selection
+    if (command.op == Operator::Change)
+    {
+        updateMode(Mode::INSERT);
+        setCursorPosition(start);
+        return;
+    }
 
-    updateCommand(Action::None);
     updateMode(Mode::NORMAL);
+    setCursorPosition(linewise ? firstNonBlank(m_buffer.lineAt(start)) : start);
 }
 
+/**
+ * @brief remembers the text typed since entering insert mode, repeating it for a count (3ihi, 5o)
+ */
+void VimTextEdit::finishInsert()
+{
+    const int cursor = textCursor().position();
+    QString typed;
+    if (m_insertStart >= 0 && cursor >= m_insertStart)
+        typed = m_buffer.text(m_insertStart, cursor - m_insertStart);
+    m_insertStart = -1;
+    if (m_insertRepeatable)
+        m_lastInsert = typed;
+
+    // the rest of a block gets what was typed on its first line
+    if (m_blockInsertPending)
+    {
+        m_blockInsertPending = false;
+        BlockEdit::Block rest = m_blockInsert;
+        ++rest.firstLine;
+        if (rest.firstLine <= rest.lastLine && !typed.isEmpty() && !typed.contains('\n'))
+        {
+            editBlock(rest, m_blockInsertOperation, typed);
+            setCursorPosition(cursor);
+        }
+        return;
+    }
+
+    if (!isInserting(m_insertCommand.action))
+        return;
+    const quint32 count = m_insertCommand.countOr(1);
+    const bool newLines = m_insertCommand.action == Action::insertLine || m_insertCommand.action == Action::InsertLine;
+    const QString text = newLines ? '\n' + typed : typed;
+    if (count < 2 || text.isEmpty())
+        return;
 
+    // all the copies go in with one edit
+    insertText(cursor, text.repeated(count - 1));
+    setCursorPosition(cursor + int(text.size()) * int(count - 1));
+}
 
-void VimTextEdit::updateCount(QChar countChar)
+/**
+ * @brief repeats the last change (.), count replaces the count it was made with
+ */
+void VimTextEdit::repeatChange(quint32 count)
 {
-    if (m_count != countChar.digitValue())
+    if (m_lastChange.action == Action::None)
+        return;
+    Command command = m_lastChange;
+    if (count)
+        command.count = count;
+    const QString typed = m_lastInsert;
+
+    executeCommand(command);
+    // type the same text again and leave insert mode like Esc would
+    if (m_mode == Mode::INSERT)
     {
-        m_count = countChar.digitValue();
-        emit countChanged("count: " + QString(countChar));
+        const int cursor = textCursor().position();
+        insertText(cursor, typed);
+        setCursorPosition(cursor + int(typed.size()));
+        finishInsert();
+        updateMode(Mode::NORMAL);
     }
 }
 
-void VimTextEdit::updateCommand(Action command)
+/**
+ * @brief undoes (or redoes) count steps, leaving the cursor where the text changed
+ */
+void VimTextEdit::Undo(quint32 count, bool redo)
 {
-    if (command != m_command)
+    qsizetype cursor = -1;
+    for (quint32 i = 0; i < count; ++i)
     {
-        m_command = command;
-        emit commandChanged(commandAsString(command));
+        const QList<UndoHistory::Edit> edits = redo ? m_undo.redo() : m_undo.undo();
+        if (edits.isEmpty())
+            break;
+
+        for (const UndoHistory::Edit& edit : edits)
+        {
+            // the texts are slices of the old buffer, no copy until the document needs one
+            const TextBuffer removed = m_buffer.mid(edit.position, edit.length);
+            m_buffer.remove(edit.position, edit.length);
+            m_buffer.insert(edit.position, edit.text);
+            ++m_revision;
+            bufferChanged(edit.position, removed, edit.text);
+            replaceDocumentText(int(edit.position), int(edit.length), edit.text.toString());
+            cursor = cursor < 0 ? edit.position : qMin(cursor, edit.position);
+        }
     }
+
+    if (cursor >= 0)
+        setCursorPosition(int(cursor));
 }
 
-void VimTextEdit::updateMode(Mode mode)
+/**
+ * @brief puts a register count times after (p) or before (P) the cursor, a selection is replaced
+ */
+void VimTextEdit::Put(const Command& command)
 {
-    if (mode == m_mode)
+    // a copy, replacing a selection overwrites the unnamed register
+    const Registers::Register reg = m_registers.get(command.reg);
+    if (reg.text.isEmpty() && !reg.linewise)
         return;
-    m_mode = mode;
 
-    static int cursorFlashTime = QApplication::cursorFlashTime();
-    
-    switch (m_mode)
+    bool before = command.action == Action::PutBefore;
+    if (!normalMode())
     {
-        case Mode::NORMAL:
-            // disable cursor blinking in normal mode
-            QApplication::setCursorFlashTime(0);
+        Operate(Command{Action::Operate, Operator::Delete});
+        before = true;
+    }
 
-            moveCursor(MoveDir::Left);
-            setCursorWidth(CURSOR_WIDTH_NORMAL);
-            break;
+    // all the copies go in with one edit
+    TextBuffer text;
+    for (quint32 i = 0; i < command.countOr(1); ++i)
+    {
+        if (reg.linewise && i > 0)
+            text.append("\n");
+        text.insert(text.length(), reg.text);
+    }
 
-        case Mode::INSERT:
-            // enable cursor blinking in insert mode
-            QApplication::setCursorFlashTime(cursorFlashTime);
+    const int cursor = textCursor().position();
+    if (!reg.linewise)
+    {
+        const int position = before || cursor == lineEnd(cursor) ? cursor : cursor + 1;
+        insertText(position, text);
+        setCursorPosition(position + int(text.length()) - 1);
+        return;
+    }
 
-            setCursorWidth(CURSOR_WIDTH_INSERT);
-            break;
+    // lines go above or below the cursor's line
+    qsizetype line = m_buffer.lineAt(cursor);
+    if (before)
+    {
+        text.append("\n");
+        insertText(lineStart(cursor), text);
+    }
+    else
+    {
+        text.insert(0, QString("\n"));
+        insertText(lineEnd(cursor), text);
+        ++line;
+    }
+    setCursorPosition(firstNonBlank(line));
+}
 
-        case Mode::VISUAL:
-        case Mode::VISUAL_LINE:
-        case Mode::VISUAL_BLOCK:
-            setCursorWidth(CURSOR_WIDTH_NORMAL);
-            break;
+/**
+ * @brief r: replaces count chars (or the selection) with the typed char
+ */
+void VimTextEdit::Replace(const Command& command)
+{
+    const QChar ch(command.ch);
+    if (visualBlockMode())
+    {
+        const BlockEdit::Block block = blockSelection();
+        editBlock(block, BlockEdit::Replace, QStringView(&ch, 1));
+        updateMode(Mode::NORMAL);
+        setCursorPosition(int(m_buffer.lineStart(block.firstLine) + block.firstColumn));
+        return;
     }
-    // emit mode changed signal
-    emit modeChanged("-- " + modeAsString(m_mode) + " --");
+
+    int start = textCursor().position();
+    int end = start + int(command.countOr(1));
+    if (!normalMode())
+    {
+        bool linewise = false;
+        const auto selection = operatorRange(Command{Action::Operate}, linewise);
+        start = selection.first;
+        end = selection.second;
+    }
+    // not enough chars left on the line
+    else if (end > lineEnd(start))
+    {
+        return;
+    }
+
+    QString text = m_buffer.text(start, end - start);
+    if (normalMode() && ch == '\r')
+    {
+        // r<Enter> breaks the line
+        text = "\n";
+    }
+    else
+    {
+        // line breaks in a selection stay
+        for (QChar& c : text)
+            if (c != '\n')
+                c = ch;
+    }
+    replaceText(start, end - start, text);
+
+    const bool visual = !normalMode();
+    updateMode(Mode::NORMAL);
+    setCursorPosition(visual ? start : start + int(text.size()) - 1);
 }
 
-void VimTextEdit::moveCursor(MoveDir operation, QTextCursor::MoveMode mode)
+/**
+ * @brief d/c/y/x on a visual block, each as one edit of all its lines
+ */
+void VimTextEdit::OperateBlock(const Command& command)
 {
-    if (visualMode() || visualLineMode() || visualBlockMode())
-        mode = QTextCursor::KeepAnchor;
-    auto c = textCursor();
-    c.movePosition(operation, mode, m_count);
-    setTextCursor(c);
+    const BlockEdit::Block block = blockSelection();
+    const qsizetype top = m_buffer.lineStart(block.firstLine);
+    const int topLeft = int(qMin(top + block.firstColumn, m_buffer.lineEnd(block.firstLine)));
+
+    // registers have no block type, the block is stored a line per row
+    const Registers::Register text{TextBuffer(BlockEdit::text(m_buffer, block)), false};
+    if (command.op == Operator::Yank)
+    {
+        m_registers.yank(command.reg, text);
+        updateMode(Mode::NORMAL);
+        setCursorPosition(topLeft);
+        return;
+    }
+
+    m_registers.remove(command.reg, text);
+    editBlock(block, BlockEdit::Delete);
+    if (command.op != Operator::Change)
+    {
+        updateMode(Mode::NORMAL);
+        setCursorPosition(topLeft);
+        return;
+    }
+
+    // typing replaces the deleted columns on every line
+    updateMode(Mode::INSERT);
+    setCursorPosition(topLeft);
+    m_blockInsert = block;
+    m_blockInsert.toLineEnd = false;
+    m_blockInsertOperation = BlockEdit::Insert;
+    m_blockInsertPending = true;
 }
 
-QString VimTextEdit::modeAsString(Mode mode)
+/**
+ * @brief block I/A: insert mode on the block's first line, the rest follows when it ends
+ */
+void VimTextEdit::beginBlockInsert(BlockEdit::Operation operation)
 {
-    switch (mode)
+    const BlockEdit::Block block = blockSelection();
+    const qsizetype start = m_buffer.lineStart(block.firstLine);
+    const qsizetype length = m_buffer.lineEnd(block.firstLine) - start;
+
+    qsizetype column = qMin(block.firstColumn, length);
+    if (operation == BlockEdit::Append)
     {
-        case Mode::INSERT:       return "INSERT";
-        case Mode::VISUAL:       return "VISUAL";
-        case Mode::VISUAL_LINE:  return "VISUAL LINE";
-        case Mode::VISUAL_BLOCK: return "VISUAL BLOCK";
-        default:                 return "NORMAL";
+        column = block.toLineEnd ? length : block.lastColumn + 1;
+        // a short first line is padded like the others will be
+        if (length < column)
+            insertText(int(start + length), QString(column - length, ' '));
     }
+
+    updateMode(Mode::INSERT);
+    setCursorPosition(int(start + column));
+    m_blockInsert = block;
+    m_blockInsertOperation = operation;
+    m_blockInsertPending = true;
+}
+
+/**
+ * @brief applies a block operation to all the block's lines with a single edit
+ */
+void VimTextEdit::editBlock(const BlockEdit::Block& block, BlockEdit::Operation operation, QStringView text)
+{
+    const int start = int(m_buffer.lineStart(block.firstLine));
+    const int end = int(m_buffer.lineEnd(block.lastLine));
+    replaceText(start, end - start, BlockEdit::apply(m_buffer, block, operation, text));
 }
+// --------------
 
-QString VimTextEdit::commandAsString(Action command)
+// Motions & Ranges
+// --------------
+/**
+ * @brief where motion moves the cursor from 'from', count is 0 if none was given
+ *
+ * Counts are handled by the motions themselves (a counted word motion is
+ * one scan, a counted line motion one index lookup).
+ */
+int VimTextEdit::motionTarget(Motion motion, quint32 count, int from) const
 {
-    switch (command)
+    const qsizetype n = qsizetype(qMax(1u, count));
+    const qsizetype line = m_buffer.lineAt(from);
+    const qsizetype lastLine = m_buffer.lineCount() - 1;
+
+    auto wordMotion = [&](WordMotion::Motion wordMotion, bool bigWord) {
+        return int(WordMotion::move(m_buffer, from, wordMotion, bigWord, int(qMin(n, qsizetype(INT_MAX)))));
+    };
+
+    switch (motion)
     {
-        case Action::Delete:
-            return "d";
-        case Action::Change:
-            return "c";
+        case Motion::Left:  return int(qMax(m_buffer.lineStart(line), from - n));
+        case Motion::Right: return int(qMin(m_buffer.lineEnd(line), from + n));
+
+        case Motion::Down:
+        case Motion::Up:
+        {
+            const qsizetype target = qBound(qsizetype(0), motion == Motion::Down ? line + n : line - n, lastLine);
+            const qsizetype start = m_buffer.lineStart(target);
+            return int(start + qMin(goalColumn(from), m_buffer.lineEnd(target) - start));
+        }
+
+        case Motion::WordStart:      return wordMotion(WordMotion::NextWordStart, false);
+        case Motion::WordEnd:        return wordMotion(WordMotion::NextWordEnd, false);
+        case Motion::WordBack:       return wordMotion(WordMotion::PrevWordStart, false);
+        case Motion::WordEndBack:    return wordMotion(WordMotion::PrevWordEnd, false);
+        case Motion::BigWordStart:   return wordMotion(WordMotion::NextWordStart, true);
+        case Motion::BigWordEnd:     return wordMotion(WordMotion::NextWordEnd, true);
+        case Motion::BigWordBack:    return wordMotion(WordMotion::PrevWordStart, true);
+        case Motion::BigWordEndBack: return wordMotion(WordMotion::PrevWordEnd, true);
+
+        case Motion::LineStart:     return int(m_buffer.lineStart(line));
+        case Motion::FirstNonBlank: return firstNonBlank(line);
+        // 3$ is the last char of the second line down
+        case Motion::LineEnd:       return lastChar(qMin(line + n - 1, lastLine));
+
+        case Motion::FirstLine: return firstNonBlank(count ? qsizetype(count) - 1 : 0);
+        case Motion::LastLine:  return firstNonBlank(count ? qsizetype(count) - 1 : lastLine);
+
         default:
-            return "No Command";
+            return from;
     }
 }
 
+/**
+ * @brief [start, end) an operator works on
+ *
+ * @param linewise set if whole lines are affected
+ */
+std::pair<int, int> VimTextEdit::operatorRange(const Command& command, bool& linewise) const
+{
+    const QTextCursor cursor = textCursor();
+    const int from = cursor.position();
+    int start = from;
+    int end = from;
+
+    if (!normalMode())
+    {
+        // visual selections include the char under the cursor
+        start = cursor.selectionStart();
+        end = qMin(cursor.selectionEnd() + 1, int(m_buffer.length()));
+        linewise = visualLineMode();
+    }
+    else if (command.motion >= Motion::InnerWord)
+    {
+        return textObjectRange(command.motion, command.countOr(1), from);
+    }
+    else if (command.motion == Motion::WholeLine)
+    {
+        linewise = true;
+        end = int(m_buffer.lineStart(m_buffer.lineAt(from) + qsizetype(command.countOr(1)) - 1));
+    }
+    else
+    {
+        Motion motion = command.motion;
+        // cw on a word changes up to its end, like ce
+        if (command.op == Operator::Change && !WordMotion::isBlank(WordMotion::classOf(m_buffer.at(from))))
+        {
+            if (motion == Motion::WordStart)
+                motion = Motion::WordEnd;
+            else if (motion == Motion::BigWordStart)
+                motion = Motion::BigWordEnd;
+        }
+
+        const int target = motionTarget(motion, command.count, from);
+        start = qMin(from, target);
+        end = qMax(from, target);
+        linewise = isLinewise(motion);
+        // d$ on an empty line has no char to include, the line break stays
+        if (isInclusive(motion) && end < m_buffer.length() && m_buffer.at(end) != '\n')
+            ++end;
 
+        // dw on the last word of a line stops at the line end
+        if ((motion == Motion::WordStart || motion == Motion::BigWordStart) &&
+            m_buffer.lineAt(end) > m_buffer.lineAt(from))
+            end = qMax(from, int(m_buffer.lineEnd(m_buffer.lineAt(end) - 1)));
+    }
+
+    if (linewise)
+    {
+        start = lineStart(start);
+        end = lineEnd(end);
+    }
+    return {start, end};
+}
 
 /**
- * @brief current char that cursor is on (the character which will be deleted if backspace clicked)
- * 
- * @param offset 1 right char, -1 left char, 0 current char (default) and so on..
- * @return QChar 
+ * @brief [start, end) of count iw/aw/iW/aW objects at 'from' (within its line)
  */
-QChar VimTextEdit::currChar(int offset) const
+std::pair<int, int> VimTextEdit::textObjectRange(Motion object, quint32 count, int from) const
 {
-    int pos = textCursor().position() + offset;
-    QString text = this->toPlainText();
+    const bool bigWord = object == Motion::InnerBigWord || object == Motion::AroundBigWord;
+    const bool around = object == Motion::AroundWord || object == Motion::AroundBigWord;
+    const qsizetype first = lineStart(from);
+    const qsizetype last = lineEnd(from);
+    if (first == last)
+        return {from, from};
 
-    if (pos < text.length() && pos >= 0)
-        return this->toPlainText().at(pos);
-    else
-        return QChar();
+    auto classAt = [&](qsizetype pos) { return WordMotion::classOf(m_buffer.at(pos), bigWord); };
+    auto runEnd = [&](qsizetype pos) {
+        const WordMotion::CharClass cls = classAt(pos);
+        while (pos < last && classAt(pos) == cls)
+            ++pos;
+        return pos;
+    };
+
+    // the run the cursor is in, then one more run per count
+    const WordMotion::CharClass cls = classAt(from);
+    qsizetype start = from;
+    while (start > first && classAt(start - 1) == cls)
+        --start;
+    qsizetype end = runEnd(from);
+    for (quint32 i = 1; i < count && end < last; ++i)
+        end = runEnd(end);
+
+    if (around)
+    {
+        // a word takes its trailing blanks (or the leading ones), blanks take the next word
+        if (WordMotion::isBlank(cls) || (end < last && classAt(end) == WordMotion::Blank))
+        {
+            if (end < last)
+                end = runEnd(end);
+        }
+        else
+        {
+            while (start > first && classAt(start - 1) == WordMotion::Blank)
+                --start;
+        }
+    }
+    return {int(start), int(end)};
+}
+// --------------
+
+
+
+/**
+ * @brief searches the pattern from the cursor on, n/N repeat the search
+ *
+ * All matches are collected in the background, the visible ones first, and
+ * the cursor jumps to the first one after it as soon as it is found.
+ */
+void VimTextEdit::search(const QString& pattern, SearchOptions options)
+{
+    m_search = SearchEngine(pattern, options);
+    if (!m_search.isValid())
+    {
+        m_parallelSearch->cancel();
+        m_researchTimer->stop();
+        m_matches.clear();
+        m_wrappedMatches.clear();
+        updateHighlights();
+        if (!m_search.errorString().isEmpty())
+            emit commandChanged("Invalid pattern: " + m_search.errorString());
+        return;
+    }
+
+    m_jumpPending = true;
+    startSearch();
+}
+
+void VimTextEdit::findMatch(bool backward)
+{
+    if (!m_search.isValid())
+        return;
+
+    const int cursor = textCursor().position();
+    SearchMatch match;
+    if (m_view)
+    {
+        // the pages shown first, then the rest of the file page by page
+        match = backward ? m_search.findPrevious(m_buffer, cursor)
+                         : m_search.findNext(m_buffer, cursor + 1);
+        if (match.isValid())
+            jumpToMatch(match);
+        else
+            findInView(backward);
+        return;
+    }
+    if (m_searchComplete && m_searchRevision == m_revision)
+    {
+        if (m_matches.isEmpty())
+        {
+            emit commandChanged("Pattern not found: " + m_search.pattern());
+            return;
+        }
+        // binary search in the collected matches, wrapping around
+        auto next = std::upper_bound(m_matches.cbegin(), m_matches.cend(), qsizetype(cursor),
+                                     [](qsizetype pos, const SearchMatch& m) { return pos < m.position; });
+        if (backward)
+        {
+            auto prev = std::lower_bound(m_matches.cbegin(), m_matches.cend(), qsizetype(cursor),
+                                         [](const SearchMatch& m, qsizetype pos) { return m.position < pos; });
+            match = prev == m_matches.cbegin() ? m_matches.last() : *(prev - 1);
+        }
+        else
+            match = next == m_matches.cend() ? m_matches.first() : *next;
+    }
+    else
+    {
+        // the search is still running (or stale): scan from the cursor
+        match = backward ? m_search.findPrevious(m_buffer, cursor)
+                         : m_search.findNext(m_buffer, cursor + 1);
+        // wrap around
+        if (!match.isValid())
+            match = backward ? m_search.findPrevious(m_buffer, m_buffer.length())
+                             : m_search.findNext(m_buffer, 0);
+    }
+
+    if (!match.isValid())
+    {
+        emit commandChanged("Pattern not found: " + m_search.pattern());
+        return;
+    }
+
+    jumpToMatch(match);
+}
+
+void VimTextEdit::jumpToMatch(const SearchMatch& match)
+{
+    setCursorPosition(int(match.position));
+    updateHighlights();
+}
+
+/**
+ * @brief (re)starts collecting the matches of the current search
+ */
+void VimTextEdit::startSearch()
+{
+    m_researchTimer->stop();
+    m_matches.clear();
+    m_wrappedMatches.clear();
+    m_searchComplete = false;
+    m_searchRevision = m_revision;
+    m_searchFrom = firstVisiblePosition();
+    // a cursor above the viewport must not miss the matches in between
+    if (m_jumpPending)
+        m_searchFrom = qMin(m_searchFrom, qsizetype(textCursor().position()));
+    m_parallelSearch->start(m_buffer, m_search, m_searchFrom);
+}
+
+/**
+ * @brief receives the matches in scan order: from the viewport to the end, then from the start
+ */
+void VimTextEdit::addMatches(const QList<SearchMatch>& matches)
+{
+    if (m_searchRevision != m_revision)
+        return;
+
+    const int cursor = textCursor().position();
+    for (const SearchMatch& match : matches)
+    {
+        if (match.position >= m_searchFrom && m_wrappedMatches.isEmpty())
+            m_matches.append(match);
+        else
+            m_wrappedMatches.append(match);
+
+        if (m_jumpPending && match.position > cursor)
+        {
+            m_jumpPending = false;
+            setCursorPosition(int(match.position));
+        }
+    }
+    updateHighlights();
+}
+
+void VimTextEdit::finishSearch(qsizetype matchCount)
+{
+    if (m_searchRevision != m_revision)
+        return;
+
+    m_wrappedMatches.append(m_matches);
+    m_matches.swap(m_wrappedMatches);
+    m_wrappedMatches.clear();
+    m_searchComplete = true;
+
+    bool searchFile = false;
+    if (m_jumpPending)
+    {
+        m_jumpPending = false;
+        // nothing after the cursor: a viewed file goes on past the pages shown
+        if (m_view)
+            searchFile = true;
+        // else wrap around to the first match
+        else if (!m_matches.isEmpty())
+            setCursorPosition(int(m_matches.first().position));
+    }
+    updateHighlights();
+
+    // a viewed file's matches aren't counted, the window holds only some of them
+    if (searchFile)
+        findInView(false);
+    else if (m_view)
+        return;
+    else if (matchCount == 0)
+        emit commandChanged("Pattern not found: " + m_search.pattern());
+    else
+        emit commandChanged(QString::number(matchCount) + " matches");
+}
+
+/**
+ * @brief highlights the matches inside the viewport, the one under the cursor stronger
+ *
+ * Only a screenful of extra selections is ever built, so highlighting stays
+ * cheap however many matches the document has.
+ */
+void VimTextEdit::updateHighlights()
+{
+    QList<QTextEdit::ExtraSelection> selections;
+    if (m_search.isValid() && m_searchRevision == m_revision)
+    {
+        const qsizetype from = firstVisiblePosition();
+        const qsizetype to = lastVisiblePosition();
+        const int cursor = textCursor().position();
+
+        auto addVisible = [&](const QList<SearchMatch>& matches) {
+            // matches never overlap, so they're sorted by their end too
+            auto it = std::upper_bound(matches.cbegin(), matches.cend(), from,
+                                       [](qsizetype pos, const SearchMatch& m) { return pos < m.end(); });
+            for (; it != matches.cend() && it->position <= to; ++it)
+            {
+                QTextEdit::ExtraSelection selection;
+                selection.cursor = QTextCursor(document());
+                selection.cursor.setPosition(int(it->position));
+                selection.cursor.setPosition(int(it->end()), QTextCursor::KeepAnchor);
+                selection.format.setBackground(it->position == cursor ? QColor(255, 150, 0, 160)
+                                                                      : QColor(255, 200, 0, 90));
+                selections.append(selection);
+            }
+        };
+        addVisible(m_matches);
+        addVisible(m_wrappedMatches);
+    }
+
+    // the visible rows of a visual block
+    if (visualBlockMode())
+    {
+        const BlockEdit::Block block = blockSelection();
+        const qsizetype first = qMax(block.firstLine, m_buffer.lineAt(firstVisiblePosition()));
+        const qsizetype last = qMin(block.lastLine, m_buffer.lineAt(lastVisiblePosition()));
+        const QColor color = palette().highlight().color();
+        for (qsizetype line = first; line <= last; ++line)
+        {
+            const qsizetype start = m_buffer.lineStart(line);
+            const qsizetype end = m_buffer.lineEnd(line);
+            const qsizetype from = qMin(start + block.firstColumn, end);
+            const qsizetype to = block.toLineEnd ? end : qMin(start + block.lastColumn + 1, end);
+            if (from == to)
+                continue;
+
+            QTextEdit::ExtraSelection selection;
+            selection.cursor = QTextCursor(document());
+            selection.cursor.setPosition(int(from));
+            selection.cursor.setPosition(int(to), QTextCursor::KeepAnchor);
+            selection.format.setBackground(color);
+            selection.format.setForeground(palette().highlightedText());
+            selections.append(selection);
+        }
+    }
+    setExtraSelections(selections);
+}
+
+BlockEdit::Block VimTextEdit::blockSelection() const
+{
+    return BlockEdit::blockOf(m_buffer, m_blockAnchor, textCursor().position(), m_blockToLineEnd);
+}
+
+int VimTextEdit::firstVisiblePosition() const
+{
+    return firstVisibleBlock().position();
+}
+
+int VimTextEdit::lastVisiblePosition() const
+{
+    const QRect area = viewport()->rect();
+    return cursorForPosition(area.bottomRight()).position();
+}
+
+void VimTextEdit::paintEvent(QPaintEvent* event)
+{
+    {
+        LatencyScope latency(LatencyProfiler::Paint);
+        QPlainTextEdit::paintEvent(event);
+    }
+    LatencyProfiler& profiler = LatencyProfiler::instance();
+    profiler.painted();
+
+    // startup is over once there's text on screen
+    if (!m_textPainted && !isEmpty())
+    {
+        m_textPainted = true;
+        profiler.record(LatencyProfiler::FirstPaint, 0, profiler.now());
+        emit textPainted();
+    }
+}
+
+void VimTextEdit::resizeEvent(QResizeEvent* event)
+{
+    QPlainTextEdit::resizeEvent(event);
+
+    const QRect area = contentsRect();
+    m_lineNumbers->setGeometry(area.left(), area.top(), lineNumberAreaWidth(), area.height());
+    updateHighlights();
+    releaseLayouts();
+    m_highlightTimer->start();
+}
+
+/**
+ * @brief drops the layouts of lines that scrolled out of the viewport and its margin
+ *
+ * QPlainTextEdit lays lines out when they're shown but keeps the layouts;
+ * they are rebuilt on demand if the lines come back.
+ */
+void VimTextEdit::releaseLayouts()
+{
+    const int first = firstVisibleBlock().blockNumber();
+    const int rows = viewport()->height() / qMax(1, fontMetrics().height()) + 1;
+    const int keepFirst = qMax(0, first - LAYOUT_MARGIN);
+    const int keepLast = first + rows + LAYOUT_MARGIN;
+
+    if (m_layoutLast >= m_layoutFirst)
+    {
+        QTextBlock block = document()->findBlockByNumber(m_layoutFirst);
+        for (int number = m_layoutFirst; block.isValid() && number <= m_layoutLast; ++number, block = block.next())
+            if (number < keepFirst || number > keepLast)
+                block.clearLayout();
+    }
+    m_layoutFirst = keepFirst;
+    m_layoutLast = keepLast;
+}
+
+// Line Numbers
+// --------------
+int VimTextEdit::lineNumberAreaWidth() const
+{
+    const qsizetype lines = m_view ? qMax(m_view->lineCount(), m_viewFirstLine + m_buffer.lineCount())
+                                   : m_buffer.lineCount();
+    const int digits = qMax(3, int(QString::number(lines).size()));
+    return digits * fontMetrics().horizontalAdvance('9') + 2 * LINE_NUMBER_PADDING;
+}
+
+void VimTextEdit::updateLineNumberArea()
+{
+    const int width = lineNumberAreaWidth();
+    if (viewportMargins().left() != width)
+    {
+        setViewportMargins(width, 0, 0, 0);
+        const QRect area = contentsRect();
+        m_lineNumbers->setGeometry(area.left(), area.top(), width, area.height());
+    }
+    m_lineNumbers->update();
+}
+
+/**
+ * @brief paints the numbers of the visible lines
+ *
+ * Only the first visible line number is looked up (O(log n) in the line
+ * index), the following ones are counted from it.
+ */
+void VimTextEdit::paintLineNumbers(QPaintEvent* event)
+{
+    QPainter painter(m_lineNumbers);
+    painter.fillRect(event->rect(), palette().color(QPalette::AlternateBase));
+    painter.setPen(palette().color(QPalette::PlaceholderText));
+
+    const int width = m_lineNumbers->width() - LINE_NUMBER_PADDING;
+    const int height = fontMetrics().height();
+
+    // geometry of the visible blocks only, they are laid out anyway
+    QTextBlock block = firstVisibleBlock();
+    qsizetype line = m_buffer.lineAt(block.position());
+    // a viewed file's lines are numbered once the pages before the window are counted
+    if (m_view)
+    {
+        if (m_viewFirstLine < 0)
+            return;
+        line += m_viewFirstLine;
+    }
+    const QPointF offset = contentOffset();
+    for (; block.isValid(); block = block.next(), ++line)
+    {
+        const QRectF rect = blockBoundingGeometry(block).translated(offset);
+        if (rect.top() > event->rect().bottom())
+            break;
+        if (rect.bottom() >= event->rect().top())
+            painter.drawText(0, int(rect.top()), width, height, Qt::AlignRight, QString::number(line + 1));
+    }
+}
+// --------------
+
+// Syntax Highlighting
+// --------------
+static const QTextCharFormat& tokenFormat(SyntaxTokenizer::Token token)
+{
+    static const std::array<QTextCharFormat, 6> formats = [] {
+        std::array<QTextCharFormat, 6> formats;
+        formats[SyntaxTokenizer::Keyword].setForeground(QColor(0x3b, 0x7d, 0xd8));
+        formats[SyntaxTokenizer::Keyword].setFontWeight(QFont::Bold);
+        formats[SyntaxTokenizer::Number].setForeground(QColor(0xb5, 0x65, 0x1d));
+        formats[SyntaxTokenizer::String].setForeground(QColor(0x2e, 0x9d, 0x5b));
+        formats[SyntaxTokenizer::Comment].setForeground(QColor(0x80, 0x80, 0x80));
+        formats[SyntaxTokenizer::Comment].setFontItalic(true);
+        formats[SyntaxTokenizer::Preprocessor].setForeground(QColor(0xa6, 0x4c, 0xa6));
+        return formats;
+    }();
+    return formats[token];
+}
+
+void VimTextEdit::setLanguage(SyntaxTokenizer::Language language)
+{
+    m_highlighter->setLanguage(language);
+    m_highlightTimer->start();
+}
+
+/**
+ * @brief asks for the tokens of the lines in view
+ */
+void VimTextEdit::startHighlight()
+{
+    const qsizetype first = firstVisibleBlock().blockNumber();
+    const qsizetype last = cursorForPosition(viewport()->rect().bottomLeft()).blockNumber();
+    m_highlighter->update(m_buffer, m_revision, first, last);
+}
+
+/**
+ * @brief sets the tokens of the lines in view as their layouts' formats
+ *
+ * Only lines whose formats changed are laid out again, and tokens of an
+ * older text are dropped: a newer update is on its way.
+ */
+void VimTextEdit::applyHighlight(quint64 revision, qsizetype firstLine, const QList<SyntaxHighlighter::Spans>& lines)
+{
+    if (revision != m_revision)
+        return;
+
+    QList<QTextLayout::FormatRange> formats;
+    QTextBlock block = document()->findBlockByNumber(int(firstLine));
+    for (qsizetype i = 0; i < lines.size() && block.isValid(); ++i, block = block.next())
+    {
+        formats.clear();
+        for (const SyntaxTokenizer::Span& span : lines[i])
+            formats.append(QTextLayout::FormatRange{span.start, span.length, tokenFormat(span.token)});
+
+        QTextLayout* layout = block.layout();
+        if (layout->formats() == formats)
+            continue;
+        layout->setFormats(formats);
+        document()->markContentsDirty(block.position(), block.length());
+    }
+}
+
+// --------------
+
+// Buffers
+// --------------
+/**
+ * @brief shows the buffer held by state, leaving the one shown so far in state
+ *
+ * The text is a snapshot and the document is kept laid out, so showing a
+ * parked buffer only swaps them; an evicted document is rebuilt from the
+ * text first.
+ */
+void VimTextEdit::swapBuffer(BufferState& state)
+{
+    // what was typed so far stays in the buffer it was typed in, as one undo step;
+    // a switch isn't an Escape key press, only the mode goes back to normal
+    if (m_mode == Mode::INSERT)
+        finishInsert();
+    m_undo.close(m_buffer);
+    m_parser.reset();
+    updateMode(Mode::NORMAL);
+
+    const qsizetype undoBudget = m_undo.memoryBudget();
+    std::swap(m_buffer, state.text);
+    std::swap(m_revision, state.revision);
+    std::swap(m_undo, state.undo);
+    m_undo.setMemoryBudget(undoBudget, m_buffer);
+
+    const int cursor = textCursor().position();
+    const int scroll = verticalScrollBar()->value();
+    QTextDocument* shown = document();
+    QTextDocument* next = state.document;
+    if (!next)
+    {
+        next = new QTextDocument(this);
+        next->setDocumentLayout(new QPlainTextDocumentLayout(next));
+        next->setUndoRedoEnabled(false);
+        next->setDefaultFont(font());
+        next->setPlainText(documentText(m_buffer.toString()));
+    }
+
+    // setDocument() deletes a document its text control owns, the parked one must survive
+    shown->setParent(this);
+    disconnect(shown, nullptr, this, nullptr);
+    setDocument(next);
+    connectDocument();
+    state.document = shown;
+
+    setCursorPosition(qBound(0, state.cursor, int(m_buffer.length())));
+    verticalScrollBar()->setValue(state.scroll);
+    state.cursor = cursor;
+    state.scroll = scroll;
+
+    // the line states and the matches were those of the other text
+    const SyntaxTokenizer::Language language = m_highlighter->language();
+    m_highlighter->cancel();
+    m_highlighter->reset();
+    m_highlighter->setLanguage(state.language);
+    state.language = language;
+    m_highlightTimer->start();
+
+    m_parallelSearch->cancel();
+    m_jumpPending = false;
+    if (m_search.isValid())
+        startSearch();
+    // a substitution was matched on the other text, the marks are of its lines
+    m_substitute->cancel();
+    m_visualFirst = m_visualLast = -1;
+
+    m_layoutFirst = 0;
+    m_layoutLast = -1;
+    updateLineNumberArea();
+    updateHighlights();
+}
+
+/**
+ * @brief makes the edits recovered from a journal again, as one undo step
+ */
+void VimTextEdit::replayEdits(const QList<EditJournal::Edit>& edits)
+{
+    int cursor = textCursor().position();
+    beginEdit();
+    for (const EditJournal::Edit& edit : edits)
+    {
+        // clamped, a journal is only checked against the size of its file
+        const int position = int(qBound(qsizetype(0), edit.position, m_buffer.length()));
+        const int length = int(qBound(qsizetype(0), edit.removed, m_buffer.length() - position));
+        replaceText(position, length, edit.text);
+        cursor = position + int(edit.text.size());
+    }
+    endEdit();
+    m_undo.close(m_buffer);
+    setCursorPosition(qMin(cursor, int(m_buffer.length())));
+}
+// --------------
+
+// View
+// --------------
+/**
+ * @brief shows filename read-only, a few pages at a time, following its end like tail -f if follow is set
+ */
+bool VimTextEdit::openView(const QString& filename, bool follow, QString& error)
+{
+    auto view = new PagedFile(filename, this);
+    if (!view->open(error))
+    {
+        delete view;
+        return false;
+    }
+    delete m_view;
+    m_view = view;
+
+    connect(m_view, &PagedFile::indexProgressed, this, [this] {
+        if (m_viewFirstLine < 0)
+            m_viewFirstLine = m_view->firstLine(m_viewFirst);
+        if (m_viewPendingLine >= 0 && (m_view->pageOfLine(m_viewPendingLine) >= 0 || m_view->isIndexed()))
+            showFileLine(m_viewPendingLine);
+        updateLineNumberArea();
+    });
+    connect(m_view, &PagedFile::grown, this, &VimTextEdit::viewGrown);
+    connect(m_view, &PagedFile::truncated, this, [this] {
+        showPages(m_view->isFollowing() ? m_view->pageCount() : 0);
+        if (m_view->isFollowing())
+            goToLine(m_buffer.lineCount() - 1);
+        else
+            setCursorPosition(0);
+        emit commandChanged("\"" + m_view->filename() + "\" was truncated, reading it again");
+    });
+    connect(m_view, &PagedFile::found, this, &VimTextEdit::viewFound);
+    connect(m_view, &PagedFile::notFound, this, &VimTextEdit::viewNotFound);
+    connect(this, &QPlainTextEdit::cursorPositionChanged, this, &VimTextEdit::slideView, Qt::UniqueConnection);
+    connect(verticalScrollBar(), &QScrollBar::valueChanged, this, &VimTextEdit::slideView, Qt::UniqueConnection);
+
+    // nothing of the file is edited, so nothing is recorded
+    m_journal = nullptr;
+    m_viewPendingLine = -1;
+    showPages(follow ? m_view->pageCount() : 0);
+    setCursorPosition(0);
+    if (follow)
+        setFollowing(true);
+    return true;
+}
+
+/**
+ * @brief the cursor to line of the viewed file (0 based), the last one for -1
+ *
+ * A line that isn't counted yet is gone to once it is.
+ */
+void VimTextEdit::showFileLine(qsizetype line)
+{
+    if (!m_view)
+    {
+        goToLine(line < 0 ? m_buffer.lineCount() - 1 : qMin(line, m_buffer.lineCount() - 1));
+        return;
+    }
+
+    const int page = line < 0 ? m_view->pageCount() - 1 : m_view->pageOfLine(line);
+    if (page < 0 && !m_view->isIndexed())
+    {
+        m_viewPendingLine = line;
+        emit commandChanged(QString("Counting lines (%1%)...").arg(m_view->indexedPercent()));
+        return;
+    }
+    m_viewPendingLine = -1;
+    // past the last line
+    if (page < 0)
+    {
+        showFileLine(-1);
+        return;
+    }
+
+    // the line may start on the page after the one it was counted in
+    const int windowEnd = m_viewFirst + int(m_viewPageStarts.size());
+    if (page < m_viewFirst || (page + 1 >= windowEnd && windowEnd < m_view->pageCount()))
+        showPages(page - VIEW_PAGES / 2);
+
+    if (line < 0 || m_viewFirstLine < 0)
+        goToLine(m_buffer.lineCount() - 1);
+    else
+        goToLine(qBound(qsizetype(0), line - m_viewFirstLine, m_buffer.lineCount() - 1));
+}
+
+void VimTextEdit::setFollowing(bool following)
+{
+    if (!m_view)
+        return;
+    m_view->setFollowing(following);
+    if (following)
+        showFileLine(-1);
+    emit commandChanged(following ? "Following \"" + m_view->filename() + "\"" : QString("Stopped following"));
+}
+
+/**
+ * @brief fills the document with VIEW_PAGES pages from firstPage on (fewer at the end of the file)
+ */
+void VimTextEdit::showPages(int firstPage)
+{
+    const int pageCount = m_view->pageCount();
+    const int first = qBound(0, firstPage, qMax(0, pageCount - VIEW_PAGES));
+    const int end = qMin(pageCount, first + VIEW_PAGES);
+
+    m_viewShowing = true;
+    beginLoad();
+    m_viewPageStarts.clear();
+    qint64 start = m_view->pageStart(first);
+    for (int page = first; page < end; ++page)
+    {
+        const qint64 pageEnd = m_view->pageStart(page + 1);
+        m_viewPageStarts.append(m_buffer.length());
+        appendLoaded(m_view->read(start, pageEnd));
+        start = pageEnd;
+    }
+    m_viewFirst = first;
+    m_viewEnd = start;
+    m_viewFirstLine = m_view->firstLine(first);
+    m_viewShowing = false;
+
+    // the matches were those of the pages shown before
+    m_parallelSearch->cancel();
+    m_jumpPending = false;
+    if (m_search.isValid())
+        startSearch();
+    m_layoutFirst = 0;
+    m_layoutLast = -1;
+    updateLineNumberArea();
+}
+
+int VimTextEdit::viewPageIndex(int position) const
+{
+    auto next = std::upper_bound(m_viewPageStarts.cbegin(), m_viewPageStarts.cend(), qsizetype(position));
+    return int(qMax(qsizetype(0), qsizetype(next - m_viewPageStarts.cbegin()) - 1));
+}
+
+/**
+ * @brief slides the window once the cursor (or the viewport, scrolled away from it) gets to its first or last page
+ */
+void VimTextEdit::slideView()
+{
+    // a selection can't outlive the text it's in, the window waits for normal mode
+    if (!m_view || m_viewShowing || !normalMode() || m_viewPageStarts.size() < 2)
+        return;
+
+    const int cursor = textCursor().position();
+    const bool cursorVisible = cursor >= firstVisiblePosition() && cursor <= lastVisiblePosition();
+    const int index = viewPageIndex(cursorVisible ? cursor : firstVisiblePosition());
+    const int last = int(m_viewPageStarts.size()) - 1;
+    if ((index == 0 && m_viewFirst > 0) || (index == last && m_viewFirst + last + 1 < m_view->pageCount()))
+        recenterView(index);
+}
+
+/**
+ * @brief shows the pages around the page at index in the window, keeping the cursor and the scroll on the same text
+ */
+void VimTextEdit::recenterView(int pageIndex)
+{
+    auto locate = [this](int position) {
+        const int index = viewPageIndex(position);
+        return std::pair<int, qsizetype>(m_viewFirst + index, position - m_viewPageStarts[index]);
+    };
+    auto position = [this](std::pair<int, qsizetype> place) {
+        const int index = place.first - m_viewFirst;
+        if (index < 0)
+            return 0;
+        if (index >= m_viewPageStarts.size())
+            return int(m_buffer.length());
+        return int(qMin(m_buffer.length(), m_viewPageStarts[index] + place.second));
+    };
+
+    const auto cursor = locate(textCursor().position());
+    const auto top = locate(firstVisiblePosition());
+    showPages(m_viewFirst + pageIndex - VIEW_PAGES / 2);
+
+    m_viewShowing = true;
+    setCursorPosition(position(cursor));
+    verticalScrollBar()->setValue(document()->findBlock(position(top)).blockNumber());
+    m_viewShowing = false;
+    updateHighlights();
+}
+
+/**
+ * @brief appends what was written to the file since, if the window shows its end
+ */
+void VimTextEdit::viewGrown(qint64 previousSize)
+{
+    if (m_viewEnd != previousSize)
+        return;
+
+    // the rest of the last page shown, then the pages that came after it
+    const int previousPages = int(qMax(qint64(1), (previousSize + PagedFile::PAGE_SIZE - 1) / PagedFile::PAGE_SIZE));
+    const int pageCount = m_view->pageCount();
+    qint64 start = m_viewEnd;
+    for (int page = previousPages; page <= pageCount; ++page)
+    {
+        const qint64 end = page < pageCount ? m_view->pageStart(page) : m_view->size();
+        if (end > start)
+            appendLoaded(m_view->read(start, end));
+        if (page < pageCount)
+            m_viewPageStarts.append(m_buffer.length());
+        start = qMax(start, end);
+    }
+    m_viewEnd = start;
+
+    if (m_view->isFollowing() && normalMode())
+    {
+        // the window keeps VIEW_PAGES pages, dropped from its start
+        if (m_viewPageStarts.size() > VIEW_PAGES)
+            showPages(pageCount);
+        goToLine(m_buffer.lineCount() - 1);
+    }
+    else if (m_viewPageStarts.size() > VIEW_PAGES + 1)
+    {
+        recenterView(viewPageIndex(textCursor().position()));
+    }
+
+    if (m_search.isValid())
+        startSearch();
+    updateLineNumberArea();
+}
+
+/**
+ * @brief searches the pages outside the window, from the one after it to the end of the file and on from the start
+ */
+void VimTextEdit::findInView(bool backward)
+{
+    const int pageCount = m_view->pageCount();
+    const int windowSize = int(m_viewPageStarts.size());
+    QList<int> pages;
+    for (int i = 1; i <= pageCount - windowSize; ++i)
+        pages.append(backward ? (m_viewFirst - i + pageCount) % pageCount
+                              : (m_viewFirst + windowSize - 1 + i) % pageCount);
+
+    m_viewSearchBackward = backward;
+    if (pages.isEmpty())
+    {
+        viewNotFound();
+        return;
+    }
+    m_view->find(m_search, pages, backward);
+    emit commandChanged("Searching \"" + m_view->filename() + "\" for " + m_search.pattern() + "...");
+}
+
+void VimTextEdit::viewFound(int page, qsizetype position, qsizetype length)
+{
+    showPages(page - VIEW_PAGES / 2);
+    const qsizetype start = m_viewPageStarts[page - m_viewFirst];
+    jumpToMatch(SearchMatch{start + position, length});
+    emit commandChanged(m_search.pattern());
+}
+
+/**
+ * @brief nothing outside the window: wraps around inside it, to the matches on the cursor's other side
+ */
+void VimTextEdit::viewNotFound()
+{
+    const SearchMatch match = m_viewSearchBackward ? m_search.findPrevious(m_buffer, m_buffer.length())
+                                                   : m_search.findNext(m_buffer, 0);
+    if (!match.isValid())
+    {
+        emit commandChanged("Pattern not found: " + m_search.pattern());
+        return;
+    }
+    jumpToMatch(match);
+    emit commandChanged(m_search.pattern());
+}
+// --------------
+
+/**
+ * @brief clears the editor and makes it read-only until endLoad()
+ */
+void VimTextEdit::beginLoad(bool keepHistory)
+{
+    setReadOnly(true);
+    m_buffer.clear();
+    if (!keepHistory)
+        m_undo.clear();
+    m_highlighter->reset();
+    ++m_revision;
+    m_editing = true;
+    clear();
+    m_editing = false;
+}
+
+/**
+ * @brief appends a batch of loaded text (the buffer shares it instead of copying)
+ */
+void VimTextEdit::appendLoaded(const QString& text)
+{
+    const qsizetype end = m_buffer.length();
+    m_buffer.append(text);
+    ++m_revision;
+    // the loaded file is what the journal starts from, it only gets the edits
+    m_highlighter->linesChanged(m_buffer.lineAt(end), 0, m_buffer.mid(end).lineCount() - 1);
+
+    m_editing = true;
+    QTextCursor c(document());
+    c.movePosition(QTextCursor::End);
+    c.insertText(documentText(text));
+    m_editing = false;
+}
+
+void VimTextEdit::endLoad()
+{
+    setReadOnly(false);
+    setCursorPosition(0);
+}
+
+/**
+ * @brief replaces [position, position + length) in the buffer and mirrors the edit to the document
+ */
+void VimTextEdit::replaceText(int position, int length, const QString& text)
+{
+    const TextBuffer removed = m_buffer.mid(position, length);
+    m_buffer.remove(position, length);
+    m_buffer.insert(position, text);
+    ++m_revision;
+    const TextBuffer inserted = m_buffer.mid(position, text.size());
+    m_undo.record(position, removed, inserted);
+    bufferChanged(position, removed, inserted);
+    replaceDocumentText(position, length, text);
+}
+
+/**
+ * @brief inserts a slice of text, the buffer shares it instead of copying
+ */
+void VimTextEdit::insertText(int position, const TextBuffer& text)
+{
+    m_buffer.insert(position, text);
+    ++m_revision;
+    m_undo.record(position, TextBuffer(), text);
+    bufferChanged(position, TextBuffer(), text);
+    replaceDocumentText(position, 0, text.toString());
+}
+
+/**
+ * @brief tells the highlighter and the journal about an edit at position, once the buffer holds it
+ */
+void VimTextEdit::bufferChanged(qsizetype position, const TextBuffer& removed, const TextBuffer& inserted)
+{
+    m_highlighter->linesChanged(m_buffer.lineAt(position), removed.lineCount() - 1, inserted.lineCount() - 1);
+    if (m_journal)
+        m_journal->record(position, removed.length(), inserted);
+}
+
+/**
+ * @brief mirrors an edit already made to the buffer to the document
+ */
+void VimTextEdit::replaceDocumentText(int position, int length, const QString& text)
+{
+    if (m_editDepth > 0 && m_editBlock.isNull())
+    {
+        m_editBlock = QTextCursor(document());
+        m_editBlock.beginEditBlock();
+    }
+
+    // the edit is already in the buffer, don't feed it back through syncBuffer
+    m_editing = true;
+    QTextCursor c(document());
+    c.setPosition(position);
+    c.setPosition(position + length, QTextCursor::KeepAnchor);
+    c.insertText(documentText(text));
+    m_editing = false;
+}
+
+void VimTextEdit::beginEdit()
+{
+    ++m_editDepth;
+}
+
+/**
+ * @brief closes the outermost edit, the document then reports all its changes at once
+ */
+void VimTextEdit::endEdit()
+{
+    if (--m_editDepth > 0 || m_editBlock.isNull())
+        return;
+
+    // the merged change is already in the buffer
+    m_editing = true;
+    m_editBlock.endEditBlock();
+    m_editing = false;
+    m_editBlock = QTextCursor();
+    // the layout was out of date while the cursor moved
+    ensureCursorVisible();
+}
+
+/**
+ * @brief follows the changes of the document shown, called whenever another one is
+ */
+void VimTextEdit::connectDocument()
+{
+    connect(document(), &QTextDocument::contentsChange,
+            this, &VimTextEdit::syncBuffer);
+    connect(document(), &QTextDocument::contentsChanged, this, [this]() {
+        if (m_search.isValid())
+            m_researchTimer->start();
+        m_highlightTimer->start();
+        updateLineNumberArea();
+    });
+}
+
+/**
+ * @brief applies a document change made by QTextEdit itself (typing, pasting, undo) to the buffer
+ */
+void VimTextEdit::syncBuffer(int position, int charsRemoved, int charsAdded)
+{
+    if (m_editing)
+        return;
+    LatencyScope latency(LatencyProfiler::BufferSync);
+
+    // the counts may include the implicit paragraph separator ending the document
+    int docLength = document()->characterCount() - 1;
+    position = qBound(0, position, int(m_buffer.length()));
+    int removed = qMin(charsRemoved, int(m_buffer.length()) - position);
+    int added = qMin(charsAdded, docLength - position);
+
+    QString text;
+    if (added > 0)
+    {
+        QTextCursor c(document());
+        c.setPosition(position);
+        c.setPosition(position + added, QTextCursor::KeepAnchor);
+        text = c.selectedText().replace(QChar::ParagraphSeparator, '\n');
+    }
+    const TextBuffer removedText = m_buffer.mid(position, removed);
+    m_buffer.remove(position, removed);
+    m_buffer.insert(position, text);
+    ++m_revision;
+    const TextBuffer inserted = m_buffer.mid(position, text.size());
+    m_undo.record(position, removedText, inserted);
+    bufferChanged(position, removedText, inserted);
+    // typing is one step until insert mode ends
+    if (m_mode != Mode::INSERT)
+        m_undo.close(m_buffer);
+
+    // every edit path keeps the two the same length, anything else is a bug to fix there
+    Q_ASSERT_X(m_buffer.length() == docLength, "VimTextEdit::syncBuffer", "the buffer no longer mirrors the document");
+}
+
+
+
+/**
+ * @brief shows the keys of a command being typed and its count, like Vim's showcmd
+ */
+void VimTextEdit::showPendingCommand(CommandParser::Result result)
+{
+    if (result == CommandParser::Pending)
+    {
+        emit commandChanged(m_parser.pendingKeys().toString());
+        m_showingCommand = true;
+    }
+    else if (m_showingCommand)
+    {
+        emit commandChanged("No Command");
+        m_showingCommand = false;
+    }
+
+    const quint32 count = qMax(1u, m_parser.pendingCount());
+    if (count != m_shownCount)
+    {
+        m_shownCount = count;
+        emit countChanged("count: " + QString::number(count));
+    }
+}
+
+void VimTextEdit::updateMode(Mode mode)
+{
+    if (mode == m_mode)
+        return;
+    const Mode previous = m_mode;
+    m_mode = mode;
+
+    static int cursorFlashTime = QApplication::cursorFlashTime();
+    
+    switch (m_mode)
+    {
+        case Mode::NORMAL:
+            // disable cursor blinking in normal mode
+            QApplication::setCursorFlashTime(0);
+
+            moveCursor(MoveDir::Left);
+            setCursorWidth(CURSOR_WIDTH_NORMAL);
+            break;
+
+        case Mode::INSERT:
+            // enable cursor blinking in insert mode
+            QApplication::setCursorFlashTime(cursorFlashTime);
+
+            setCursorWidth(CURSOR_WIDTH_INSERT);
+            break;
+
+        case Mode::VISUAL:
+        case Mode::VISUAL_LINE:
+            setCursorWidth(CURSOR_WIDTH_NORMAL);
+            break;
+
+        case Mode::VISUAL_BLOCK:
+        {
+            // the rectangle is drawn as extra selections, not as the cursor's selection
+            auto c = textCursor();
+            m_blockAnchor = c.position();
+            m_blockToLineEnd = false;
+            c.clearSelection();
+            setTextCursor(c);
+            setCursorWidth(CURSOR_WIDTH_NORMAL);
+            break;
+        }
+    }
+    if (previous == Mode::VISUAL_BLOCK || m_mode == Mode::VISUAL_BLOCK)
+        updateHighlights();
+    // emit mode changed signal
+    emit modeChanged("-- " + modeAsString(m_mode) + " --");
+}
+
+void VimTextEdit::moveCursor(MoveDir operation, QTextCursor::MoveMode mode)
+{
+    LatencyScope latency(LatencyProfiler::Cursor);
+    if (visualMode() || visualLineMode())
+        mode = QTextCursor::KeepAnchor;
+    auto c = textCursor();
+    c.movePosition(operation, mode);
+    setTextCursor(c);
+    if (visualBlockMode())
+        updateHighlights();
+}
+
+void VimTextEdit::setCursorPosition(int position, QTextCursor::MoveMode mode)
+{
+    LatencyScope latency(LatencyProfiler::Cursor);
+    if (visualMode() || visualLineMode())
+        mode = QTextCursor::KeepAnchor;
+    auto c = textCursor();
+    c.setPosition(position, mode);
+    setTextCursor(c);
+    if (visualBlockMode())
+        updateHighlights();
+}
+
+/**
+ * @brief moves the cursor to the first non-blank char of line (0 based)
+ */
+void VimTextEdit::goToLine(qsizetype line, QTextCursor::MoveMode mode)
+{
+    setCursorPosition(firstNonBlank(line), mode);
+}
+
+/**
+ * @brief collects the text of a : command until Enter runs it
+ */
+void VimTextEdit::editExCommand(QKeyEvent* event)
+{
+    switch (event->key())
+    {
+        case Qt::Key_Return:
+        case Qt::Key_Enter:
+        {
+            QString command = m_exCommand;
+            m_exCommand.clear();
+            m_exMode = false;
+            emit commandChanged("No Command");
+            runExCommand(command.trimmed());
+            return;
+        }
+
+        case Qt::Key_Escape:
+        case Qt::Key_CapsLock:
+            m_exCommand.clear();
+            m_exMode = false;
+            emit commandChanged("No Command");
+            return;
+
+        case Qt::Key_Backspace:
+            if (m_exCommand.isEmpty())
+            {
+                m_exMode = false;
+                emit commandChanged("No Command");
+                return;
+            }
+            m_exCommand.chop(1);
+            break;
+
+        default:
+            m_exCommand += event->text();
+            break;
+    }
+    emit commandChanged(":" + m_exCommand);
+}
+
+/**
+ * @brief runs a : command, [range]name[!] [argument]
+ */
+void VimTextEdit::runExCommand(const QString& command)
+{
+    if (command.isEmpty())
+        return;
+
+    ExParser::Context context;
+    context.cursorLine = m_buffer.lineAt(textCursor().position());
+    context.lineCount = m_buffer.lineCount();
+    context.visualFirst = m_visualFirst;
+    context.visualLast = m_visualLast;
+    if (m_view && m_viewFirstLine >= 0)
+    {
+        // lines of the viewed file; until they're all counted, any line may exist
+        context.cursorLine += m_viewFirstLine;
+        context.lineCount = m_view->isIndexed() ? m_view->lineCount()
+                                                : std::numeric_limits<qsizetype>::max() / 2;
+    }
+    const ExCommand ex = ExParser::parse(command, context);
+    if (!ex.isValid())
+    {
+        emit commandChanged(ex.error);
+        return;
+    }
+    const QString& name = ex.name;
+    const QString argument = ex.argument.trimmed();
+
+    // a range alone jumps to its last line (:N, :$)
+    if (name.isEmpty())
+    {
+        if (m_view)
+            showFileLine(ex.lastLine == context.lineCount - 1 ? -1 : ex.lastLine);
+        else
+            goToLine(ex.lastLine);
+        return;
+    }
+
+    // buffers: :e file, :b N, :bn, :bp, :ls
+    if ((name == "e" || name == "edit") && !argument.isEmpty())
+    {
+        emit editRequested(argument);
+        return;
+    }
+    if (name == "bn" || name == "bnext" || name == "bp" || name == "bprevious")
+    {
+        emit bufferStepRequested(name.startsWith("bn") ? 1 : -1);
+        return;
+    }
+    if ((name == "b" || name == "buffer") && argument.toInt() > 0)
+    {
+        emit bufferRequested(argument.toInt());
+        return;
+    }
+    if (name == "ls" || name == "buffers")
+    {
+        emit bufferListRequested();
+        return;
+    }
+    // the file's format: :set ff=unix|dos|mac, :set fenc=..., :set [no]bomb
+    if (name == "set" || name == "se")
+    {
+        // :set follow, :set nofollow: tail -f the viewed file
+        if (m_view && (argument == "follow" || argument == "nofollow"))
+        {
+            setFollowing(argument == "follow");
+            return;
+        }
+        emit formatOptionRequested(argument);
+        return;
+    }
+
+    // editing: :[range]d [x], :[range]s/pat/rep/flags, :[range]g/pat/cmd, :v/pat/cmd
+    const bool substitute = name == "s" || name == "substitute";
+    const bool global = name == "g" || name == "global" || name == "v" || name == "vglobal";
+    if ((substitute || global || name == "d" || name == "delete") && isReadOnly())
+    {
+        emit commandChanged("E21: Cannot make changes, the buffer is read-only");
+        return;
+    }
+    if (name == "d" || name == "delete")
+    {
+        deleteLines(ex.firstLine, ex.lastLine, argument.isEmpty() ? 0 : argument[0].unicode());
+        return;
+    }
+    if (substitute || global)
+    {
+        const Substitution substitution = substitute
+            ? Substitution::substitute(ex.argument, m_lastSubstitution)
+            : Substitution::global(ex.argument, ex.bang || name.startsWith('v'), m_lastSubstitution);
+        if (!substitution.isValid())
+        {
+            emit commandChanged(substitution.errorString());
+            return;
+        }
+        m_lastSubstitution = substitution;
+        // :g runs on every line without a range
+        if (global && !ex.hasRange)
+            startSubstitution(substitution, 0, m_buffer.lineCount() - 1);
+        else
+            startSubstitution(substitution, ex.firstLine, ex.lastLine);
+        return;
+    }
+    emit commandChanged("E492: Not an editor command: " + command);
+}
+
+/**
+ * @brief deletes lines [firstLine, lastLine] into a register, like dd on them
+ */
+void VimTextEdit::deleteLines(qsizetype firstLine, qsizetype lastLine, char16_t reg)
+{
+    int start = int(m_buffer.lineStart(firstLine));
+    int end = int(m_buffer.lineEnd(lastLine));
+    m_registers.remove(reg, {m_buffer.mid(start, end - start), true});
+
+    // take the line break along, the one before the range for the last line
+    if (end < m_buffer.length())
+        ++end;
+    else if (start > 0)
+        --start;
+    beginEdit();
+    removeText(start, end - start);
+    endEdit();
+    m_undo.close(m_buffer);
+    goToLine(m_buffer.lineAt(start));
+    emit commandChanged(QString("%1 fewer lines").arg(lastLine - firstLine + 1));
+}
+
+/**
+ * @brief matches substitution on lines [firstLine, lastLine] in the background
+ *
+ * The changes are applied when all of them are known, unless the text
+ * changed in the meantime.
+ */
+void VimTextEdit::startSubstitution(const Substitution& substitution, qsizetype firstLine, qsizetype lastLine)
+{
+    m_runningSubstitution = substitution;
+    m_substituteRevision = m_revision;
+    m_substitute->start(m_buffer, substitution, firstLine, lastLine);
+    if (m_substitute->isRunning())
+        emit commandChanged(substitution.isCountOnly() ? "Counting..." : "Substituting...");
+}
+
+/**
+ * @brief applies the changes of a substitution as one edit and one undo step
+ */
+void VimTextEdit::applySubstitution(const Substitution::Result& result)
+{
+    if (m_substituteRevision != m_revision)
+    {
+        emit commandChanged("Substitution cancelled, the text changed");
+        return;
+    }
+    const QString summary = m_runningSubstitution.summary(result);
+    if (result.changes.isEmpty())
+    {
+        emit commandChanged(summary.isEmpty() ? "No Command" : summary);
+        return;
+    }
+
+    // back to front, so the positions of the changes before stay put
+    beginEdit();
+    qsizetype shift = 0;
+    for (qsizetype i = result.changes.size() - 1; i >= 0; --i)
+    {
+        const Substitution::Change& change = result.changes[i];
+        replaceText(int(change.position), int(change.length), change.text);
+        // how far the changes before the last one moved it
+        if (i < result.changes.size() - 1)
+            shift += change.text.size() - change.length;
+    }
+    // the last line has no line break of its own, the one before it goes with it
+    if (result.deletedLastLine && m_buffer.length() > 0 && m_buffer.at(m_buffer.length() - 1) == '\n')
+        removeText(int(m_buffer.length() - 1), 1);
+    endEdit();
+    m_undo.close(m_buffer);
+
+    // on the last line changed
+    const Substitution::Change& last = result.changes.last();
+    const qsizetype position = qMin(last.position + shift + last.lastLine, m_buffer.length());
+    goToLine(m_buffer.lineAt(position));
+    emit commandChanged(summary);
+}
+
+bool VimTextEdit::isEditing(Action action)
+{
+    switch (action)
+    {
+        case Action::Operate:
+        case Action::CharDelete:
+        case Action::ReplaceChar:
+        case Action::Repeat:
+        case Action::Undo:
+        case Action::Redo:
+        case Action::Put:
+        case Action::PutBefore:
+        case Action::insert:
+        case Action::Insert:
+        case Action::insertLine:
+        case Action::InsertLine:
+        case Action::append:
+        case Action::Append:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// actions that switch to insert mode by themselves
+bool VimTextEdit::isInserting(Action action)
+{
+    switch (action)
+    {
+        case Action::insert:
+        case Action::Insert:
+        case Action::insertLine:
+        case Action::InsertLine:
+        case Action::append:
+        case Action::Append:
+            return true;
+        default:
+            return false;
+    }
+}
+
+QString VimTextEdit::modeAsString(Mode mode)
+{
+    switch (mode)
+    {
+        case Mode::INSERT:       return "INSERT";
+        case Mode::VISUAL:       return "VISUAL";
+        case Mode::VISUAL_LINE:  return "VISUAL LINE";
+        case Mode::VISUAL_BLOCK: return "VISUAL BLOCK";
+        default:                 return "NORMAL";
+    }
+}
+
+bool VimTextEdit::isLinewise(Motion motion)
+{
+    switch (motion)
+    {
+        case Motion::Down:
+        case Motion::Up:
+        case Motion::FirstLine:
+        case Motion::LastLine:
+        case Motion::WholeLine:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// the operator includes the char the motion ends on
+bool VimTextEdit::isInclusive(Motion motion)
+{
+    switch (motion)
+    {
+        case Motion::WordEnd:
+        case Motion::BigWordEnd:
+        case Motion::WordEndBack:
+        case Motion::BigWordEndBack:
+        case Motion::LineEnd:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/**
+ * @brief the char a key stands for in a command: Ctrl+letters are control chars,
+ *        Esc and Caps Lock are Escape, 0 for keys without text
+ */
+char16_t VimTextEdit::commandKey(const QKeyEvent* event)
+{
+    const int key = event->key();
+    if (key == Qt::Key_Escape || key == Qt::Key_CapsLock)
+        return CommandParser::Escape;
+    if (event->modifiers().testFlag(Qt::ControlModifier) && key >= Qt::Key_A && key <= Qt::Key_Z)
+        return char16_t(key - Qt::Key_A + 1);
+
+    const QString text = event->text();
+    return text.isEmpty() ? 0 : text.at(0).unicode();
+}
+
+
+
+/**
+ * @brief current char that cursor is on (the character which will be deleted if backspace clicked)
+ * 
+ * @param offset 1 right char, -1 left char, 0 current char (default) and so on..
+ * @return QChar 
+ */
+QChar VimTextEdit::currChar(int offset) const
+{
+    int pos = textCursor().position() + offset;
+    if (pos < 0)
+        return QChar();
+    return m_buffer.at(pos);
+}
+
+/**
+ * @brief iterator over the buffer chars starting at the cursor
+ * 
+ * @param offset same meaning as in currChar
+ * @return TextIterator 
+ */
+TextIterator VimTextEdit::charIterator(int offset) const
+{
+    return TextIterator(m_buffer, textCursor().position() + offset);
+}
+
+int VimTextEdit::lineStart(int position) const
+{
+    return int(m_buffer.lineStart(m_buffer.lineAt(position)));
+}
+
+int VimTextEdit::lineEnd(int position) const
+{
+    return int(m_buffer.lineEnd(m_buffer.lineAt(position)));
+}
+
+// where the cursor stops at the end of a line: on its last char, never on the line break
+int VimTextEdit::lastChar(qsizetype line) const
+{
+    return int(qMax(m_buffer.lineStart(line), m_buffer.lineEnd(line) - 1));
+}
+
+int VimTextEdit::firstNonBlank(qsizetype line) const
+{
+    TextIterator it(m_buffer, m_buffer.lineStart(line));
+    while (!it.atEnd() && (*it == ' ' || *it == '\t'))
+        ++it;
+    return int(it.position());
+}
+
+/**
+ * @brief column j/k aim for: the one remembered from the last j/k, or the cursor's
+ */
+qsizetype VimTextEdit::goalColumn(int position) const
+{
+    if (position == m_goalPosition)
+        return m_goalColumn;
+    return position - m_buffer.lineStart(m_buffer.lineAt(position));
 }
@@ -1,65 +1,128 @@
 #ifndef VIMTEXTEDIT_H
 #define VIMTEXTEDIT_H
 
+#include <QPlainTextEdit>
 #include <QTextEdit>
 #include <QWidget>
 #include <QString>
 #include <QKeyEvent>
 #include <QChar>
-#include <QHash>
+#include <QList>
+#include <QTimer>
 #include <initializer_list>
+#include <utility>
+#include "textbuffer.h"
+#include "textiterator.h"
+#include "searchengine.h"
+#include "parallelsearch.h"
+#include "exparser.h"
+#include "substitution.h"
+#include "parallelsubstitute.h"
+#include "wordmotion.h"
+#include "latencyprofiler.h"
+#include "commandparser.h"
+#include "undohistory.h"
+#include "registers.h"
+#include "blockedit.h"
+#include "syntaxhighlighter.h"
+#include "bufferlist.h"
+#include "editjournal.h"
+#include "pagedfile.h"
+
+class LineNumberArea;
 
 using MoveDir = QTextCursor::MoveOperation;
 using MoveMode = QTextCursor::MoveMode;
 
 enum Mode {NORMAL = 0, INSERT, VISUAL, VISUAL_LINE, VISUAL_BLOCK};
 
-enum Action
+
+/**
+ * @brief plain-text editor widget with Vim modes
+ *
+ * QPlainTextEdit lays out only the lines it has to show and scrolls by
+ * line, so nothing is laid out for the whole document. Layouts of lines
+ * that scrolled away are released again (releaseLayouts()), which keeps
+ * layout memory proportional to the viewport rather than to the file.
+ *
+ * A file viewed read-only (openView()) isn't loaded at all: the document
+ * is a window of VIEW_PAGES pages of a PagedFile that slides along as the
+ * cursor and the viewport get to its first or last page.
+ */
+class VimTextEdit : public QPlainTextEdit
 {
-    None = 0,
-    Move,   // move operation (hjkl, w, b, e)
-    Change, // change operation (Delete + Insert)
-    CharDelete, // delete a char (x)
-    Delete, // delete operation
+    Q_OBJECT
 
-    Navigate,    // Change Mode To Normal
-    Visual,      // Change Mode To Visual
-    VisualLine,  // Change Mode To Visual Line
-    VisualBlock, // Change Mode To Visual Block
+public:
+    explicit VimTextEdit(QWidget* parent = nullptr);
+    
+    inline bool isEmpty() const { return m_buffer.isEmpty(); }
+    inline const TextBuffer& buffer() const { return m_buffer; }
+    // bumped on every change of the text
+    inline quint64 revision() const { return m_revision; }
+    // a :s or :g is being matched in the background
+    inline bool isBusy() const { return m_substitute->isRunning(); }
 
-    insert, // Change Mode To Insert (curr pos)
-    Insert, // Change Mode To Insert (beg. of line)
+    void search(const QString& pattern, SearchOptions options);
+    // the cursor to the first non-blank char of line (0 based)
+    void goToLine(qsizetype line, MoveMode moveMode = MoveMode::MoveAnchor);
 
-    insertLine, // Insert New Line Below Current Line
-    InsertLine, // Insert New Line Above Current Line
+    // Line Numbers
+    int lineNumberAreaWidth() const;
+    void paintLineNumbers(QPaintEvent* event);
 
-    append, // Change Mode To Insert (curr pos + 1)
-    Append, // Change Mode To Insert (eof line)
-};
+    // Progressive Loading
+    void beginLoad(bool keepHistory = false);
+    void appendLoaded(const QString& text);
+    void endLoad();
+    // --------------
 
+    // Undo History
+    inline void clearHistory() { m_undo.clear(); }
+    inline void setUndoMemoryBudget(qsizetype bytes) { m_undo.setMemoryBudget(bytes, m_buffer); }
+    // --------------
 
-class VimTextEdit : public QTextEdit
-{
-    Q_OBJECT
+    // Syntax Highlighting
+    void setLanguage(SyntaxTokenizer::Language language);
+    inline SyntaxTokenizer::Language language() const { return m_highlighter->language(); }
+    // --------------
 
-public:
-    explicit VimTextEdit(QWidget* parent = nullptr);
-    
-    inline bool isEmpty() const { return toPlainText().isEmpty(); }
+    // Buffers
+    void swapBuffer(BufferState& state);
+    // edits are recorded to journal (null: none) until another one is set
+    inline void setJournal(EditJournal* journal) { m_journal = journal; }
+    void replayEdits(const QList<EditJournal::Edit>& edits);
+    // --------------
+
+    // View
+    bool openView(const QString& filename, bool follow, QString& error);
+    inline bool isViewing() const { return m_view != nullptr; }
+    // the cursor to line of the viewed file (0 based), the last one for -1
+    void showFileLine(qsizetype line);
+    void setFollowing(bool following);
+    // --------------
 signals:
     void modeChanged(const QString& modeStr);
     void countChanged(const QString& countStr);
     void commandChanged(const QString& commandStr);
+    // : commands on the buffer list, the window runs them
+    void editRequested(const QString& filename);    // :e file
+    void bufferRequested(int number);               // :b N (1 based)
+    void bufferStepRequested(int step);             // :bn, :bp
+    void bufferListRequested();                     // :ls
+    void formatOptionRequested(const QString& option); // :set ff=dos, :set fenc=latin1, :set (shows the format)
+    void textPainted(); // once, when text shows up for the first time
 
 private:
     // OVERRIDDEN
     void keyPressEvent(QKeyEvent* event) override;
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
     // ------------
 
     // State Setters
     void updateMode(Mode mode);
-    void updateCount(QChar countChar);
-    void updateCommand(Action command);
+    void showPendingCommand(CommandParser::Result result);
     // --------------
 
     // State Getters
@@ -69,31 +132,193 @@ private:
     inline bool visualLineMode() const {return m_mode == Mode::VISUAL_LINE;}
     inline bool visualBlockMode() const {return m_mode == Mode::VISUAL_BLOCK;}
     QChar currChar(int offset = 0) const;
+    TextIterator charIterator(int offset = 0) const;
+    int lineStart(int position) const;
+    int lineEnd(int position) const;
+    int lastChar(qsizetype line) const;
+    int firstNonBlank(qsizetype line) const;
+    qsizetype goalColumn(int position) const;
+    BlockEdit::Block blockSelection() const;
+    int firstVisiblePosition() const;
+    int lastVisiblePosition() const;
     // --------------
 
     // Main Functions
-    void executeAction(Action action, QKeyCombination keys);
-    void Move(QKeyCombination key, MoveMode mode = QTextCursor::MoveAnchor);
+    void executeCommand(const Command& command);
+    void Move(Motion motion, quint32 count);
+    void Operate(const Command& command);
+    void finishInsert();
+    void repeatChange(quint32 count);
+    void Undo(quint32 count, bool redo = false);
+    void Put(const Command& command);
+    void Replace(const Command& command);
+    void OperateBlock(const Command& command);
+    void beginBlockInsert(BlockEdit::Operation operation);
+    void editBlock(const BlockEdit::Block& block, BlockEdit::Operation operation, QStringView text = {});
     void moveCursor(MoveDir moveDir, MoveMode moveMode = MoveMode::MoveAnchor);
-    void Change(QKeyCombination key);
-    void Delete(QKeyCombination key);
+    void setCursorPosition(int position, MoveMode moveMode = MoveMode::MoveAnchor);
+    void editExCommand(QKeyEvent* event);
+    void runExCommand(const QString& command);
+    void deleteLines(qsizetype firstLine, qsizetype lastLine, char16_t reg);
+    void startSubstitution(const Substitution& substitution, qsizetype firstLine, qsizetype lastLine);
+    void applySubstitution(const Substitution::Result& result);
+    void findMatch(bool backward = false);
+    void jumpToMatch(const SearchMatch& match);
+    // --------------
+
+    // Search Highlighting
+    void startSearch();
+    void addMatches(const QList<SearchMatch>& matches);
+    void finishSearch(qsizetype matchCount);
+    void updateHighlights();
+    // --------------
+
+    // Syntax Highlighting
+    void startHighlight();
+    void applyHighlight(quint64 revision, qsizetype firstLine, const QList<SyntaxHighlighter::Spans>& lines);
+    // --------------
+
+    void updateLineNumberArea();
+    void releaseLayouts();
+
+    // View
+    void showPages(int firstPage);
+    void slideView();
+    void recenterView(int pageIndex);
+    int viewPageIndex(int position) const;
+    void viewGrown(qint64 previousSize);
+    void findInView(bool backward);
+    void viewFound(int page, qsizetype position, qsizetype length);
+    void viewNotFound();
+    // --------------
+
+    // Motions & Ranges
+    int motionTarget(Motion motion, quint32 count, int from) const;
+    std::pair<int, int> operatorRange(const Command& command, bool& linewise) const;
+    std::pair<int, int> textObjectRange(Motion object, quint32 count, int from) const;
+    // --------------
+
+    // Buffer Editing
+    void replaceText(int position, int length, const QString& text);
+    inline void insertText(int position, const QString& text) { replaceText(position, 0, text); }
+    void insertText(int position, const TextBuffer& text);
+    inline void removeText(int position, int length) { replaceText(position, length, QString()); }
+    void replaceDocumentText(int position, int length, const QString& text);
+    void syncBuffer(int position, int charsRemoved, int charsAdded);
+    void bufferChanged(qsizetype position, const TextBuffer& removed, const TextBuffer& inserted);
+    void connectDocument();
+    void beginEdit();
+    void endEdit();
     // --------------
 
     // Static Functions
-    static inline bool isSwitchMode(Action action) {return action < Action::Navigate;}
+    static bool isEditing(Action action);
+    static bool isInserting(Action action);
+    static bool isLinewise(Motion motion);
+    static bool isInclusive(Motion motion);
+    static char16_t commandKey(const QKeyEvent* event);
     static QString modeAsString(Mode mode);
-    static QString commandAsString(Action command);
     // --------------
 private:
     Mode m_mode = INSERT;
-    static const QHash<QKeyCombination, Action> keyToAction;
 
     int CURSOR_WIDTH_INSERT = 1;
     int CURSOR_WIDTH_NORMAL = 6;
 
-    // command count
-    qint16 m_count = 1;
-    Action m_command = Action::None;
+    // authoritative plain text, the document mirrors it
+    TextBuffer m_buffer;
+    quint64 m_revision = 0;
+    bool m_editing = false;
+    // edits between beginEdit() and endEdit() form one document change
+    // (one layout pass, one textChanged); the block opens on the first edit
+    int m_editDepth = 0;
+    QTextCursor m_editBlock;
+    // the document's own undo stack is off, this is the only history
+    UndoHistory m_undo;
+    // crash recovery journal of the buffer shown, owned by the window
+    EditJournal* m_journal = nullptr;
+
+    // last search, matched in the background on all cores
+    SearchEngine m_search;
+    ParallelSearch* m_parallelSearch = nullptr;
+    quint64 m_searchRevision = 0;
+    bool m_jumpPending = false;
+    // the scan starts at the top of the viewport: m_matches holds the matches
+    // from m_searchFrom on, m_wrappedMatches the ones before, both sorted;
+    // once the search is complete they are joined into m_matches
+    QList<SearchMatch> m_matches;
+    QList<SearchMatch> m_wrappedMatches;
+    qsizetype m_searchFrom = 0;
+    bool m_searchComplete = false;
+    // re-runs the search once typing settles
+    QTimer* m_researchTimer = nullptr;
+    static constexpr int RESEARCH_DELAY = 250; // ms
+
+    // syntax tokens, computed in the background for the lines in view
+    SyntaxHighlighter* m_highlighter = nullptr;
+    // coalesces the edits and scrolls of one event loop pass into one update
+    QTimer* m_highlightTimer = nullptr;
+
+    // j/k keep the column they started from across shorter lines
+    qsizetype m_goalColumn = 0;
+    int m_goalPosition = -1; // cursor position the goal column belongs to
+
+    LineNumberArea* m_lineNumbers = nullptr;
+    bool m_textPainted = false;
+    static constexpr int LINE_NUMBER_PADDING = 6;
+
+    // blocks around the viewport that may hold a layout
+    int m_layoutFirst = 0;
+    int m_layoutLast = -1;
+    static constexpr int LAYOUT_MARGIN = 64; // lines kept laid out above and below the viewport
+
+    // normal/visual mode keys
+    CommandParser m_parser;
+    bool m_showingCommand = false;
+    quint32 m_shownCount = 1;
+
+    // yanked and deleted text
+    Registers m_registers;
+
+    // visual block: the corner it started from, and whether $ extended it to the line ends
+    int m_blockAnchor = 0;
+    bool m_blockToLineEnd = false;
+    // block I/A/c: typed on the first line, copied to the rest of the block when insert mode ends
+    BlockEdit::Block m_blockInsert;
+    BlockEdit::Operation m_blockInsertOperation = BlockEdit::Insert;
+    bool m_blockInsertPending = false;
+
+    // the last change and the text typed with it, replayed by .
+    Command m_lastChange;
+    QString m_lastInsert;
+    // command that entered insert mode and where its typing started
+    Command m_insertCommand;
+    int m_insertStart = -1;
+    bool m_insertRepeatable = false;
+
+    // : command line being typed
+    bool m_exMode = false;
+    QString m_exCommand;
+    // lines of the last visual selection, for '< and '>
+    qsizetype m_visualFirst = -1;
+    qsizetype m_visualLast = -1;
+
+    // :s and :g, matched on all cores and applied as one edit
+    ParallelSubstitute* m_substitute = nullptr;
+    Substitution m_lastSubstitution;
+    Substitution m_runningSubstitution;
+    quint64 m_substituteRevision = 0;
+
+    // view: a read-only window of pages over a file of any size
+    PagedFile* m_view = nullptr;
+    int m_viewFirst = 0;                // first page in the window
+    QList<qsizetype> m_viewPageStarts;  // where each page of the window starts in the text
+    qint64 m_viewEnd = 0;               // byte of the file the window ends at
+    qsizetype m_viewFirstLine = -1;     // line of the file the window starts at, -1 until counted
+    qsizetype m_viewPendingLine = -1;   // line to go to once it's counted
+    bool m_viewShowing = false;
+    bool m_viewSearchBackward = false;
+    static constexpr int VIEW_PAGES = 3;
 };
 
 #endif // VIMTEXTEDIT_H
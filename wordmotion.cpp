@@ -0,0 +1,336 @@
+#include "wordmotion.h"
+#include "simd.h"
+#include <QtAlgorithms>
+#include <array>
+
+// Classes
+// --------------
+static constexpr std::array<quint8, 256> makeClassTable()
+{
+    std::array<quint8, 256> table = {};
+    for (int ch = 0; ch < 256; ++ch)
+    {
+        quint8 cls = WordMotion::Punct;
+        if (ch == ' ' || ch == '\t' || ch == '\r' || ch == '\v' || ch == '\f' || ch == 0 || ch == 0xA0)
+            cls = WordMotion::Blank;
+        else if (ch == '\n')
+            cls = WordMotion::LineFeed;
+        else if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_')
+            cls = WordMotion::Word;
+        // Latin-1 letters, without the multiplication and division signs
+        else if (ch >= 0xC0 && ch != 0xD7 && ch != 0xF7)
+            cls = WordMotion::Word;
+        else if (ch == 0xAA || ch == 0xB5 || ch == 0xBA)
+            cls = WordMotion::Word;
+        table[ch] = cls;
+    }
+    return table;
+}
+
+static constexpr std::array<quint8, 256> classTable = makeClassTable();
+
+WordMotion::CharClass WordMotion::classOf(QChar ch, bool bigWord)
+{
+    CharClass cls;
+    const char16_t code = ch.unicode();
+    if (code < 256)
+        cls = CharClass(classTable[code]);
+    else if (ch.isSpace())
+        cls = Blank;
+    else if (ch.isLetterOrNumber() || ch.isMark())
+        cls = Word;
+    else
+        cls = Punct;
+
+    // a WORD is any run of non-blanks
+    if (bigWord && cls == Punct)
+        cls = Word;
+    return cls;
+}
+
+#ifdef VIMMY_SSE2
+/**
+ * @brief movemask (2 bits per char) of the 8 chars whose class is cls, only ASCII chars can match
+ */
+static inline int classMask(__m128i chars, WordMotion::CharClass cls, bool bigWord)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ascii = _mm_cmpeq_epi16(_mm_and_si128(chars, _mm_set1_epi16(short(0xFF80))), zero);
+
+    auto inRange = [](__m128i v, short low, short count) {
+        __m128i offset = _mm_sub_epi16(v, _mm_set1_epi16(low));
+        return _mm_and_si128(_mm_cmpgt_epi16(offset, _mm_set1_epi16(-1)),
+                             _mm_cmplt_epi16(offset, _mm_set1_epi16(count)));
+    };
+
+    const __m128i lineFeed = _mm_cmpeq_epi16(chars, _mm_set1_epi16('\n'));
+    // '\t' '\v' '\f' '\r' ' ' and NUL
+    const __m128i blank = _mm_or_si128(_mm_andnot_si128(lineFeed, inRange(chars, '\t', 5)),
+                                       _mm_or_si128(_mm_cmpeq_epi16(chars, _mm_set1_epi16(' ')),
+                                                    _mm_cmpeq_epi16(chars, zero)));
+    __m128i mask;
+    switch (cls)
+    {
+        case WordMotion::Blank:    mask = blank;    break;
+        case WordMotion::LineFeed: mask = lineFeed; break;
+        default:
+        {
+            const __m128i lower = _mm_or_si128(chars, _mm_set1_epi16(0x20));
+            const __m128i word = _mm_or_si128(_mm_or_si128(inRange(lower, 'a', 26), inRange(chars, '0', 10)),
+                                              _mm_cmpeq_epi16(chars, _mm_set1_epi16('_')));
+            const __m128i nonBlank = _mm_andnot_si128(_mm_or_si128(blank, lineFeed), ascii);
+            if (bigWord)
+                mask = nonBlank;
+            else if (cls == WordMotion::Word)
+                mask = word;
+            else
+                mask = _mm_andnot_si128(word, nonBlank);
+            break;
+        }
+    }
+    return _mm_movemask_epi8(_mm_and_si128(mask, ascii));
+}
+#endif
+
+/**
+ * @brief end of the run of cls chars starting at i in data[0, n)
+ */
+static qsizetype runEnd(const QChar* data, qsizetype i, qsizetype n, WordMotion::CharClass cls, bool bigWord)
+{
+#ifdef VIMMY_SSE2
+    while (i + 8 <= n)
+    {
+        int match = classMask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i)), cls, bigWord);
+        if (match == 0xFFFF)
+        {
+            i += 8;
+            continue;
+        }
+        // the first char that didn't match may still be a non-ASCII char of the class
+        i += qCountTrailingZeroBits(quint32(~match)) / 2;
+        if (WordMotion::classOf(data[i], bigWord) != cls)
+            return i;
+        ++i;
+    }
+#endif
+    while (i < n && WordMotion::classOf(data[i], bigWord) == cls)
+        ++i;
+    return i;
+}
+
+/**
+ * @brief start of the run of cls chars ending right before i in data
+ */
+static qsizetype runStart(const QChar* data, qsizetype i, WordMotion::CharClass cls, bool bigWord)
+{
+#ifdef VIMMY_SSE2
+    while (i >= 8)
+    {
+        int match = classMask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i - 8)), cls, bigWord);
+        if (match == 0xFFFF)
+        {
+            i -= 8;
+            continue;
+        }
+        // the last char that didn't match may still be a non-ASCII char of the class
+        qsizetype last = i - 8 + (31 - qCountLeadingZeroBits(quint32(~match & 0xFFFF))) / 2;
+        if (WordMotion::classOf(data[last], bigWord) != cls)
+            return last + 1;
+        i = last;
+    }
+#endif
+    while (i > 0 && WordMotion::classOf(data[i - 1], bigWord) == cls)
+        --i;
+    return i;
+}
+// --------------
+
+// Scanner
+// --------------
+namespace {
+
+// position in the buffer remembering the piece it is in
+class Scanner
+{
+public:
+    Scanner(const TextBuffer& buffer, qsizetype pos, bool bigWord)
+        : m_buffer(buffer)
+        , m_length(buffer.length())
+        , m_bigWord(bigWord)
+        , m_pos(qBound(qsizetype(0), pos, m_length))
+    {
+    }
+
+    inline qsizetype position() const { return m_pos; }
+    inline bool atStart() const { return m_pos <= 0; }
+    inline bool atEnd() const { return m_pos >= m_length; }
+
+    // class of the char at pos + offset, blank outside the text
+    WordMotion::CharClass classAt(qsizetype offset = 0)
+    {
+        qsizetype pos = m_pos + offset;
+        if (pos < 0 || pos >= m_length)
+            return WordMotion::Blank;
+        load(pos);
+        return WordMotion::classOf(m_span.text[pos - m_span.start], m_bigWord);
+    }
+
+    inline void step(qsizetype offset) { m_pos = qBound(qsizetype(0), m_pos + offset, m_length); }
+
+    // moves past the run of cls chars starting at pos
+    void skipForward(WordMotion::CharClass cls)
+    {
+        while (m_pos < m_length)
+        {
+            load(m_pos);
+            const qsizetype size = m_span.text.size();
+            qsizetype end = runEnd(m_span.text.data(), m_pos - m_span.start, size, cls, m_bigWord);
+            m_pos = m_span.start + end;
+            if (end < size)
+                break;
+        }
+    }
+
+    // moves back to the start of the run of cls chars ending right before pos
+    void skipBackward(WordMotion::CharClass cls)
+    {
+        while (m_pos > 0)
+        {
+            load(m_pos - 1);
+            qsizetype start = runStart(m_span.text.data(), m_pos - m_span.start, cls, m_bigWord);
+            m_pos = m_span.start + start;
+            if (start > 0)
+                break;
+        }
+    }
+
+private:
+    inline void load(qsizetype pos)
+    {
+        if (pos < m_span.start || pos >= m_span.start + m_span.text.size())
+            m_span = m_buffer.spanAt(pos);
+    }
+
+    const TextBuffer& m_buffer;
+    TextBuffer::Span m_span;
+    qsizetype m_length;
+    bool m_bigWord;
+    qsizetype m_pos;
+};
+
+inline bool atEmptyLine(Scanner& it)
+{
+    return it.classAt() == WordMotion::LineFeed && (it.atStart() || it.classAt(-1) == WordMotion::LineFeed);
+}
+
+// skips blanks forwards from pos, stopping at an empty line
+void skipBlanksForward(Scanner& it)
+{
+    while (!it.atEnd())
+    {
+        it.skipForward(WordMotion::Blank);
+        if (it.classAt() != WordMotion::LineFeed)
+            return;
+        it.step(1);
+        if (it.classAt() == WordMotion::LineFeed)
+            return;
+    }
+}
+
+// skips blanks backwards from pos, stopping at an empty line or the start
+void skipBlanksBackward(Scanner& it)
+{
+    while (!it.atStart() && !atEmptyLine(it))
+    {
+        WordMotion::CharClass cls = it.classAt();
+        if (cls == WordMotion::LineFeed)
+            it.step(-1);
+        else if (cls == WordMotion::Blank)
+        {
+            it.step(1);
+            it.skipBackward(WordMotion::Blank);
+            if (!it.atStart())
+                it.step(-1);
+        }
+        else
+            return;
+    }
+}
+
+} // namespace
+// --------------
+
+// Motions
+// --------------
+qsizetype WordMotion::move(const TextBuffer& buffer, qsizetype pos, Motion motion, bool bigWord, int count)
+{
+    Scanner it(buffer, pos, bigWord);
+    for (int i = 0; i < count; ++i)
+    {
+        switch (motion)
+        {
+            // w: start of the next word (an empty line counts as a word)
+            case NextWordStart:
+            {
+                CharClass cls = it.classAt();
+                if (!isBlank(cls))
+                    it.skipForward(cls);
+                else if (cls == LineFeed)
+                {
+                    it.step(1);
+                    if (it.classAt() == LineFeed)
+                        break;
+                }
+                skipBlanksForward(it);
+                break;
+            }
+
+            // e: end of the current/next word
+            case NextWordEnd:
+            {
+                it.step(1);
+                while (!it.atEnd() && isBlank(it.classAt()))
+                    it.skipForward(it.classAt());
+                if (it.atEnd())
+                    break;
+                it.skipForward(it.classAt());
+                it.step(-1);
+                break;
+            }
+
+            // b: start of the current/previous word (an empty line counts as a word)
+            case PrevWordStart:
+            {
+                if (it.atStart())
+                    break;
+                it.step(-1);
+                skipBlanksBackward(it);
+                CharClass cls = it.classAt();
+                if (!isBlank(cls))
+                {
+                    it.step(1);
+                    it.skipBackward(cls);
+                }
+                break;
+            }
+
+            // ge: end of the previous word (an empty line counts as a word)
+            case PrevWordEnd:
+            {
+                CharClass cls = it.classAt();
+                if (!isBlank(cls))
+                {
+                    it.step(1);
+                    it.skipBackward(cls);
+                }
+                if (it.atStart())
+                    break;
+                it.step(-1);
+                skipBlanksBackward(it);
+                break;
+            }
+        }
+    }
+    return it.position();
+}
+// --------------
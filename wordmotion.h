@@ -0,0 +1,30 @@
+#ifndef WORDMOTION_H
+#define WORDMOTION_H
+
+#include "textbuffer.h"
+#include <QChar>
+
+/**
+ * @brief Vim word and WORD motions (w, b, e, ge and W, B, E, gE) over a TextBuffer
+ *
+ * Chars below 256 are classified with a lookup table, the rest by their
+ * Unicode category. Runs of same-class chars are skipped 8 chars at a time
+ * with SIMD classification, walking the buffer's pieces in place, so a
+ * counted motion like 1000w is a single linear scan.
+ */
+class WordMotion
+{
+public:
+    enum Motion {NextWordStart = 0, NextWordEnd, PrevWordStart, PrevWordEnd};
+    // line feeds are blanks with a class of their own, because an empty line counts as a word
+    enum CharClass : quint8 {Blank = 0, LineFeed, Punct, Word};
+
+    // position after moving count words from pos
+    static qsizetype move(const TextBuffer& buffer, qsizetype pos, Motion motion,
+                          bool bigWord = false, int count = 1);
+
+    static CharClass classOf(QChar ch, bool bigWord = false);
+    static inline bool isBlank(CharClass cls) { return cls == Blank || cls == LineFeed; }
+};
+
+#endif // WORDMOTION_H